@@ -3,6 +3,7 @@ include $(CLEAR_VARS)
 
 LOCAL_C_INCLUDES := \
   external/sedget/ta/include/optee/ \
+  external/sedget/ta/arm/mve/ \
   external/optee_client/public \
   $(LOCAL_PATH)/include \
   $(LOCAL_PATH)/src/include
@@ -14,9 +15,35 @@ LOCAL_SHARED_LIBRARIES := \
 
 LOCAL_SRC_FILES := \
   src/memory/protected_mem.c \
+  src/memory/prot_pool.c \
+  src/memory/frame_buf.c \
+  src/memory/input_buf.c \
+  src/memory/prot_inject.c \
+  src/memory/scrub_queue.c \
+  src/memory/broker_client.c \
   src/arm/mve_fw.c \
-  src/optee/tee_service.c
+  src/optee/tee_service.c \
+  src/optee/tee_workers.c
 
 LOCAL_MODULE := libsedget_video
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES := \
+  external/sedget/ta/include/optee/ \
+  $(LOCAL_PATH)/include \
+  $(LOCAL_PATH)/src/include
+
+LOCAL_SHARED_LIBRARIES := \
+  liblog \
+  libcutils \
+  libsedget_video
+
+LOCAL_SRC_FILES := \
+  broker/sedget_brokerd.c
+
+LOCAL_MODULE := sedget_brokerd
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
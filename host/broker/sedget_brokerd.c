@@ -0,0 +1,423 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+/*
+ * Protected buffer broker. Allocates buffers from its own heaps for the
+ * processes that ask with sedget_alloc_brokered_buf(), handing them
+ * dma-buf fds over a Unix socket; it opens no TEE session. Every buffer is
+ * allocated anew and the broker holds an fd of it until it is released.
+ * Buffers released by a client, or left by a client that goes away, are
+ * dropped rather than handed to the next one: the client may still hold
+ * dups of the fd or have passed it on to other processes, and there is no
+ * way to tell when the last of them is closed. The memory goes back to its
+ * heap once every holder closed its fd.
+ *
+ * Clients are not authenticated: whoever can connect to the socket, as its
+ * file permissions allow, may allocate up to MAX_CLIENT_BUFS buffers.
+ */
+#define LOG_TAG "SEDGET_BROKER"
+#include <cutils/log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sedget_video.h"
+#include "broker_proto.h"
+
+#define MAX_CLIENTS		32
+#define MAX_CLIENT_BUFS		128
+#define PAGE_SIZE_4K		4096
+
+struct broker_buf {
+	uint32_t id;			/* 0 for a free slot */
+	int fd;
+	size_t size;
+	uint32_t type;
+	int owner;			/* client index */
+	sedget_protected_buffer *prot_buf;
+};
+
+/* Where buffers come from */
+struct broker_backend {
+	const char *name;
+	int (*alloc)(struct broker_buf *buf);
+	void (*destroy)(struct broker_buf *buf);
+};
+
+static struct {
+	const struct broker_backend *backend;
+	struct broker_buf *bufs;
+	size_t num_bufs;
+	uint32_t next_id;
+} broker = {
+	.next_id = 1,
+};
+
+static int ion_alloc(struct broker_buf *buf)
+{
+	buf->prot_buf = sedget_alloc_prot_buf(buf->size, buf->type);
+	if (buf->prot_buf == NULL)
+		return -errno;
+
+	buf->fd = sedget_get_mem_fd(buf->prot_buf);
+
+	return 0;
+}
+
+static void ion_destroy(struct broker_buf *buf)
+{
+	sedget_free_prot_buf(buf->prot_buf);
+}
+
+static const struct broker_backend ion_backend = {
+	.name = "ion",
+	.alloc = ion_alloc,
+	.destroy = ion_destroy,
+};
+
+/* Non-secure memfd buffers, to exercise the broker without a TEE */
+static int memfd_alloc(struct broker_buf *buf)
+{
+	buf->fd = memfd_create("sedget_broker", MFD_CLOEXEC);
+	if (buf->fd < 0)
+		return -errno;
+
+	if (ftruncate(buf->fd, buf->size) != 0) {
+		int ret = -errno;
+
+		close(buf->fd);
+		return ret;
+	}
+
+	return 0;
+}
+
+static void memfd_destroy(struct broker_buf *buf)
+{
+	close(buf->fd);
+}
+
+static const struct broker_backend memfd_backend = {
+	.name = "memfd",
+	.alloc = memfd_alloc,
+	.destroy = memfd_destroy,
+};
+
+static struct broker_buf *find_buf(uint32_t id)
+{
+	size_t i;
+
+	for (i = 0; i < broker.num_bufs; i++)
+		if (broker.bufs[i].id == id)
+			return &broker.bufs[i];
+
+	return NULL;
+}
+
+static struct broker_buf *new_buf_slot(void)
+{
+	struct broker_buf *bufs;
+	size_t i, n;
+
+	for (i = 0; i < broker.num_bufs; i++)
+		if (broker.bufs[i].id == 0)
+			return &broker.bufs[i];
+
+	n = broker.num_bufs ? broker.num_bufs * 2 : 16;
+	bufs = realloc(broker.bufs, n * sizeof(*bufs));
+	if (bufs == NULL)
+		return NULL;
+
+	memset(bufs + broker.num_bufs, 0,
+	       (n - broker.num_bufs) * sizeof(*bufs));
+	broker.bufs = bufs;
+	i = broker.num_bufs;
+	broker.num_bufs = n;
+
+	return &broker.bufs[i];
+}
+
+static void drop_buf(struct broker_buf *buf)
+{
+	broker.backend->destroy(buf);
+	memset(buf, 0, sizeof(*buf));
+}
+
+static uint32_t take_id(void)
+{
+	uint32_t id;
+
+	/* ids live in the int array of the client handle */
+	do {
+		id = broker.next_id++ & INT32_MAX;
+	} while (id == 0 || find_buf(id));
+
+	return id;
+}
+
+static size_t count_client_bufs(int client)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < broker.num_bufs; i++)
+		if (broker.bufs[i].id && broker.bufs[i].owner == client)
+			n++;
+
+	return n;
+}
+
+static int handle_alloc(int client, const struct broker_req *req,
+			struct broker_rsp *rsp, int *fd)
+{
+	size_t size = (req->size + PAGE_SIZE_4K - 1) & ~(size_t)(PAGE_SIZE_4K - 1);
+	struct broker_buf *buf;
+	int ret;
+
+	if (req->size == 0 || req->size > SIZE_MAX - PAGE_SIZE_4K ||
+	    req->type > SEDGET_BUF_FRAME)
+		return -EINVAL;
+
+	if (count_client_bufs(client) >= MAX_CLIENT_BUFS)
+		return -EDQUOT;
+
+	buf = new_buf_slot();
+	if (buf == NULL)
+		return -ENOMEM;
+
+	buf->size = size;
+	buf->type = req->type;
+	ret = broker.backend->alloc(buf);
+	if (ret != 0) {
+		memset(buf, 0, sizeof(*buf));
+		return ret;
+	}
+	buf->id = take_id();
+	buf->owner = client;
+	rsp->id = buf->id;
+	rsp->size = buf->size;
+	*fd = buf->fd;
+
+	return 0;
+}
+
+static int handle_release(int client, const struct broker_req *req)
+{
+	struct broker_buf *buf = req->id ? find_buf(req->id) : NULL;
+
+	if (buf == NULL || buf->owner != client)
+		return -EINVAL;
+
+	/* other holders may remain, so the buffer is never reused */
+	drop_buf(buf);
+
+	return 0;
+}
+
+static void drop_client_bufs(int client)
+{
+	size_t i;
+
+	for (i = 0; i < broker.num_bufs; i++)
+		if (broker.bufs[i].id && broker.bufs[i].owner == client)
+			drop_buf(&broker.bufs[i]);
+}
+
+static int send_rsp(int sock, const struct broker_rsp *rsp, int fd)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} ctrl;
+	struct iovec iov = { (void *)rsp, sizeof(*rsp) };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (fd >= 0) {
+		msg.msg_control = ctrl.buf;
+		msg.msg_controllen = sizeof(ctrl.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) == sizeof(*rsp) ? 0 : -errno;
+}
+
+/* Serve one request; a non zero return closes the connection */
+static int serve_client(int client, int sock)
+{
+	struct broker_req req;
+	struct broker_rsp rsp;
+	int fd = -1;
+	ssize_t len;
+
+	len = recv(sock, &req, sizeof(req), 0);
+	if (len != sizeof(req) || req.magic != BROKER_MAGIC)
+		return -EPROTO;
+
+	memset(&rsp, 0, sizeof(rsp));
+	rsp.magic = BROKER_MAGIC;
+
+	switch (req.op) {
+	case BROKER_OP_ALLOC:
+		rsp.result = handle_alloc(client, &req, &rsp, &fd);
+		break;
+	case BROKER_OP_RELEASE:
+		rsp.result = handle_release(client, &req);
+		break;
+	default:
+		rsp.result = -EINVAL;
+		break;
+	}
+
+	return send_rsp(sock, &rsp, fd);
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(sock, MAX_CLIENTS) != 0) {
+		int ret = -errno;
+
+		close(sock);
+		return ret;
+	}
+
+	return sock;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s socket] [-m]\n"
+		"  -s  socket path (default %s)\n"
+		"  -m  serve non-secure memfd buffers, for testing; needs -s\n"
+		"      with another socket path\n",
+		prog, BROKER_SOCKET_PATH);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pollfd pfd[1 + MAX_CLIENTS];
+	const char *path = BROKER_SOCKET_PATH;
+	int nclients = 0;
+	int opt, i;
+
+	broker.backend = &ion_backend;
+
+	while ((opt = getopt(argc, argv, "s:m")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+		case 'm':
+			broker.backend = &memfd_backend;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* clients of the default socket expect protected buffers */
+	if (broker.backend == &memfd_backend &&
+	    strcmp(path, BROKER_SOCKET_PATH) == 0) {
+		fprintf(stderr, "-m needs -s with another socket path\n");
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	pfd[0].fd = listen_on(path);
+	pfd[0].events = POLLIN;
+	if (pfd[0].fd < 0) {
+		ALOGE("Failed to listen on %s: %d", path, pfd[0].fd);
+		return EXIT_FAILURE;
+	}
+
+	ALOGI("Serving %s buffers on %s", broker.backend->name, path);
+
+	for (;;) {
+		if (poll(pfd, 1 + nclients, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			ALOGE("poll failed: %s", strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		/* serve or drop clients, the last one moving into a dropped slot */
+		for (i = nclients; i >= 1; i--) {
+			if (!pfd[i].revents)
+				continue;
+			if (!(pfd[i].revents & POLLIN) ||
+			    serve_client(i, pfd[i].fd) != 0) {
+				close(pfd[i].fd);
+				drop_client_bufs(i);
+				if (i != nclients) {
+					size_t j;
+
+					pfd[i] = pfd[nclients];
+					for (j = 0; j < broker.num_bufs; j++)
+						if (broker.bufs[j].id &&
+						    broker.bufs[j].owner == nclients)
+							broker.bufs[j].owner = i;
+				}
+				nclients--;
+			}
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			int sock = accept4(pfd[0].fd, NULL, NULL, SOCK_CLOEXEC);
+
+			if (sock < 0)
+				continue;
+			if (nclients == MAX_CLIENTS) {
+				ALOGE("Too many clients");
+				close(sock);
+				continue;
+			}
+			nclients++;
+			pfd[nclients].fd = sock;
+			pfd[nclients].events = POLLIN;
+			pfd[nclients].revents = 0;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
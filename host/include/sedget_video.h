@@ -6,6 +6,8 @@
 #ifndef __SEDGET_VIDEO_H__
 #define __SEDGET_VIDEO_H__
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -18,6 +20,8 @@ typedef void sedget_protected_buffer;
  *  SEDGET_BUF_INPUT		: video codec input buffer(s) holding bitstream
  *  SEDGET_BUF_INTERMEDIATE	: video codec engine working buffer(s)
  *  SEDGET_BUF_FIRMWARE		: video codec firmware working buffer(s)
+ *  SEDGET_BUF_FRAME		: decoded reference and output frame(s), see
+ *				  sedget_frame_buf_size()
  *
  * Buffer type 'SEDGET_BUF_INTERMEDIATE' and 'SEDGET_BUF_FIRMWARE'
  * allocation depends on hardware codec types. These two buffer types
@@ -26,9 +30,83 @@ typedef void sedget_protected_buffer;
 typedef enum _sedget_buf_type {
 	SEDGET_BUF_INPUT,
 	SEDGET_BUF_INTERMEDIATE,
-	SEDGET_BUF_FIRMWARE
+	SEDGET_BUF_FIRMWARE,
+	SEDGET_BUF_FRAME
 } sedget_buf_type;
 
+/* Most heaps a buffer type can be allocated from */
+#define SEDGET_HEAP_ORDER_MAX	8
+
+/*
+ * Select the ION heaps buffers of 'type' are allocated from, for this
+ * process, in order of preference. Each allocation tries them in turn until
+ * one succeeds. A heap whose allocations failed or were slow three times in
+ * a row is tried after the others for a second, then twice as long each
+ * time it does it again, so that allocation stays fast while one heap is
+ * under pressure. Buffers obtained through the broker come from the heaps
+ * of the broker process. SEDGET_BUF_FIRMWARE buffers may come from a page
+ * granular heap, which is then best listed after the default one.
+ *
+ * @param type		Protected buffer type
+ * @param heap_ids	ION heap ids, most preferred first
+ * @param count		Number of ids, 0 restores the default heaps
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ */
+int sedget_set_heap_order(sedget_buf_type type, const unsigned int *heap_ids,
+			  size_t count);
+
+/*
+ * Same as sedget_set_heap_order with the heaps of a mask of ION heap ids,
+ * lowest id first. A mask of 0 restores the default heaps.
+ */
+int sedget_set_heap_mask(sedget_buf_type type, unsigned int heap_id_mask);
+
+/* Allocations from one ION heap by this process */
+struct sedget_heap_stats {
+	unsigned int attempts;
+	unsigned int failures;
+	unsigned int slow;		/* successful but slow */
+	unsigned int avg_latency_us;	/* moving average of successful ones */
+	int deprioritized;		/* currently tried after other heaps */
+};
+
+/*
+ * Get the allocation statistics of ION heap 'heap_id'.
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ */
+int sedget_get_heap_stats(unsigned int heap_id,
+			  struct sedget_heap_stats *stats);
+
+/*
+ * Decoded frame layouts:
+ *  SEDGET_FRAME_NV12		: 8-bit 4:2:0, Y plane then interleaved CbCr
+ *  SEDGET_FRAME_P010		: 10-bit 4:2:0 as NV12 with 16-bit samples
+ *  SEDGET_FRAME_AFBC_8		: 8-bit 4:2:0 AFBC, 16x16 superblocks
+ *  SEDGET_FRAME_AFBC_10	: 10-bit 4:2:0 AFBC, 16x16 superblocks
+ */
+typedef enum _sedget_frame_format {
+	SEDGET_FRAME_NV12,
+	SEDGET_FRAME_P010,
+	SEDGET_FRAME_AFBC_8,
+	SEDGET_FRAME_AFBC_10
+} sedget_frame_format;
+
+/*
+ * Size in bytes of a SEDGET_BUF_FRAME buffer holding one frame. Lines are
+ * padded to 64 bytes and the frame to whole 16x16 blocks, as the codec
+ * writes them.
+ *
+ * @param format	Frame layout
+ * @param width		Frame width in pixels, up to 8192
+ * @param height	Frame height in pixels, up to 8192
+ *
+ * @return the size in bytes, 0 if the format or dimensions are invalid.
+ */
+size_t sedget_frame_buf_size(sedget_frame_format format, unsigned int width,
+			     unsigned int height);
+
 /*
  * Allocate protected buffer for video codec
  *
@@ -41,6 +119,291 @@ typedef enum _sedget_buf_type {
 sedget_protected_buffer *sedget_alloc_prot_buf(size_t mem_size,
 					       sedget_buf_type type);
 
+/*
+ * Allocate a protected buffer from the sedget_brokerd broker rather than in
+ * this process. Every buffer is allocated anew and costs a round trip to
+ * the broker, which keeps a reference to it until it is freed.
+ *
+ * @param mem_size Protected buffer size in bytes
+ * @param type     Protected buffer type
+ *
+ * @return Pointer to 'sedget_protected_buffer' object is returned
+ *         NULL indicates a failure and errno is set, to ENOTCONN when no
+ *         broker is running and to EDQUOT when the broker already holds
+ *         too many buffers of this process.
+ */
+sedget_protected_buffer *sedget_alloc_brokered_buf(size_t mem_size,
+						   sedget_buf_type type);
+
+/* Opaque pool of protected buffers of one type and size */
+typedef struct _sedget_buf_pool sedget_buf_pool;
+
+/* Scrub buffers put back into the pool before handing them out again */
+#define SEDGET_POOL_SCRUB	(1 << 0)
+
+/*
+ * Create a pool recycling up to 'max_bufs' protected buffers of 'mem_size'
+ * bytes. Buffers are allocated on first demand and kept until the pool is
+ * destroyed, so steady state playback allocates nothing.
+ *
+ * @param mem_size	Size in bytes of each buffer
+ * @param type		Protected buffer type
+ * @param max_bufs	Number of buffers the pool may hold
+ * @param flags		SEDGET_POOL_* flags
+ *
+ * @return Pointer to the pool, NULL indicates a failure and errno is set.
+ */
+sedget_buf_pool *sedget_create_buf_pool(size_t mem_size, sedget_buf_type type,
+					size_t max_bufs, unsigned int flags);
+
+/*
+ * Free every buffer of the pool and the pool. Pending scrubs are waited
+ * for.
+ *
+ * @return 0 on success, -EBUSY if buffers were not put back.
+ */
+int sedget_destroy_buf_pool(sedget_buf_pool *pool);
+
+/*
+ * Take a buffer from the pool, allocating it if the pool holds fewer than
+ * 'max_bufs' buffers.
+ *
+ * @return Pointer to 'sedget_protected_buffer' object, NULL indicates a
+ * 	failure and errno is set. EBUSY means all buffers are in use.
+ */
+sedget_protected_buffer *sedget_pool_get(sedget_buf_pool *pool);
+
+/*
+ * Give a buffer taken by sedget_pool_get back to the pool. With
+ * SEDGET_POOL_SCRUB it is handed out again only once scrubbed, and freed
+ * if scrubbing fails. The caller loses ownership in any case.
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ */
+int sedget_pool_put(sedget_buf_pool *pool, sedget_protected_buffer *prot_buf);
+
+/* Size in bytes of the buffers of 'pool' */
+size_t sedget_pool_buf_size(const sedget_buf_pool *pool);
+
+/*
+ * Allocate buffers ahead of sedget_pool_get, e.g. while the firmware
+ * loads, so that stream start does not wait for large allocations.
+ *
+ * @param pool		Pool to fill
+ * @param count		Number of idle buffers wanted, at most 'max_bufs'
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ */
+int sedget_pool_prefill(sedget_buf_pool *pool, size_t count);
+
+/*
+ * Change the size of the buffers of 'pool'. Idle buffers are freed now,
+ * buffers in use when they are put back; new buffers get the new size.
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ */
+int sedget_pool_resize(sedget_buf_pool *pool, size_t mem_size);
+
+/*
+ * Create a pool of SEDGET_BUF_FRAME buffers sized for 'format' at
+ * 'width' x 'height', see sedget_create_buf_pool().
+ *
+ * @return Pointer to the pool, NULL indicates a failure and errno is set.
+ */
+sedget_buf_pool *sedget_create_frame_pool(sedget_frame_format format,
+					  unsigned int width,
+					  unsigned int height,
+					  size_t max_bufs, unsigned int flags);
+
+/*
+ * Prepare a frame pool for a new sequence. Buffers are kept when they
+ * still fit frames of the new sequence without wasting more than half of
+ * their size, which covers sequences of the same resolution; otherwise the
+ * pool is resized.
+ *
+ * @param pool		Pool created by sedget_create_frame_pool
+ * @param format	Frame layout of the new sequence
+ * @param width		Frame width in pixels
+ * @param height	Frame height in pixels
+ *
+ * @return 0 if buffers are kept, 1 if the pool was resized, or an negative
+ * 	errno indicates error occured.
+ */
+int sedget_frame_pool_configure(sedget_buf_pool *pool,
+				sedget_frame_format format,
+				unsigned int width, unsigned int height);
+
+/*
+ * Compressed formats of SEDGET_BUF_INPUT buffers
+ */
+typedef enum _sedget_codec {
+	SEDGET_CODEC_AVC,
+	SEDGET_CODEC_HEVC,
+	SEDGET_CODEC_VP8,
+	SEDGET_CODEC_VP9,
+	SEDGET_CODEC_MPEG2,
+	SEDGET_CODEC_MPEG4,
+	SEDGET_CODEC_VC1,
+	SEDGET_CODEC_RV,
+	SEDGET_CODEC_JPEG
+} sedget_codec;
+
+/* general_tier_flag of HEVC streams, or'ed to their level */
+#define SEDGET_LEVEL_HIGH_TIER	0x100
+
+/*
+ * Size in bytes of a SEDGET_BUF_INPUT buffer holding one access unit of a
+ * stream. It starts from the largest access unit the codec level allows
+ * at 10 frames per second or more, within the CPB size of the level, and,
+ * once access units of streams of the same kind were reported with
+ * sedget_input_pool_observe(), follows twice the largest of them. Sizes
+ * are rounded up to a few size classes, so that similar streams share
+ * buffer sizes.
+ *
+ * @param codec		Compressed format
+ * @param profile	profile_idc of AVC and HEVC, profile of VP9; 0 if
+ *			unknown or for other codecs. HEVC range extension
+ *			and later profiles are not supported.
+ * @param level		level_idc of AVC, general_level_idc of HEVC, with
+ *			SEDGET_LEVEL_HIGH_TIER for High tier HEVC streams;
+ *			0 if unknown or for other codecs
+ * @param width		Frame width in pixels, up to 8192
+ * @param height	Frame height in pixels, up to 8192
+ *
+ * @return the size in bytes, 0 if the codec, profile or dimensions are
+ *	   invalid or not supported.
+ */
+size_t sedget_input_buf_size(sedget_codec codec, unsigned int profile,
+			     unsigned int level, unsigned int width,
+			     unsigned int height);
+
+/*
+ * Create a pool of 'count' SEDGET_BUF_INPUT buffers sized by
+ * sedget_input_buf_size() for a stream, and allocate them.
+ *
+ * @return Pointer to the pool, NULL indicates a failure and errno is set.
+ */
+sedget_buf_pool *sedget_alloc_input_for_stream(sedget_codec codec,
+					       unsigned int profile,
+					       unsigned int level,
+					       unsigned int width,
+					       unsigned int height,
+					       size_t count);
+
+/*
+ * Report the size of an access unit of the stream of an input pool,
+ * before taking a buffer for it. The pool grows at once when the unit does
+ * not fit its buffers, and shrinks when the sizes learnt for this kind of
+ * stream need less than half of them.
+ *
+ * @param pool		Pool created by sedget_alloc_input_for_stream
+ * @param len		Size in bytes of the access unit
+ *
+ * @return 0 if buffers are kept, 1 if the pool was resized, or an negative
+ * 	errno indicates error occured.
+ */
+int sedget_input_pool_observe(sedget_buf_pool *pool, size_t len);
+
+/*
+ * One compressed access unit to copy into protected memory
+ */
+typedef struct _sedget_inject_unit {
+	size_t src_offset;		/* Offset in the staging buffer */
+	sedget_protected_buffer *dst;	/* SEDGET_BUF_INPUT buffer */
+	size_t dst_offset;		/* Offset in 'dst' */
+	size_t len;			/* Bytes to copy */
+	int result;			/* Set to 0 or a negative errno */
+} sedget_inject_unit;
+
+/*
+ * Copy a batch of access units from a non-secure staging buffer into
+ * protected input buffers. Units are handed to the secure world in as few
+ * invocations as possible; consecutive units going to the same one or two
+ * buffers travel together.
+ *
+ * @param staging	Non-secure buffer holding the access units
+ * @param staging_size	Size in bytes of the staging buffer
+ * @param units		Units to copy, 'result' is set for each of them
+ * @param count		Number of units
+ *
+ * @return the number of units copied, or a negative errno if some units
+ * 	could not be submitted; 'result' then tells which ones were copied.
+ */
+int sedget_inject_input(const void *staging, size_t staging_size,
+			sedget_inject_unit *units, size_t count);
+
+/*
+ * Zero a range of a protected buffer, typically before reusing it for
+ * another session or client. Zeroes reach memory before this returns.
+ *
+ * @param prot_buf	Pointer to 'sedget_protected_buffer' object
+ * @param offset	Start of the range in bytes
+ * @param len		Length of the range, 0 for up to the buffer end
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ */
+int sedget_scrub_prot_buf(sedget_protected_buffer *prot_buf,
+			  size_t offset, size_t len);
+
+/*
+ * Completion of a scrub queued by sedget_scrub_prot_buf_async, called from
+ * the scrub thread with 0 or a negative errno. It may free or recycle
+ * 'prot_buf'.
+ */
+typedef void (*sedget_scrub_done)(sedget_protected_buffer *prot_buf,
+				  int result, void *arg);
+
+/*
+ * Queue a range of a protected buffer for scrubbing in the background.
+ * Ranges queued close together are zeroed in the same secure world
+ * invocation. 'prot_buf' must not be used nor freed until 'done' is called.
+ *
+ * @param prot_buf	Pointer to 'sedget_protected_buffer' object
+ * @param offset	Start of the range in bytes
+ * @param len		Length of the range, 0 for up to the buffer end
+ * @param done		Completion callback, may be NULL
+ * @param arg		Passed to 'done'
+ *
+ * @return 0 if queued or an negative errno indicates error occured.
+ */
+int sedget_scrub_prot_buf_async(sedget_protected_buffer *prot_buf,
+				size_t offset, size_t len,
+				sedget_scrub_done done, void *arg);
+
+/*
+ * Wait until every scrub queued so far completed and its callback
+ * returned.
+ */
+void sedget_scrub_wait_idle(void);
+
+/*
+ * Firmware load descriptors returned by sedget_load_prot_firmware, as laid
+ * out by the Trusted Application (ta/arm/mve/mve_fw_mmu.h).
+ */
+struct mve_fw_version {
+	uint8_t major;			/* Firmware major version */
+	uint8_t minor;			/* Firmware minor version */
+};
+
+/* One L2 page table per core, consecutive from l2pages */
+struct mve_fw_secure_descriptor {
+	struct mve_fw_version fw_version; /* FW protocol version */
+	uint32_t l2pages;		/* Physical address of the L2 page tables */
+};
+
+/*
+ * Returned when out_size leaves room for it. Each core gets an L1 page table
+ * whose first num_l2pages entries map the firmware; the driver copies them
+ * into the L1 table of the session.
+ */
+struct mve_fw_secure_descriptor_ext {
+	struct mve_fw_secure_descriptor base; /* l2pages is 0 unless it can describe the tables alone */
+	uint32_t num_l2pages;		/* L2 page tables per core */
+	uint32_t reserved;		/* Always 0 */
+	uint64_t l1pages;		/* Physical address of the L1 page tables, one per core */
+	uint64_t l2pages;		/* Physical address of the L2 page tables, num_l2pages per core */
+};
+
 /*
  * Load 'role' specified firmware into secure memory and return result in
  * user provided buffer
@@ -49,8 +412,14 @@ sedget_protected_buffer *sedget_alloc_prot_buf(size_t mem_size,
  * @param num_cores	Number of cores of MVE in the hardware
  * @param out		Pagetable items are created and returned in 'out' after
  *			firmware is loaded into specified position
- * @param out_size	Size in bytes of memory pointed by out. An out of
- * 			memory error is returned if out_size is not big enough
+ * @param out_size	Size in bytes of memory pointed by out. With
+ * 			sizeof(struct mve_fw_secure_descriptor_ext) or
+ * 			more, that descriptor is returned and per-core L1
+ * 			tables are built, which lifts the one L2 table per
+ * 			core and 32-bit physical address limits. Otherwise a
+ * 			struct mve_fw_secure_descriptor is returned, and
+ * 			errno is set to EOVERFLOW if the page tables need
+ * 			the extended one; the size needed is logged.
  *
  * @return Pointer to 'sedget_protected_buffer' object is returned. NULL
  * 	indicates a failure and errno is set.
@@ -61,8 +430,58 @@ sedget_protected_buffer *sedget_load_prot_firmware(const char *role,
 						   size_t out_size);
 
 /*
- * Free secure memory allocated by sedget_alloc_prot_buf and
- * sedget_load_prot_firmware.
+ * Replace the firmware loaded by sedget_load_prot_firmware with the one of
+ * another role, e.g. when a stream switches codec, reusing the protected
+ * buffer instead of freeing it and allocating a new one. The TEE session
+ * and the registration of the buffer are kept from one reload to the next;
+ * the TA still translates the pages of the buffer, decrypts the whole new
+ * image and rebuilds the pagetable items every time. The MVE must not run
+ * the firmware meanwhile; on failure the buffer holds no usable firmware.
+ *
+ * @param prot_buf	Firmware buffer returned by sedget_load_prot_firmware
+ * @param role		Firmware codec type to be loaded
+ * @param num_cores	Number of cores of MVE in the hardware
+ * @param out		Pagetable items are returned in 'out', as with
+ *			sedget_load_prot_firmware
+ * @param out_size	Size in bytes of memory pointed by out
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ * 	-ENOSPC means the new firmware does not fit in the buffer; free it
+ * 	and use sedget_load_prot_firmware instead. -EOVERFLOW means out_size
+ * 	is too small, as with sedget_load_prot_firmware.
+ */
+int sedget_reload_prot_firmware(sedget_protected_buffer *prot_buf,
+				const char *role,
+				int num_cores,
+				void *out,
+				size_t out_size);
+
+/*
+ * Rebuild the pagetable items of a firmware loaded by
+ * sedget_load_prot_firmware for another number of cores. The firmware is
+ * not decrypted again; per-core pages are added or removed. The MVE must
+ * not run the firmware while it is rescaled.
+ *
+ * @param prot_buf	Firmware buffer returned by sedget_load_prot_firmware
+ * @param num_cores	New number of cores
+ * @param out		Updated pagetable items are returned in 'out'
+ * @param out_size	Size in bytes of memory pointed by out
+ *
+ * @return 0 on success or an negative errno indicates error occured.
+ * 	-ENOSPC means the buffer has no room for that many cores.
+ * 	-EOVERFLOW means out_size is too small, as with
+ * 	sedget_load_prot_firmware.
+ * 	-ENOTSUP means the firmware must be loaded again instead.
+ */
+int sedget_rescale_prot_firmware(sedget_protected_buffer *prot_buf,
+				 int num_cores,
+				 void *out,
+				 size_t out_size);
+
+/*
+ * Free secure memory allocated by sedget_alloc_prot_buf,
+ * sedget_alloc_brokered_buf and sedget_load_prot_firmware. Firmware buffers are wiped first, so the MVE
+ * must not run their firmware anymore.
  *
  * @param prot_buf	Pointer to 'sedget_protected_buffer' object previously
  * 			allocated
@@ -0,0 +1,402 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#ifndef __SEDGET_VIDEO_HPP__
+#define __SEDGET_VIDEO_HPP__
+
+/*
+ * Header only C++17 layer over sedget_video.h. Nothing here throws; errors
+ * are reported through std::error_code holding the errno of the C API.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <memory_resource>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "sedget_video.h"
+
+namespace sedget {
+
+inline std::error_code errno_code(int err) noexcept
+{
+	return std::error_code(err < 0 ? -err : err, std::generic_category());
+}
+
+/*
+ * Move only owner of a protected buffer. The buffer is freed, or given
+ * back to the pool it was taken from, when the owner goes away.
+ */
+class ProtectedBuffer {
+public:
+	ProtectedBuffer() noexcept = default;
+
+	/* Take ownership of 'handle', given back to 'pool' if not NULL */
+	explicit ProtectedBuffer(sedget_protected_buffer *handle,
+				 sedget_buf_pool *pool = nullptr) noexcept
+		: handle_(handle), pool_(handle ? pool : nullptr)
+	{
+	}
+
+	ProtectedBuffer(ProtectedBuffer &&other) noexcept
+		: handle_(std::exchange(other.handle_, nullptr)),
+		  pool_(std::exchange(other.pool_, nullptr))
+	{
+	}
+
+	ProtectedBuffer &operator=(ProtectedBuffer &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			handle_ = std::exchange(other.handle_, nullptr);
+			pool_ = std::exchange(other.pool_, nullptr);
+		}
+		return *this;
+	}
+
+	ProtectedBuffer(const ProtectedBuffer &) = delete;
+	ProtectedBuffer &operator=(const ProtectedBuffer &) = delete;
+
+	~ProtectedBuffer()
+	{
+		reset();
+	}
+
+	static ProtectedBuffer allocate(size_t size, sedget_buf_type type,
+					std::error_code &ec) noexcept
+	{
+		sedget_protected_buffer *handle = sedget_alloc_prot_buf(size, type);
+
+		ec = handle ? std::error_code() : errno_code(errno);
+		return ProtectedBuffer(handle);
+	}
+
+	void reset() noexcept
+	{
+		if (handle_ == nullptr)
+			return;
+
+		if (pool_)
+			sedget_pool_put(pool_, handle_);
+		else
+			sedget_free_prot_buf(handle_);
+		handle_ = nullptr;
+		pool_ = nullptr;
+	}
+
+	/*
+	 * Give up ownership. A handle taken from a pool must then be given
+	 * back with sedget_pool_put().
+	 */
+	sedget_protected_buffer *release() noexcept
+	{
+		pool_ = nullptr;
+		return std::exchange(handle_, nullptr);
+	}
+
+	/* Zero a range, 0 'len' for up to the buffer end */
+	std::error_code scrub(size_t offset = 0, size_t len = 0) noexcept
+	{
+		if (handle_ == nullptr)
+			return errno_code(EINVAL);
+		return errno_code(sedget_scrub_prot_buf(handle_, offset, len));
+	}
+
+	sedget_protected_buffer *get() const noexcept
+	{
+		return handle_;
+	}
+
+	int fd() const noexcept
+	{
+		return handle_ ? sedget_get_mem_fd(handle_) : -EINVAL;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return handle_ != nullptr;
+	}
+
+private:
+	sedget_protected_buffer *handle_ = nullptr;
+	sedget_buf_pool *pool_ = nullptr;
+};
+
+/*
+ * Firmware loaded in protected memory by sedget_load_prot_firmware(). The
+ * pagetable items are written to the caller's descriptor, see
+ * sedget_video.h for its size.
+ */
+class FirmwareImage {
+public:
+	FirmwareImage() noexcept = default;
+
+	static FirmwareImage load(const char *role, int num_cores, void *out,
+				  size_t out_size, std::error_code &ec) noexcept
+	{
+		FirmwareImage fw;
+
+		fw.buf_ = ProtectedBuffer(sedget_load_prot_firmware(role, num_cores,
+								    out, out_size));
+		ec = fw.buf_ ? std::error_code() : errno_code(errno);
+		if (fw.buf_)
+			fw.num_cores_ = num_cores;
+		return fw;
+	}
+
+	/* See sedget_reload_prot_firmware() */
+	std::error_code reload(const char *role, int num_cores, void *out,
+			       size_t out_size) noexcept
+	{
+		int ret;
+
+		if (!buf_)
+			return errno_code(EINVAL);
+
+		ret = sedget_reload_prot_firmware(buf_.get(), role, num_cores,
+						  out, out_size);
+		if (ret == 0)
+			num_cores_ = num_cores;
+		return errno_code(ret);
+	}
+
+	/* See sedget_rescale_prot_firmware() */
+	std::error_code rescale(int num_cores, void *out, size_t out_size) noexcept
+	{
+		int ret;
+
+		if (!buf_)
+			return errno_code(EINVAL);
+
+		ret = sedget_rescale_prot_firmware(buf_.get(), num_cores, out,
+						   out_size);
+		if (ret == 0)
+			num_cores_ = num_cores;
+		return errno_code(ret);
+	}
+
+	const ProtectedBuffer &buffer() const noexcept
+	{
+		return buf_;
+	}
+
+	int fd() const noexcept
+	{
+		return buf_.fd();
+	}
+
+	int num_cores() const noexcept
+	{
+		return num_cores_;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return static_cast<bool>(buf_);
+	}
+
+private:
+	ProtectedBuffer buf_;
+	int num_cores_ = 0;
+};
+
+/*
+ * memory_resource for the host side bookkeeping of protected buffers:
+ * containers of handles are carved from one upstream block and recycled
+ * per size class, so steady state use allocates nothing. Protected
+ * memory is not CPU accessible and never comes from here; it is drawn
+ * from a BufferPool. Not thread safe, like unsynchronized_pool_resource.
+ */
+class HandleResource : public std::pmr::memory_resource {
+public:
+	explicit HandleResource(size_t max_handles,
+				std::pmr::memory_resource *upstream =
+					std::pmr::get_default_resource())
+		: arena_(arena_size(max_handles), upstream),
+		  pools_(pool_options(max_handles), &arena_)
+	{
+	}
+
+	HandleResource(const HandleResource &) = delete;
+	HandleResource &operator=(const HandleResource &) = delete;
+
+private:
+	/* a container of every handle and a few smaller ones */
+	static size_t arena_size(size_t max_handles) noexcept
+	{
+		return 4 * (max_handles + 1) * sizeof(ProtectedBuffer);
+	}
+
+	static std::pmr::pool_options pool_options(size_t max_handles) noexcept
+	{
+		std::pmr::pool_options opts;
+
+		opts.max_blocks_per_chunk = 4;
+		opts.largest_required_pool_block =
+			(max_handles + 1) * sizeof(ProtectedBuffer);
+		return opts;
+	}
+
+	void *do_allocate(size_t bytes, size_t align) override
+	{
+		return pools_.allocate(bytes, align);
+	}
+
+	void do_deallocate(void *p, size_t bytes, size_t align) override
+	{
+		pools_.deallocate(p, bytes, align);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	std::pmr::monotonic_buffer_resource arena_;
+	std::pmr::unsynchronized_pool_resource pools_;
+};
+
+/*
+ * Pool of protected buffers of one type and size, see
+ * sedget_create_buf_pool(). Buffers taken from it go back to it when their
+ * ProtectedBuffer goes away, so they must not outlive the pool.
+ */
+class BufferPool {
+public:
+	BufferPool(size_t size, sedget_buf_type type, size_t max_bufs,
+		   unsigned int flags, std::error_code &ec) noexcept
+		: pool_(sedget_create_buf_pool(size, type, max_bufs, flags)),
+		  resource_(max_bufs)
+	{
+		ec = pool_ ? std::error_code() : errno_code(errno);
+	}
+
+	/* Pool of frame buffers, see sedget_create_frame_pool() */
+	BufferPool(sedget_frame_format format, unsigned int width,
+		   unsigned int height, size_t max_bufs, unsigned int flags,
+		   std::error_code &ec) noexcept
+		: pool_(sedget_create_frame_pool(format, width, height,
+						 max_bufs, flags)),
+		  resource_(max_bufs)
+	{
+		ec = pool_ ? std::error_code() : errno_code(errno);
+	}
+
+	/* Pool of input buffers, see sedget_alloc_input_for_stream() */
+	BufferPool(sedget_codec codec, unsigned int profile, unsigned int level,
+		   unsigned int width, unsigned int height, size_t count,
+		   std::error_code &ec) noexcept
+		: pool_(sedget_alloc_input_for_stream(codec, profile, level,
+						      width, height, count)),
+		  resource_(count)
+	{
+		ec = pool_ ? std::error_code() : errno_code(errno);
+	}
+
+	BufferPool(const BufferPool &) = delete;
+	BufferPool &operator=(const BufferPool &) = delete;
+
+	~BufferPool()
+	{
+		if (pool_)
+			sedget_destroy_buf_pool(pool_);
+	}
+
+	ProtectedBuffer acquire(std::error_code &ec) noexcept
+	{
+		sedget_protected_buffer *handle =
+			pool_ ? sedget_pool_get(pool_) : nullptr;
+
+		ec = handle ? std::error_code() :
+			errno_code(pool_ ? errno : EINVAL);
+		return ProtectedBuffer(handle, pool_);
+	}
+
+	/*
+	 * Take 'count' buffers at once, held in a container allocated from
+	 * resource(). On failure none is taken.
+	 */
+	std::pmr::vector<ProtectedBuffer> acquire(size_t count,
+						  std::error_code &ec)
+	{
+		std::pmr::vector<ProtectedBuffer> bufs(&resource_);
+
+		bufs.reserve(count);
+		while (bufs.size() < count) {
+			ProtectedBuffer buf = acquire(ec);
+
+			if (ec) {
+				bufs.clear();
+				break;
+			}
+			bufs.push_back(std::move(buf));
+		}
+		return bufs;
+	}
+
+	std::error_code prefill(size_t count) noexcept
+	{
+		return errno_code(sedget_pool_prefill(pool_, count));
+	}
+
+	/*
+	 * Prepare a frame pool for a new sequence, see
+	 * sedget_frame_pool_configure(). 'resized' tells whether buffers
+	 * were kept.
+	 */
+	std::error_code configure(sedget_frame_format format, unsigned int width,
+				  unsigned int height, bool *resized = nullptr) noexcept
+	{
+		int ret = sedget_frame_pool_configure(pool_, format, width, height);
+
+		if (resized)
+			*resized = ret > 0;
+		return errno_code(ret < 0 ? ret : 0);
+	}
+
+	/*
+	 * Report the size of an access unit before acquiring a buffer for
+	 * it, see sedget_input_pool_observe().
+	 */
+	std::error_code observe(size_t len, bool *resized = nullptr) noexcept
+	{
+		int ret = sedget_input_pool_observe(pool_, len);
+
+		if (resized)
+			*resized = ret > 0;
+		return errno_code(ret < 0 ? ret : 0);
+	}
+
+	/* Resource for containers of buffers of this pool */
+	std::pmr::memory_resource *resource() noexcept
+	{
+		return &resource_;
+	}
+
+	size_t buffer_size() const noexcept
+	{
+		return sedget_pool_buf_size(pool_);
+	}
+
+	sedget_buf_pool *get() const noexcept
+	{
+		return pool_;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return pool_ != nullptr;
+	}
+
+private:
+	sedget_buf_pool *pool_;
+	HandleResource resource_;
+};
+
+} /* namespace sedget */
+
+#endif
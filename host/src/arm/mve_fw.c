@@ -21,6 +21,9 @@
 #define SIZE_4M         0x400000
 #define SIZE_1M         0x100000
 
+/* Allocations tried before giving up on the size the TA asks for */
+#define LOAD_ATTEMPTS   3
+
 #define COUNT_ELEM(ar)	(sizeof(ar) / sizeof(ar[0]))
 
 /* role v.s. secure firmware name */
@@ -59,12 +62,10 @@ static size_t get_firmware_file_size(const char *filename)
 	return (size_t)fw_stat.st_size;
 }
 
-static size_t load_firmware(const char *filename, int shm_fd, size_t shm_len,
-			    void *fw_secure_desc, int fw_desc_size,
-			    uint32_t ncores)
+/* Read an encrypted firmware file; the result is to be freed by the caller */
+static unsigned char *read_firmware(const char *filename, size_t *size)
 {
 	FILE *fw_fp = NULL;
-	size_t res = 0;
 	unsigned char *fw_buf = NULL;
 	size_t fw_size = 0;
 
@@ -88,39 +89,32 @@ static size_t load_firmware(const char *filename, int shm_fd, size_t shm_len,
 
 	if (fread(fw_buf, 1, fw_size, fw_fp) != fw_size) {
 		ALOGE("Firmware read error");
+		free(fw_buf);
+		fw_buf = NULL;
 		goto exit;
 	}
 
-	if (tee_service_load_firmware(fw_buf, fw_size, shm_fd, shm_len,
-				      fw_secure_desc, fw_desc_size, ncores))
-		goto exit;
-
-	res = fw_size;
+	*size = fw_size;
 
 exit:
-	if (fw_buf)
-		free(fw_buf);
-
 	if (fw_fp)
 		fclose(fw_fp);
 
-	return res;
+	return fw_buf;
 }
 
+static size_t get_prot_buf_size(int mem_fd)
+{
+	off_t size = lseek(mem_fd, 0, SEEK_END);
 
-sedget_protected_buffer *sedget_load_prot_firmware(const char *role,
-						   int num_cores,
-						   void *out,
-						   size_t out_size)
+	return size < 0 ? 0 : (size_t)size;
+}
+
+/* Read the encrypted firmware of 'role'; to be freed by the caller */
+static unsigned char *read_role_firmware(const char *role, size_t *size)
 {
-	int mem_fd = -1;
-	sedget_protected_buffer *prot_buf = NULL;
-	struct firmware_list_item *p_fw_item;
 	uint32_t i, elem_count;
 
-	if (role == NULL || out == NULL || out_size == 0)
-		return NULL;
-
 	elem_count = COUNT_ELEM(firmware_list);
 
 	/* find matching firmware for role */
@@ -133,33 +127,172 @@ sedget_protected_buffer *sedget_load_prot_firmware(const char *role,
 		return NULL;
 	}
 
-	p_fw_item = &firmware_list[i];
+	return read_firmware(firmware_list[i].filename, size);
+}
+
 
-	/* prepare ion buffer -- firmware BSS needs more buffers;
-	 * 4M is maxium size for L2 pte of firmware MMU */
-	prot_buf = sedget_alloc_prot_buf(SIZE_4M, SEDGET_BUF_FIRMWARE);
-	if (prot_buf == NULL) {
-		ALOGE("Failed to allocate ion buffer");
+sedget_protected_buffer *sedget_load_prot_firmware(const char *role,
+						   int num_cores,
+						   void *out,
+						   size_t out_size)
+{
+	int mem_fd = -1;
+	int ret = -EINVAL;
+	sedget_protected_buffer *prot_buf = NULL;
+	unsigned char *fw_buf;
+	size_t fw_size = 0;
+	size_t mem_len = SIZE_4M;
+	size_t desc_size = out_size;
+	uint32_t i;
+
+	if (role == NULL || out == NULL || out_size == 0)
 		return NULL;
-	}
 
-	mem_fd = sedget_get_mem_fd(prot_buf);
-	if (mem_fd < 0)
-		goto error_out;
+	fw_buf = read_role_firmware(role, &fw_size);
+	if (fw_buf == NULL)
+		return NULL;
 
-	memset(out, 0x0, out_size);
+	/* prepare ion buffer -- firmware BSS needs more buffers; 4M fits
+	 * most firmware, the TA tells the size it needs otherwise */
+	for (i = 0; i < LOAD_ATTEMPTS && mem_len <= SEDGET_FW_BUF_MAX_SIZE;
+	     i++) {
+		prot_buf = sedget_alloc_prot_buf(mem_len, SEDGET_BUF_FIRMWARE);
+		if (prot_buf == NULL) {
+			ALOGE("Failed to allocate ion buffer");
+			break;
+		}
+
+		mem_fd = sedget_get_mem_fd(prot_buf);
+		if (mem_fd < 0)
+			goto error_out;
 
-	if (load_firmware(p_fw_item->filename, mem_fd, SIZE_4M,
-				out, out_size, num_cores) == 0) {
+		memset(out, 0x0, out_size);
+
+		ret = tee_service_load_firmware(fw_buf, fw_size, mem_fd,
+						&mem_len, out, &desc_size,
+						num_cores);
+		if (ret != -ENOSPC)
+			break;
+
+		ALOGD("Secure Firmware needs %zu bytes buffer", mem_len);
+		sedget_free_prot_buf(prot_buf);
+		prot_buf = NULL;
+	}
+
+	if (ret == -EOVERFLOW) {
+		ALOGE("Firmware descriptor needs %zu bytes, got %zu", desc_size,
+		      out_size);
+		goto error_out;
+	}
+	if (ret != 0) {
 		ALOGE("Failed to load firmware");
 		goto error_out;
 	}
 
+	free(fw_buf);
+
 	ALOGD("Secure Firmware loaded with size: %zu", out_size);
 
 	return prot_buf;
 
 error_out:
-	sedget_free_prot_buf(prot_buf);
+	free(fw_buf);
+	if (prot_buf)
+		sedget_free_prot_buf(prot_buf);
+	if (ret == -EOVERFLOW)
+		errno = EOVERFLOW;
 	return NULL;
 }
+
+int sedget_reload_prot_firmware(sedget_protected_buffer *prot_buf,
+				const char *role,
+				int num_cores,
+				void *out,
+				size_t out_size)
+{
+	unsigned char *fw_buf;
+	size_t fw_size = 0;
+	size_t mem_len;
+	size_t desc_size = out_size;
+	int mem_fd, ret;
+
+	if (prot_buf == NULL || role == NULL || out == NULL ||
+	    out_size == 0 || num_cores <= 0)
+		return -EINVAL;
+
+	mem_fd = sedget_get_mem_fd(prot_buf);
+	if (mem_fd < 0)
+		return mem_fd;
+
+	mem_len = get_prot_buf_size(mem_fd);
+	if (mem_len == 0)
+		return -EINVAL;
+
+	fw_buf = read_role_firmware(role, &fw_size);
+	if (fw_buf == NULL)
+		return -ENOENT;
+
+	memset(out, 0x0, out_size);
+
+	ret = tee_service_reload_firmware(fw_buf, fw_size, mem_fd, &mem_len,
+					  out, &desc_size, num_cores);
+	free(fw_buf);
+	if (ret == -ENOSPC) {
+		ALOGD("Secure Firmware for %s needs %zu bytes buffer", role,
+		      mem_len);
+		return ret;
+	}
+	if (ret == -EOVERFLOW) {
+		ALOGE("Firmware descriptor needs %zu bytes, got %zu", desc_size,
+		      out_size);
+		return ret;
+	}
+	if (ret) {
+		ALOGE("Failed to reload firmware for %s", role);
+		return ret;
+	}
+
+	ALOGD("Secure Firmware reloaded for %s", role);
+
+	return 0;
+}
+
+int sedget_rescale_prot_firmware(sedget_protected_buffer *prot_buf,
+				 int num_cores,
+				 void *out,
+				 size_t out_size)
+{
+	int mem_fd, ret;
+	size_t mem_len;
+	size_t desc_size = out_size;
+
+	if (prot_buf == NULL || out == NULL || out_size == 0 ||
+	    num_cores <= 0)
+		return -EINVAL;
+
+	mem_fd = sedget_get_mem_fd(prot_buf);
+	if (mem_fd < 0)
+		return mem_fd;
+
+	mem_len = get_prot_buf_size(mem_fd);
+	if (mem_len == 0)
+		return -EINVAL;
+
+	memset(out, 0x0, out_size);
+
+	ret = tee_service_rescale_firmware(mem_fd, mem_len, out, &desc_size,
+					   num_cores);
+	if (ret == -EOVERFLOW) {
+		ALOGE("Firmware descriptor needs %zu bytes, got %zu", desc_size,
+		      out_size);
+		return ret;
+	}
+	if (ret) {
+		ALOGE("Failed to rescale firmware to %d cores", num_cores);
+		return ret;
+	}
+
+	ALOGD("Secure Firmware rescaled to %d cores", num_cores);
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __BROKER_PROTO_H_
+#define __BROKER_PROTO_H_
+
+#include <stdint.h>
+
+/*
+ * Protocol between libsedget_video and sedget_brokerd. Messages are fixed
+ * size SOCK_SEQPACKET records; the fd of an allocated buffer travels as
+ * SCM_RIGHTS ancillary data of the BROKER_OP_ALLOC reply.
+ */
+
+#define BROKER_SOCKET_PATH	"/dev/socket/sedget_broker"
+
+/* Overrides BROKER_SOCKET_PATH, an empty value disables the broker */
+#define BROKER_SOCKET_ENV	"SEDGET_BROKER_SOCKET"
+
+#define BROKER_MAGIC		0x4b524253	/* "SBRK" */
+
+enum broker_op {
+	BROKER_OP_ALLOC = 1,	/* size, type -> id, size, fd */
+	BROKER_OP_RELEASE,	/* id -> result */
+};
+
+struct broker_req {
+	uint32_t magic;
+	uint32_t op;
+	uint64_t size;
+	uint32_t type;		/* sedget_buf_type */
+	uint32_t id;
+};
+
+struct broker_rsp {
+	uint32_t magic;
+	int32_t result;		/* 0 or a negative errno */
+	uint64_t size;
+	uint32_t id;
+	uint32_t reserved;
+};
+
+/*
+ * Client side, in libsedget_video, for sedget_alloc_brokered_buf().
+ * broker_alloc() returns the fd of a new buffer and its id, to be given
+ * back to broker_release(), or -ENOTCONN when no broker is running.
+ */
+int broker_alloc(size_t size, int type, uint32_t *id);
+
+int broker_release(uint32_t id);
+
+#endif
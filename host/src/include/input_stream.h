@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __INPUT_STREAM_H_
+#define __INPUT_STREAM_H_
+
+#include "sedget_video.h"
+
+/* Kind of stream an input pool was created for, see input_buf.c */
+struct input_stream {
+	sedget_codec codec;
+	unsigned int profile;
+	unsigned int level;
+	unsigned int width;
+	unsigned int height;
+};
+
+/* Set once, before the pool is handed out */
+void prot_pool_set_stream(sedget_buf_pool *pool,
+			  const struct input_stream *stream);
+
+/* NULL if the pool was not created for a stream */
+const struct input_stream *prot_pool_stream(const sedget_buf_pool *pool);
+
+#endif
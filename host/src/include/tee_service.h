@@ -5,9 +5,79 @@
 #ifndef __TEE_SERVICE_H_
 #define __TEE_SERVICE_H_
 
+#include <sedget_video_ta.h>
+
+/*
+ * On -ENOSPC '*mem_len' is updated with the secure buffer size the TA
+ * needs, which may still be a lower bound. On -EOVERFLOW '*fw_desc_size'
+ * is updated with the descriptor size the TA needs.
+ */
 int tee_service_load_firmware(void *fw_data, size_t len,
-				int mem_fd, size_t mem_len,
-				void *fw_secure_desc, int fw_desc_size,
+				int mem_fd, size_t *mem_len,
+				void *fw_secure_desc, size_t *fw_desc_size,
+				uint32_t ncores);
+
+/*
+ * Same as tee_service_load_firmware, into a buffer that already holds a
+ * firmware, through the session kept for the process lifetime with which
+ * the buffer stays registered, see tee_service_release_buffer().
+ */
+int tee_service_reload_firmware(void *fw_data, size_t len,
+				int mem_fd, size_t *mem_len,
+				void *fw_secure_desc, size_t *fw_desc_size,
 				uint32_t ncores);
 
+/*
+ * Decrypt the segmented firmware package 'fw_data' into the secure buffer
+ * 'mem_fd' with worker TA sessions running in parallel; the load is then
+ * completed by SEDGET_VIDEO_TA_CMD_FINISH_FW. -ENOTSUP means the package
+ * is not segmented, its segments are too large for the workers,
+ * parallelism would not help or no worker is available. -EACCES means the
+ * buffer holds firmware, which only LOAD_FW writes to.
+ */
+int tee_workers_decrypt(const void *fw_data, size_t len, int mem_fd,
+			size_t mem_len);
+
+/* -EOVERFLOW is reported as by tee_service_load_firmware */
+int tee_service_rescale_firmware(int mem_fd, size_t mem_len,
+				 void *fw_secure_desc, size_t *fw_desc_size,
+				 uint32_t ncores);
+
+/*
+ * Wipe the firmware buffer 'mem_fd' before it is freed, so that the TA
+ * stops refusing its pages for input buffers. -ENOENT means it holds no
+ * firmware the TA loaded.
+ */
+int tee_service_release_firmware(int mem_fd, size_t mem_len);
+
+/*
+ * Forget the secure buffer 'mem_fd' before its fd is closed: the
+ * registration kept with the service session is dropped.
+ */
+void tee_service_release_buffer(int mem_fd);
+
+/*
+ * Copy 'count' entries from the staging buffer into the secure buffers
+ * 'dst_fds[i]', batching them into as few TA invocations as possible.
+ * Entry results are set by the TA, or left to TEEC_ERROR_GENERIC for
+ * entries of a batch that could not be submitted.
+ */
+int tee_service_inject(const void *staging, size_t staging_size,
+		       struct sedget_inject_entry *entries,
+		       const int *dst_fds, size_t count);
+
+/* A range of a secure buffer to zero; len 0 means up to the buffer end */
+struct tee_scrub_req {
+	int fd;
+	size_t offset;
+	size_t len;
+	int result;	/* set to 0 or a negative errno, -EACCES for firmware */
+};
+
+/*
+ * Zero 'count' ranges, batching them into as few TA invocations as
+ * possible. Requests of a batch that could not be submitted get -EIO.
+ */
+int tee_service_scrub(struct tee_scrub_req *reqs, size_t count);
+
 #endif
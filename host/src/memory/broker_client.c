@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#define LOG_TAG "SEDGET_VIDEO"
+#include <cutils/log.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "broker_proto.h"
+
+/*
+ * Connection to the broker, attempted once on first allocation and kept
+ * for the process lifetime. Calls are serialized on it; if it breaks, they
+ * fail with -ENOTCONN from then on.
+ */
+static struct {
+	pthread_mutex_t lock;
+	int sock;
+	bool tried;
+} broker = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.sock = -1,
+};
+
+static int broker_connect(void)
+{
+	const char *path = getenv(BROKER_SOCKET_ENV);
+	struct sockaddr_un addr;
+	int sock;
+
+	if (path == NULL)
+		path = BROKER_SOCKET_PATH;
+	if (*path == '\0' || strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(sock);
+		return -1;
+	}
+
+	ALOGD("Using protected buffer broker %s", path);
+
+	return sock;
+}
+
+/* Send 'req' and wait for the reply, and the fd it carries if 'fd' */
+static int broker_call(const struct broker_req *req, struct broker_rsp *rsp,
+		       int *fd)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} ctrl;
+	struct iovec iov = { rsp, sizeof(*rsp) };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	ssize_t len;
+	int rx_fd = -1;
+	int ret = 0;
+
+	pthread_mutex_lock(&broker.lock);
+	if (!broker.tried) {
+		broker.tried = true;
+		broker.sock = broker_connect();
+	}
+	if (broker.sock < 0) {
+		pthread_mutex_unlock(&broker.lock);
+		return -ENOTCONN;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
+
+	if (send(broker.sock, req, sizeof(*req), MSG_NOSIGNAL) != sizeof(*req))
+		len = -1;
+	else
+		len = recvmsg(broker.sock, &msg, MSG_CMSG_CLOEXEC);
+
+	for (cmsg = len > 0 ? CMSG_FIRSTHDR(&msg) : NULL; cmsg;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_RIGHTS &&
+		    cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+			memcpy(&rx_fd, CMSG_DATA(cmsg), sizeof(int));
+
+	if (len != sizeof(*rsp) || rsp->magic != BROKER_MAGIC ||
+	    (msg.msg_flags & MSG_CTRUNC)) {
+		ALOGE("Lost protected buffer broker");
+		close(broker.sock);
+		broker.sock = -1;
+		ret = -ENOTCONN;
+	}
+	pthread_mutex_unlock(&broker.lock);
+
+	if (ret == 0)
+		ret = rsp->result;
+	if (ret == 0 && fd != NULL && rx_fd < 0)
+		ret = -EIO;
+
+	if (ret == 0 && fd != NULL)
+		*fd = rx_fd;
+	else if (rx_fd >= 0)
+		close(rx_fd);
+
+	return ret;
+}
+
+int broker_alloc(size_t size, int type, uint32_t *id)
+{
+	struct broker_req req;
+	struct broker_rsp rsp;
+	int fd = -1;
+	int ret;
+
+	memset(&req, 0, sizeof(req));
+	req.magic = BROKER_MAGIC;
+	req.op = BROKER_OP_ALLOC;
+	req.size = size;
+	req.type = type;
+
+	ret = broker_call(&req, &rsp, &fd);
+	if (ret != 0)
+		return ret;
+
+	*id = rsp.id;
+
+	return fd;
+}
+
+int broker_release(uint32_t id)
+{
+	struct broker_req req;
+	struct broker_rsp rsp;
+
+	memset(&req, 0, sizeof(req));
+	req.magic = BROKER_MAGIC;
+	req.op = BROKER_OP_RELEASE;
+	req.id = id;
+
+	return broker_call(&req, &rsp, NULL);
+}
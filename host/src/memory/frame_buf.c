@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#define LOG_TAG "SEDGET_VIDEO"
+#include <cutils/log.h>
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "sedget_video.h"
+
+#define FRAME_MAX_DIM		8192
+#define FRAME_LINE_ALIGN	64	/* bytes per line */
+#define FRAME_BLOCK_SIZE	16	/* pixels, macroblocks and superblocks */
+#define AFBC_HEADER_SIZE	16	/* bytes per superblock */
+#define AFBC_HEADER_ALIGN	1024	/* the body follows the headers */
+
+#define ALIGN(x, a)		(((x) + (a) - 1) / (a) * (a))
+
+size_t sedget_frame_buf_size(sedget_frame_format format, unsigned int width,
+			     unsigned int height)
+{
+	size_t lines, blocks;
+
+	if (width == 0 || height == 0 ||
+	    width > FRAME_MAX_DIM || height > FRAME_MAX_DIM)
+		return 0;
+
+	lines = ALIGN(height, FRAME_BLOCK_SIZE);
+	blocks = ALIGN(width, FRAME_BLOCK_SIZE) / FRAME_BLOCK_SIZE *
+		 (lines / FRAME_BLOCK_SIZE);
+
+	/* 4:2:0, chroma adds half of the luma */
+	switch (format) {
+	case SEDGET_FRAME_NV12:
+		return ALIGN((size_t)width, FRAME_LINE_ALIGN) * lines * 3 / 2;
+	case SEDGET_FRAME_P010:
+		return ALIGN((size_t)width * 2, FRAME_LINE_ALIGN) * lines * 3 / 2;
+	case SEDGET_FRAME_AFBC_8:
+		/* an uncompressed superblock takes 16 * 16 * 3 / 2 bytes */
+		return ALIGN(blocks * AFBC_HEADER_SIZE, AFBC_HEADER_ALIGN) +
+		       blocks * 384;
+	case SEDGET_FRAME_AFBC_10:
+		return ALIGN(blocks * AFBC_HEADER_SIZE, AFBC_HEADER_ALIGN) +
+		       blocks * 480;
+	default:
+		return 0;
+	}
+}
+
+sedget_buf_pool *sedget_create_frame_pool(sedget_frame_format format,
+					  unsigned int width,
+					  unsigned int height,
+					  size_t max_bufs, unsigned int flags)
+{
+	size_t mem_size = sedget_frame_buf_size(format, width, height);
+
+	if (mem_size == 0) {
+		ALOGE("%s: invalid frame %ux%u format %d", __FUNCTION__,
+		      width, height, format);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return sedget_create_buf_pool(mem_size, SEDGET_BUF_FRAME, max_bufs,
+				      flags);
+}
+
+int sedget_frame_pool_configure(sedget_buf_pool *pool,
+				sedget_frame_format format,
+				unsigned int width, unsigned int height)
+{
+	size_t mem_size = sedget_frame_buf_size(format, width, height);
+	size_t cur_size = sedget_pool_buf_size(pool);
+	int ret;
+
+	if (pool == NULL || mem_size == 0)
+		return -EINVAL;
+
+	if (mem_size <= cur_size && mem_size > cur_size / 2)
+		return 0;
+
+	ret = sedget_pool_resize(pool, mem_size);
+	return ret < 0 ? ret : 1;
+}
@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#define LOG_TAG "SEDGET_VIDEO"
+#include <cutils/log.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "sedget_video.h"
+#include "input_stream.h"
+
+#define INPUT_MAX_DIM		8192
+#define INPUT_MIN_SIZE		(64 * 1024)	/* smallest size class */
+#define INPUT_LEARN_UNITS	32	/* before learnt sizes are used */
+#define INPUT_WINDOW_UNITS	256	/* sizes older than two windows expire */
+#define INPUT_KINDS_MAX		16	/* kinds of stream learnt at a time */
+#define INPUT_MIN_FPS		10	/* lowest frame rate sized for */
+
+#define ALIGN(x, a)		(((x) + (a) - 1) / (a) * (a))
+#define MBS(n)			((n) * 256u)	/* macroblocks to luma samples */
+
+/* Limits of one level, see Annex A of H.264 and H.265 */
+struct codec_level {
+	unsigned int idc;
+	uint32_t max_rate;	/* luma samples per second */
+	uint32_t max_pic;	/* luma samples */
+	uint32_t max_cpb;	/* 1000 bits before the profile factor */
+	unsigned int min_cr;
+};
+
+static const struct codec_level avc_levels[] = {
+	{  9, MBS(1485),     MBS(99),     350,    2 },	/* 1b */
+	{ 10, MBS(1485),     MBS(99),     175,    2 },
+	{ 11, MBS(3000),     MBS(396),    500,    2 },
+	{ 12, MBS(6000),     MBS(396),    1000,   2 },
+	{ 13, MBS(11880),    MBS(396),    2000,   2 },
+	{ 20, MBS(11880),    MBS(396),    2000,   2 },
+	{ 21, MBS(19800),    MBS(792),    4000,   2 },
+	{ 22, MBS(20250),    MBS(1620),   4000,   2 },
+	{ 30, MBS(40500),    MBS(1620),   10000,  2 },
+	{ 31, MBS(108000),   MBS(3600),   14000,  4 },
+	{ 32, MBS(216000),   MBS(5120),   20000,  4 },
+	{ 40, MBS(245760),   MBS(8192),   25000,  4 },
+	{ 41, MBS(245760),   MBS(8192),   62500,  2 },
+	{ 42, MBS(522240),   MBS(8704),   62500,  2 },
+	{ 50, MBS(589824),   MBS(22080),  135000, 2 },
+	{ 51, MBS(983040),   MBS(36864),  240000, 2 },
+	{ 52, MBS(2073600),  MBS(36864),  240000, 2 },
+	{ 60, MBS(4177920),  MBS(139264), 240000, 2 },
+	{ 61, MBS(8355840),  MBS(139264), 480000, 2 },
+	{ 62, MBS(16711680), MBS(139264), 800000, 2 },
+};
+
+/* Main tier */
+static const struct codec_level hevc_levels[] = {
+	{  30, 552960,     36864,    350,    2 },
+	{  60, 3686400,    122880,   1500,   2 },
+	{  63, 7372800,    245760,   3000,   2 },
+	{  90, 16588800,   552960,   6000,   2 },
+	{  93, 33177600,   983040,   10000,  2 },
+	{ 120, 66846720,   2228224,  12000,  4 },
+	{ 123, 133693440,  2228224,  20000,  4 },
+	{ 150, 267386880,  8912896,  25000,  6 },
+	{ 153, 534773760,  8912896,  40000,  8 },
+	{ 156, 1069547520, 8912896,  60000,  8 },
+	{ 180, 1069547520, 35651584, 60000,  8 },
+	{ 183, 2139095040, 35651584, 120000, 8 },
+	{ 186, 4278190080, 35651584, 240000, 6 },
+};
+
+/* High tier, defined from level 4 on */
+static const struct codec_level hevc_high_levels[] = {
+	{ 120, 66846720,   2228224,  30000,  4 },
+	{ 123, 133693440,  2228224,  50000,  4 },
+	{ 150, 267386880,  8912896,  100000, 4 },
+	{ 153, 534773760,  8912896,  160000, 4 },
+	{ 156, 1069547520, 8912896,  240000, 4 },
+	{ 180, 1069547520, 35651584, 240000, 4 },
+	{ 183, 2139095040, 35651584, 480000, 4 },
+	{ 186, 4278190080, 35651584, 800000, 4 },
+};
+
+/* Sizes seen for one kind of stream */
+struct stream_kind {
+	struct input_stream stream;
+	unsigned int units;		/* reported so far, saturating */
+	unsigned int window_units;
+	size_t window_max;		/* largest unit of the current window */
+	size_t prev_max;		/* and of the previous one */
+	unsigned long last_use;		/* 0 for an unused entry */
+};
+
+static struct {
+	pthread_mutex_t lock;
+	unsigned long clock;
+	struct stream_kind kinds[INPUT_KINDS_MAX];
+} learnt = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Round 'size' up to the next size class: INPUT_MIN_SIZE, then four
+ * classes per power of two.
+ */
+static size_t input_size_class(size_t size)
+{
+	size_t step = INPUT_MIN_SIZE / 4;
+
+	if (size <= INPUT_MIN_SIZE)
+		return INPUT_MIN_SIZE;
+
+	while (step * 8 < size)
+		step *= 2;
+
+	return ALIGN(size, step);
+}
+
+/* First level of at least 'idc' with room for 'pic' luma samples */
+static const struct codec_level *find_level(const struct codec_level *levels,
+					    size_t num_levels, unsigned int idc,
+					    uint64_t pic)
+{
+	size_t i;
+
+	for (i = 0; i < num_levels; i++)
+		if (levels[i].idc >= idc && levels[i].max_pic >= pic)
+			return &levels[i];
+
+	return NULL;
+}
+
+/*
+ * Largest access unit a conforming stream may have, from its raw picture
+ * size in 1/8 bytes per luma sample ('raw_x8') and, when the level is
+ * known, its compression ratio and CPB size. The compression ratio bounds
+ * the first access unit by the picture size and later ones by the luma
+ * samples the level allows since the previous one, taken at
+ * INPUT_MIN_FPS; no access unit can be larger than the CPB.
+ */
+static uint64_t level_au_limit(const struct codec_level *level,
+			       unsigned int cpb_factor, unsigned int raw_x8,
+			       uint64_t pic)
+{
+	uint64_t limit, cpb;
+
+	/* unknown level: the lowest compression ratio of any level */
+	if (level == NULL)
+		return raw_x8 * pic / 8 / 2;
+
+	if (pic < level->max_rate / INPUT_MIN_FPS)
+		pic = level->max_rate / INPUT_MIN_FPS;
+	limit = raw_x8 * pic / 8 / level->min_cr;
+
+	cpb = (uint64_t)level->max_cpb * cpb_factor / 8;
+	return limit < cpb ? limit : cpb;
+}
+
+/* cpbBrNalFactor of Table A-2 */
+static unsigned int avc_cpb_factor(unsigned int profile)
+{
+	switch (profile) {
+	case 66:	/* Baseline */
+	case 77:	/* Main */
+	case 88:	/* Extended */
+		return 1200;
+	case 100:	/* High */
+		return 1500;
+	case 110:	/* High 10 */
+		return 3600;
+	default:
+		return 4800;
+	}
+}
+
+/*
+ * FormatCapabilityFactor of Table A-8, in 1/8. Range extension and later
+ * profiles scale the CPB and compression ratio by factors of their own:
+ * 0, they are not supported.
+ */
+static unsigned int hevc_raw_x8(unsigned int profile)
+{
+	switch (profile) {
+	case 1:		/* Main */
+	case 3:		/* Main Still Picture */
+		return 12;
+	case 0:
+	case 2:		/* Main 10 */
+		return 15;
+	default:
+		return 0;
+	}
+}
+
+static size_t input_au_limit(const struct input_stream *s)
+{
+	uint64_t pic = (uint64_t)s->width * s->height;
+	const struct codec_level *level;
+	unsigned int raw_x8 = 12;	/* 8-bit 4:2:0 */
+	unsigned int idc;
+	uint64_t limit;
+
+	switch (s->codec) {
+	case SEDGET_CODEC_AVC:
+		/* whole macroblocks */
+		pic = (uint64_t)ALIGN(s->width, 16) * ALIGN(s->height, 16);
+		level = s->level ? find_level(avc_levels,
+					      sizeof(avc_levels) / sizeof(avc_levels[0]),
+					      s->level, pic) : NULL;
+		limit = level_au_limit(level, avc_cpb_factor(s->profile), 12,
+				       pic);
+		break;
+	case SEDGET_CODEC_HEVC:
+		raw_x8 = hevc_raw_x8(s->profile);
+		if (raw_x8 == 0)
+			return 0;
+		idc = s->level & ~SEDGET_LEVEL_HIGH_TIER;
+		if (idc == 0)
+			level = NULL;
+		else if (s->level & SEDGET_LEVEL_HIGH_TIER)
+			level = find_level(hevc_high_levels,
+					   sizeof(hevc_high_levels) / sizeof(hevc_high_levels[0]),
+					   idc, pic);
+		else
+			level = find_level(hevc_levels,
+					   sizeof(hevc_levels) / sizeof(hevc_levels[0]),
+					   idc, pic);
+		limit = level_au_limit(level, 1100, raw_x8, pic);
+		break;
+	case SEDGET_CODEC_VP9:
+		/* profiles 1 and 3 are 4:4:4, 2 and 3 up to 12-bit */
+		if (s->profile & 1)
+			raw_x8 *= 2;
+		if (s->profile & 2)
+			raw_x8 = raw_x8 * 3 / 2;
+		/* VP9 levels require at least a compression ratio of 2 */
+		limit = raw_x8 * pic / 8 / 2;
+		break;
+	case SEDGET_CODEC_JPEG:
+		/* 4:4:4 with next to no compression */
+		limit = 24 * pic / 8;
+		break;
+	case SEDGET_CODEC_VP8:
+	case SEDGET_CODEC_MPEG2:
+	case SEDGET_CODEC_MPEG4:
+	case SEDGET_CODEC_VC1:
+	case SEDGET_CODEC_RV:
+		limit = raw_x8 * pic / 8;
+		break;
+	default:
+		return 0;
+	}
+
+	return limit;
+}
+
+static int same_stream(const struct input_stream *a,
+		       const struct input_stream *b)
+{
+	return a->codec == b->codec && a->profile == b->profile &&
+	       a->level == b->level && a->width == b->width &&
+	       a->height == b->height;
+}
+
+/*
+ * Entry of 'stream', made from the least recently used one if 'add'.
+ * Called with the learnt lock held.
+ */
+static struct stream_kind *find_kind(const struct input_stream *stream,
+				     int add)
+{
+	struct stream_kind *kind, *lru = &learnt.kinds[0];
+	size_t i;
+
+	for (i = 0; i < INPUT_KINDS_MAX; i++) {
+		kind = &learnt.kinds[i];
+		if (kind->last_use && same_stream(&kind->stream, stream)) {
+			kind->last_use = ++learnt.clock;
+			return kind;
+		}
+		if (kind->last_use < lru->last_use)
+			lru = kind;
+	}
+
+	if (!add)
+		return NULL;
+
+	kind = lru;
+	kind->stream = *stream;
+	kind->units = 0;
+	kind->window_units = 0;
+	kind->window_max = 0;
+	kind->prev_max = 0;
+	kind->last_use = ++learnt.clock;
+	return kind;
+}
+
+/* Size wanted from what was learnt, 0 if too little. Lock held. */
+static size_t learnt_size(const struct stream_kind *kind)
+{
+	size_t max;
+
+	if (kind == NULL || kind->units < INPUT_LEARN_UNITS)
+		return 0;
+
+	max = kind->window_max > kind->prev_max ?
+	      kind->window_max : kind->prev_max;
+	/* headroom for intra pictures larger than those seen so far */
+	return max * 2;
+}
+
+static size_t stream_buf_size(const struct input_stream *stream,
+			      size_t learnt_len)
+{
+	size_t limit = input_au_limit(stream);
+
+	if (learnt_len && learnt_len < limit)
+		limit = learnt_len;
+
+	return input_size_class(limit);
+}
+
+static int valid_stream(const struct input_stream *s)
+{
+	return s->width && s->height && s->width <= INPUT_MAX_DIM &&
+	       s->height <= INPUT_MAX_DIM && input_au_limit(s) != 0;
+}
+
+size_t sedget_input_buf_size(sedget_codec codec, unsigned int profile,
+			     unsigned int level, unsigned int width,
+			     unsigned int height)
+{
+	struct input_stream stream = { codec, profile, level, width, height };
+	size_t learnt_len;
+
+	if (!valid_stream(&stream))
+		return 0;
+
+	pthread_mutex_lock(&learnt.lock);
+	learnt_len = learnt_size(find_kind(&stream, 0));
+	pthread_mutex_unlock(&learnt.lock);
+
+	return stream_buf_size(&stream, learnt_len);
+}
+
+sedget_buf_pool *sedget_alloc_input_for_stream(sedget_codec codec,
+					       unsigned int profile,
+					       unsigned int level,
+					       unsigned int width,
+					       unsigned int height,
+					       size_t count)
+{
+	struct input_stream stream = { codec, profile, level, width, height };
+	size_t mem_size = sedget_input_buf_size(codec, profile, level,
+						width, height);
+	sedget_buf_pool *pool;
+	int ret;
+
+	if (mem_size == 0) {
+		ALOGE("%s: invalid stream %ux%u codec %d", __FUNCTION__,
+		      width, height, codec);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = sedget_create_buf_pool(mem_size, SEDGET_BUF_INPUT, count, 0);
+	if (pool == NULL)
+		return NULL;
+	prot_pool_set_stream(pool, &stream);
+
+	ret = sedget_pool_prefill(pool, count);
+	if (ret < 0) {
+		sedget_destroy_buf_pool(pool);
+		errno = -ret;
+		return NULL;
+	}
+
+	return pool;
+}
+
+int sedget_input_pool_observe(sedget_buf_pool *pool, size_t len)
+{
+	const struct input_stream *stream = prot_pool_stream(pool);
+	size_t cur_size = sedget_pool_buf_size(pool);
+	struct stream_kind *kind;
+	size_t mem_size;
+	int ret;
+
+	if (stream == NULL || len == 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&learnt.lock);
+	kind = find_kind(stream, 1);
+	if (kind->window_units == INPUT_WINDOW_UNITS) {
+		kind->prev_max = kind->window_max;
+		kind->window_max = 0;
+		kind->window_units = 0;
+	}
+	kind->window_units++;
+	if (kind->units < INPUT_LEARN_UNITS)
+		kind->units++;
+	if (len > kind->window_max)
+		kind->window_max = len;
+	mem_size = stream_buf_size(stream, learnt_size(kind));
+	pthread_mutex_unlock(&learnt.lock);
+
+	/* streams beyond their level still get buffers that fit */
+	if (len > mem_size)
+		mem_size = input_size_class(len);
+
+	if (len <= cur_size && mem_size > cur_size / 2)
+		return 0;
+
+	ret = sedget_pool_resize(pool, mem_size);
+	return ret < 0 ? ret : 1;
+}
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#define LOG_TAG "SEDGET_VIDEO"
+#include <cutils/log.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+
+#include <tee_client_api.h>
+
+#include "sedget_video.h"
+#include "tee_service.h"
+
+static bool unit_is_valid(const sedget_inject_unit *u, size_t staging_size)
+{
+	return u->dst != NULL && u->len <= UINT32_MAX &&
+		u->src_offset <= UINT32_MAX && u->dst_offset <= UINT32_MAX &&
+		u->src_offset <= staging_size &&
+		u->len <= staging_size - u->src_offset;
+}
+
+int sedget_inject_input(const void *staging, size_t staging_size,
+			sedget_inject_unit *units, size_t count)
+{
+	struct sedget_inject_entry *entries = NULL;
+	size_t *unit_idx = NULL;
+	int *fds = NULL;
+	size_t i, n = 0;
+	int copied = 0;
+	int ret;
+
+	if (staging == NULL || units == NULL || count == 0)
+		return -EINVAL;
+
+	entries = calloc(count, sizeof(*entries));
+	unit_idx = calloc(count, sizeof(*unit_idx));
+	fds = calloc(count, sizeof(*fds));
+	if (entries == NULL || unit_idx == NULL || fds == NULL) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	for (i = 0; i < count; i++) {
+		sedget_inject_unit *u = &units[i];
+
+		u->result = -EINVAL;
+		if (!unit_is_valid(u, staging_size))
+			continue;
+
+		fds[n] = sedget_get_mem_fd(u->dst);
+		if (fds[n] < 0)
+			continue;
+
+		entries[n].src_offset = u->src_offset;
+		entries[n].dst_offset = u->dst_offset;
+		entries[n].len = u->len;
+		unit_idx[n++] = i;
+	}
+
+	ret = n ? tee_service_inject(staging, staging_size, entries, fds, n) : 0;
+
+	for (i = 0; i < n; i++) {
+		switch (entries[i].result) {
+		case TEEC_SUCCESS:
+			units[unit_idx[i]].result = 0;
+			copied++;
+			break;
+		case TEEC_ERROR_BAD_PARAMETERS:
+			break;
+		default:
+			units[unit_idx[i]].result = -EIO;
+			break;
+		}
+	}
+
+exit:
+	free(entries);
+	free(unit_idx);
+	free(fds);
+
+	return ret ? ret : copied;
+}
@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#define LOG_TAG "SEDGET_VIDEO"
+#include <cutils/log.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sedget_video.h"
+#include "input_stream.h"
+
+/* A buffer allocated by the pool, handed out or idle */
+struct pool_buf {
+	sedget_protected_buffer *prot_buf;	/* NULL for an unused slot */
+	size_t mem_size;
+	bool in_use;
+};
+
+struct _sedget_buf_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t scrubbed;	/* a scrub completed */
+	size_t mem_size;		/* of buffers allocated from now on */
+	sedget_buf_type type;
+	unsigned int flags;
+	size_t max_bufs;
+	size_t num_bufs;		/* allocated or being allocated */
+	size_t num_scrubbing;
+	size_t num_free;
+	struct pool_buf *bufs;		/* room for max_bufs */
+	size_t *free_slots;		/* indexes of idle buffers in 'bufs' */
+	struct input_stream stream;	/* for input pools of a stream */
+	bool has_stream;
+};
+
+sedget_buf_pool *sedget_create_buf_pool(size_t mem_size, sedget_buf_type type,
+					size_t max_bufs, unsigned int flags)
+{
+	sedget_buf_pool *pool;
+
+	if (mem_size == 0 || max_bufs == 0 ||
+	    type < SEDGET_BUF_INPUT || type > SEDGET_BUF_FRAME ||
+	    (flags & ~SEDGET_POOL_SCRUB)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return NULL;
+
+	pool->bufs = calloc(max_bufs, sizeof(*pool->bufs));
+	pool->free_slots = calloc(max_bufs, sizeof(*pool->free_slots));
+	if (pool->bufs == NULL || pool->free_slots == NULL) {
+		free(pool->bufs);
+		free(pool->free_slots);
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->scrubbed, NULL);
+	pool->mem_size = mem_size;
+	pool->type = type;
+	pool->flags = flags;
+	pool->max_bufs = max_bufs;
+
+	return pool;
+}
+
+int sedget_destroy_buf_pool(sedget_buf_pool *pool)
+{
+	if (pool == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->num_scrubbing)
+		pthread_cond_wait(&pool->scrubbed, &pool->lock);
+
+	if (pool->num_free != pool->num_bufs) {
+		ALOGE("%s: %zu buffers still in use", __FUNCTION__,
+		      pool->num_bufs - pool->num_free);
+		pthread_mutex_unlock(&pool->lock);
+		return -EBUSY;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	while (pool->num_free)
+		sedget_free_prot_buf(pool->bufs[pool->free_slots[--pool->num_free]].prot_buf);
+
+	pthread_cond_destroy(&pool->scrubbed);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->free_slots);
+	free(pool->bufs);
+	free(pool);
+
+	return 0;
+}
+
+/* Called with the pool lock held */
+static struct pool_buf *pool_find(sedget_buf_pool *pool,
+				  sedget_protected_buffer *prot_buf)
+{
+	size_t i;
+
+	for (i = 0; i < pool->max_bufs; i++)
+		if (pool->bufs[i].prot_buf == prot_buf)
+			return &pool->bufs[i];
+
+	return NULL;
+}
+
+/* Called with the pool lock held */
+static void pool_drop(sedget_buf_pool *pool, struct pool_buf *buf)
+{
+	sedget_free_prot_buf(buf->prot_buf);
+	memset(buf, 0, sizeof(*buf));
+	pool->num_bufs--;
+}
+
+/*
+ * Allocate one more buffer, handed out if 'in_use' or made idle. Called
+ * with the pool lock held, which is dropped during the allocation; a buffer
+ * of a size the pool was resized from meanwhile is freed and allocated
+ * again.
+ */
+static sedget_protected_buffer *pool_alloc(sedget_buf_pool *pool, bool in_use)
+{
+	sedget_protected_buffer *prot_buf;
+	struct pool_buf *buf;
+	size_t mem_size;
+	int err;
+
+	/* reserve the slot, the allocation may take a while */
+	pool->num_bufs++;
+
+	for (;;) {
+		mem_size = pool->mem_size;
+		pthread_mutex_unlock(&pool->lock);
+
+		prot_buf = sedget_alloc_prot_buf(mem_size, pool->type);
+		err = errno;
+
+		pthread_mutex_lock(&pool->lock);
+		if (prot_buf == NULL) {
+			pool->num_bufs--;
+			errno = err;
+			return NULL;
+		}
+		if (mem_size == pool->mem_size)
+			break;
+
+		sedget_free_prot_buf(prot_buf);
+	}
+
+	/* the reservation guarantees an unused slot */
+	buf = pool_find(pool, NULL);
+	buf->prot_buf = prot_buf;
+	buf->mem_size = mem_size;
+	buf->in_use = in_use;
+	if (!in_use)
+		pool->free_slots[pool->num_free++] = buf - pool->bufs;
+
+	return prot_buf;
+}
+
+sedget_protected_buffer *sedget_pool_get(sedget_buf_pool *pool)
+{
+	sedget_protected_buffer *prot_buf;
+	struct pool_buf *buf;
+
+	if (pool == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->num_free) {
+		buf = &pool->bufs[pool->free_slots[--pool->num_free]];
+		buf->in_use = true;
+		pthread_mutex_unlock(&pool->lock);
+		return buf->prot_buf;
+	}
+	if (pool->num_bufs == pool->max_bufs) {
+		pthread_mutex_unlock(&pool->lock);
+		errno = EBUSY;
+		return NULL;
+	}
+
+	prot_buf = pool_alloc(pool, true);
+	pthread_mutex_unlock(&pool->lock);
+
+	return prot_buf;
+}
+
+int sedget_pool_prefill(sedget_buf_pool *pool, size_t count)
+{
+	int ret = 0;
+
+	if (pool == NULL || count > pool->max_bufs)
+		return -EINVAL;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->num_free < count) {
+		if (pool->num_bufs == pool->max_bufs) {
+			ret = -EBUSY;
+			break;
+		}
+		if (pool_alloc(pool, false) == NULL) {
+			ret = -errno;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return ret;
+}
+
+int sedget_pool_resize(sedget_buf_pool *pool, size_t mem_size)
+{
+	if (pool == NULL || mem_size == 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&pool->lock);
+	/* also read without the lock by sedget_pool_buf_size */
+	__atomic_store_n(&pool->mem_size, mem_size, __ATOMIC_RELAXED);
+	while (pool->num_free)
+		pool_drop(pool, &pool->bufs[pool->free_slots[--pool->num_free]]);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/*
+ * Called with the pool lock held. Buffers of an earlier size are freed
+ * rather than recycled.
+ */
+static void pool_recycle(sedget_buf_pool *pool, struct pool_buf *buf)
+{
+	if (buf->mem_size != pool->mem_size) {
+		pool_drop(pool, buf);
+		return;
+	}
+
+	pool->free_slots[pool->num_free++] = buf - pool->bufs;
+}
+
+static void pool_scrub_done(sedget_protected_buffer *prot_buf, int result,
+			    void *arg)
+{
+	sedget_buf_pool *pool = arg;
+	struct pool_buf *buf;
+
+	pthread_mutex_lock(&pool->lock);
+	buf = pool_find(pool, prot_buf);
+	if (result == 0) {
+		pool_recycle(pool, buf);
+	} else {
+		/* never hand out a buffer that may still hold content */
+		ALOGE("%s: scrub failed %d, dropping buffer", __FUNCTION__,
+		      result);
+		pool_drop(pool, buf);
+	}
+	pool->num_scrubbing--;
+	pthread_cond_broadcast(&pool->scrubbed);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int sedget_pool_put(sedget_buf_pool *pool, sedget_protected_buffer *prot_buf)
+{
+	struct pool_buf *buf;
+	int ret = 0;
+
+	if (pool == NULL || prot_buf == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&pool->lock);
+	buf = pool_find(pool, prot_buf);
+	if (buf == NULL || !buf->in_use) {
+		pthread_mutex_unlock(&pool->lock);
+		return -EINVAL;
+	}
+	buf->in_use = false;
+
+	if (!(pool->flags & SEDGET_POOL_SCRUB) ||
+	    buf->mem_size != pool->mem_size) {
+		pool_recycle(pool, buf);
+		pthread_mutex_unlock(&pool->lock);
+		return 0;
+	}
+
+	pool->num_scrubbing++;
+	pthread_mutex_unlock(&pool->lock);
+
+	ret = sedget_scrub_prot_buf_async(prot_buf, 0, 0, pool_scrub_done, pool);
+	if (ret != 0)
+		pool_scrub_done(prot_buf, ret, pool);
+
+	return ret;
+}
+
+size_t sedget_pool_buf_size(const sedget_buf_pool *pool)
+{
+	return pool ? __atomic_load_n(&pool->mem_size, __ATOMIC_RELAXED) : 0;
+}
+
+void prot_pool_set_stream(sedget_buf_pool *pool,
+			  const struct input_stream *stream)
+{
+	pool->stream = *stream;
+	pool->has_stream = true;
+}
+
+const struct input_stream *prot_pool_stream(const sedget_buf_pool *pool)
+{
+	return pool && pool->has_stream ? &pool->stream : NULL;
+}
@@ -10,6 +10,9 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -19,48 +22,203 @@
 #include <cutils/native_handle.h>
 
 #include "sedget_video.h"
+#include "broker_proto.h"
+#include "tee_service.h"
 
-static int allocate_secure_buffer(size_t size, sedget_buf_type type)
+/* ION heap ids are bits of a heap mask */
+#define HEAP_ID_MAX		32
+
+/* Consecutive failed or slow allocations after which a heap is tried last */
+#define HEAP_STRIKES		3
+
+/* How long a heap is then tried last; doubled while it does not recover */
+#define HEAP_BACKOFF_MS		1000
+#define HEAP_BACKOFF_MAX_SHIFT	5
+
+/* Allocations slower than this per MiB, counting at least 1 MiB, are slow */
+#define HEAP_SLOW_US_PER_MB	5000
+
+struct heap_order {
+	unsigned int ids[SEDGET_HEAP_ORDER_MAX];
+	size_t count;
+};
+
+struct heap_state {
+	unsigned int attempts;
+	unsigned int failures;
+	unsigned int slow;
+	unsigned int avg_us;		/* moving average of successful ones */
+	unsigned int strikes;		/* consecutive failed or slow ones */
+	unsigned int backoffs;		/* back offs since it last recovered */
+	uint64_t retry_ms;		/* tried last until then */
+};
+
+/* ION heaps of each buffer type, see sedget_set_heap_order() */
+static const struct heap_order default_heap_orders[] = {
+	[SEDGET_BUF_INPUT] = { { ION_HEAP_ID_MVE_PROTECTED }, 1 },
+	[SEDGET_BUF_INTERMEDIATE] = { { ION_HEAP_ID_MULTIMEDIA_PROTECTED }, 1 },
+	[SEDGET_BUF_FIRMWARE] = { { ION_HEAP_ID_MVE_PRIVATE }, 1 },
+	/* frames are read by the display, like intermediate buffers */
+	[SEDGET_BUF_FRAME] = { { ION_HEAP_ID_MULTIMEDIA_PROTECTED }, 1 },
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct heap_order orders[SEDGET_BUF_FRAME + 1];	/* count 0: default */
+	struct heap_state state[HEAP_ID_MAX];
+} heaps = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int sedget_set_heap_order(sedget_buf_type type, const unsigned int *heap_ids,
+			  size_t count)
+{
+	size_t i;
+
+	if (type < SEDGET_BUF_INPUT || type > SEDGET_BUF_FRAME ||
+	    count > SEDGET_HEAP_ORDER_MAX || (count && heap_ids == NULL))
+		return -EINVAL;
+
+	for (i = 0; i < count; i++)
+		if (heap_ids[i] >= HEAP_ID_MAX)
+			return -EINVAL;
+
+	pthread_mutex_lock(&heaps.lock);
+	for (i = 0; i < count; i++)
+		heaps.orders[type].ids[i] = heap_ids[i];
+	heaps.orders[type].count = count;
+	pthread_mutex_unlock(&heaps.lock);
+
+	return 0;
+}
+
+int sedget_set_heap_mask(sedget_buf_type type, unsigned int heap_id_mask)
+{
+	unsigned int ids[SEDGET_HEAP_ORDER_MAX];
+	unsigned int id;
+	size_t count = 0;
+
+	for (id = 0; id < HEAP_ID_MAX && heap_id_mask >> id; id++) {
+		if (!(heap_id_mask & (1u << id)))
+			continue;
+		if (count == SEDGET_HEAP_ORDER_MAX)
+			return -EINVAL;
+		ids[count++] = id;
+	}
+
+	return sedget_set_heap_order(type, ids, count);
+}
+
+int sedget_get_heap_stats(unsigned int heap_id,
+			  struct sedget_heap_stats *stats)
+{
+	const struct heap_state *st;
+
+	if (heap_id >= HEAP_ID_MAX || stats == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&heaps.lock);
+	st = &heaps.state[heap_id];
+	stats->attempts = st->attempts;
+	stats->failures = st->failures;
+	stats->slow = st->slow;
+	stats->avg_latency_us = st->avg_us;
+	stats->deprioritized = st->retry_ms > now_us() / 1000;
+	pthread_mutex_unlock(&heaps.lock);
+
+	return 0;
+}
+
+/*
+ * Heaps to try for 'type': the configured order, with heaps backing off
+ * moved to the end, still in order, as a last resort.
+ */
+static size_t get_heap_order(sedget_buf_type type, unsigned int *ids)
+{
+	const struct heap_order *order;
+	uint64_t now_ms = now_us() / 1000;
+	size_t i, n = 0;
+	int pass;
+
+	pthread_mutex_lock(&heaps.lock);
+	order = heaps.orders[type].count ? &heaps.orders[type] :
+					   &default_heap_orders[type];
+	for (pass = 0; pass < 2; pass++)
+		for (i = 0; i < order->count; i++)
+			if ((heaps.state[order->ids[i]].retry_ms > now_ms) == pass)
+				ids[n++] = order->ids[i];
+	pthread_mutex_unlock(&heaps.lock);
+
+	return n;
+}
+
+static void account_heap(unsigned int id, size_t size, bool ok,
+			 uint64_t elapsed_us)
+{
+	struct heap_state *st = &heaps.state[id];
+	uint64_t mb = size >> 20 ? size >> 20 : 1;
+	bool slow = ok && elapsed_us > HEAP_SLOW_US_PER_MB * mb;
+	unsigned int shift;
+
+	pthread_mutex_lock(&heaps.lock);
+	st->attempts++;
+	if (ok) {
+		/* 1/8 weight to the new sample */
+		st->avg_us = st->avg_us ? st->avg_us - st->avg_us / 8 +
+					  elapsed_us / 8 : elapsed_us;
+	} else {
+		st->failures++;
+	}
+
+	if (ok && !slow) {
+		st->strikes = 0;
+		st->backoffs = 0;
+		st->retry_ms = 0;
+	} else {
+		st->slow += slow;
+		if (++st->strikes >= HEAP_STRIKES) {
+			shift = st->backoffs < HEAP_BACKOFF_MAX_SHIFT ?
+				st->backoffs : HEAP_BACKOFF_MAX_SHIFT;
+			st->retry_ms = now_us() / 1000 +
+				       ((uint64_t)HEAP_BACKOFF_MS << shift);
+			st->backoffs++;
+			st->strikes = 0;
+			ALOGD("ION heap %u %s, tried last for %llu ms", id,
+			      ok ? "slow" : "failing",
+			      (unsigned long long)HEAP_BACKOFF_MS << shift);
+		}
+	}
+	pthread_mutex_unlock(&heaps.lock);
+}
+
+/* Allocate from one heap; the dma-buf fd or a negative errno */
+static int ion_alloc_heap(int ion_fd, size_t size, unsigned int heap_id)
 {
-	int ion_fd, mem_fd = -1;
 	struct ion_allocation_data alloc_data;
 	struct ion_handle_data hdl_data;
 	struct ion_fd_data fd_data;
+	int ret;
 
-	ion_fd = open("/dev/ion", O_RDWR);
-	if (ion_fd < 0) {
-		ALOGE("Failed to open ion device.");
-		return -EACCES;
-	}
 	alloc_data.len = size;
 	alloc_data.align = 0;
 	alloc_data.flags = 0;
+	alloc_data.heap_id_mask = 1u << heap_id;
 
-	switch (type) {
-		case SEDGET_BUF_INPUT:
-			alloc_data.heap_id_mask = ION_HEAP_MVE_PROTECTED_MASK;
-			break;
-		case SEDGET_BUF_INTERMEDIATE:
-			alloc_data.heap_id_mask = ION_HEAP_MULTIMEDIA_PROTECTED_MASK;
-			break;
-		case SEDGET_BUF_FIRMWARE:
-			alloc_data.heap_id_mask = ION_HEAP_MVE_PRIVATE_MASK;
-			break;
-		default:
-			ALOGE("Invalid Buffer Type requested.");
-			goto alloc_exit;
-	}
-
-	if (ioctl(ion_fd, ION_IOC_ALLOC, &alloc_data) == -1) {
-		ALOGE("Failed ION_IOC_ALLOC: %d(%s).", errno, strerror(errno));
-		goto alloc_exit;
-	}
+	if (ioctl(ion_fd, ION_IOC_ALLOC, &alloc_data) == -1)
+		return -errno;
 
 	/* get new created sharing fd for memory sharing with driver */
 	fd_data.handle = alloc_data.handle;
 	fd_data.fd = -1;
-	if (ioctl(ion_fd, ION_IOC_MAP, &fd_data) != -1)
-		mem_fd = fd_data.fd;
+	ret = ioctl(ion_fd, ION_IOC_MAP, &fd_data) != -1 ? fd_data.fd : -errno;
 
 	/* just free handle here since it is useless; buffer don't free with
 	 * handle freeing operation since they are individual items
@@ -68,49 +226,142 @@ static int allocate_secure_buffer(size_t size, sedget_buf_type type)
 	hdl_data.handle = alloc_data.handle;
 	(void)ioctl(ion_fd, ION_IOC_FREE, &hdl_data);
 
-alloc_exit:
+	return ret;
+}
+
+static int allocate_secure_buffer(size_t size, sedget_buf_type type)
+{
+	unsigned int ids[SEDGET_HEAP_ORDER_MAX];
+	int ion_fd, mem_fd = -ENOMEM;
+	uint64_t start;
+	size_t i, n;
+
+	ion_fd = open("/dev/ion", O_RDWR);
+	if (ion_fd < 0) {
+		ALOGE("Failed to open ion device.");
+		return -EACCES;
+	}
+
+	n = get_heap_order(type, ids);
+	for (i = 0; i < n; i++) {
+		start = now_us();
+		mem_fd = ion_alloc_heap(ion_fd, size, ids[i]);
+		account_heap(ids[i], size, mem_fd >= 0, now_us() - start);
+		if (mem_fd >= 0)
+			break;
+
+		ALOGD("ION heap %u can not allocate %zu bytes: %d(%s)", ids[i],
+		      size, -mem_fd, strerror(-mem_fd));
+	}
+
 	close(ion_fd);
 
-	/* record correct errno */
-	if (mem_fd == -1)
-		return -errno;
-	else
-		return mem_fd;
+	if (mem_fd < 0)
+		ALOGE("Failed ION_IOC_ALLOC: %d(%s).", -mem_fd,
+		      strerror(-mem_fd));
+
+	return mem_fd;
 }
 
-sedget_protected_buffer *sedget_alloc_prot_buf(size_t mem_size,
-					       sedget_buf_type type)
+/*
+ * The handle holds the buffer fd, the id the broker knows the buffer by, 0
+ * for buffers allocated locally, and the buffer type.
+ */
+#define HANDLE_BROKER_ID	1
+#define HANDLE_TYPE		2
+
+static void release_firmware(int mem_fd)
 {
-	native_handle_t *native_h = native_handle_create(1, 0);
-	int mem_fd = -1;
+	off_t size = lseek(mem_fd, 0, SEEK_END);
+	int ret;
 
-	if (type < SEDGET_BUF_INPUT || type > SEDGET_BUF_FIRMWARE){
-		ALOGE("%s: Invalid buffer type", __FUNCTION__);
+	if (size <= 0)
+		return;
+
+	ret = tee_service_release_firmware(mem_fd, size);
+	if (ret != 0 && ret != -ENOENT)
+		ALOGE("Failed to wipe firmware buffer: %d", ret);
+}
+
+/* Wrap 'mem_fd', or its negative errno, in a buffer handle */
+static sedget_protected_buffer *new_handle(int mem_fd, uint32_t broker_id,
+					   sedget_buf_type type)
+{
+	native_handle_t *native_h;
+
+	if (mem_fd < 0) {
+		errno = -mem_fd;
 		return NULL;
 	}
 
+	native_h = native_handle_create(1, 2);
 	if (!native_h) {
 		ALOGE("%s: failed to create native handle", __FUNCTION__);
+		close(mem_fd);
+		if (broker_id)
+			(void)broker_release(broker_id);
+		errno = ENOMEM;
 		return NULL;
 	}
 
-	mem_fd = allocate_secure_buffer(mem_size, type);
-	if(mem_fd >= 0) {
-		native_h->data[0] = mem_fd;
-	}
-out:
+	native_h->data[0] = mem_fd;
+	native_h->data[HANDLE_BROKER_ID] = broker_id;
+	native_h->data[HANDLE_TYPE] = type;
+
 	return native_h;
 }
 
+sedget_protected_buffer *sedget_alloc_prot_buf(size_t mem_size,
+					       sedget_buf_type type)
+{
+	if (type < SEDGET_BUF_INPUT || type > SEDGET_BUF_FRAME){
+		ALOGE("%s: Invalid buffer type", __FUNCTION__);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return new_handle(allocate_secure_buffer(mem_size, type), 0, type);
+}
+
+sedget_protected_buffer *sedget_alloc_brokered_buf(size_t mem_size,
+						   sedget_buf_type type)
+{
+	uint32_t broker_id = 0;
+	int mem_fd;
+
+	if (type < SEDGET_BUF_INPUT || type > SEDGET_BUF_FRAME){
+		ALOGE("%s: Invalid buffer type", __FUNCTION__);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	mem_fd = broker_alloc(mem_size, type, &broker_id);
+	return new_handle(mem_fd, mem_fd >= 0 ? broker_id : 0, type);
+}
+
 int sedget_free_prot_buf(sedget_protected_buffer *prot_buf)
 {
+	native_handle_t *native_h = prot_buf;
+	uint32_t broker_id;
+
 	if(NULL == prot_buf) {
 		ALOGE("%s Not a sedget memory object", __FUNCTION__);
 		return -EINVAL;
 	}
 
-	native_handle_close((native_handle_t *)prot_buf);
-	native_handle_delete((native_handle_t *)prot_buf);
+	broker_id = native_h->data[HANDLE_BROKER_ID];
+
+	/* the TA keeps refusing firmware pages until they are wiped */
+	if (native_h->data[HANDLE_TYPE] == SEDGET_BUF_FIRMWARE)
+		release_firmware(native_h->data[0]);
+
+	tee_service_release_buffer(native_h->data[0]);
+	native_handle_close(native_h);
+	native_handle_delete(native_h);
+
+	/* the broker drops the buffer once every holder closed it */
+	if (broker_id)
+		(void)broker_release(broker_id);
 
 	return 0;
 }
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#define LOG_TAG "SEDGET_VIDEO"
+#include <cutils/log.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sedget_video.h"
+#include "tee_service.h"
+
+/* Jobs handed to the TA at once by the scrub thread */
+#define SCRUB_QUEUE_BATCH	16
+
+struct scrub_job {
+	struct scrub_job *next;
+	sedget_protected_buffer *prot_buf;
+	size_t offset;
+	size_t len;
+	sedget_scrub_done done;
+	void *arg;
+};
+
+/*
+ * Jobs are run in queue order by a single thread started on first use.
+ * Whatever is queued while the TA is busy goes in the next batch.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;		/* jobs were queued */
+	pthread_cond_t idle;		/* queue drained, nothing running */
+	struct scrub_job *head;
+	struct scrub_job **tail;
+	bool started;
+	bool busy;
+} scrub_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.idle = PTHREAD_COND_INITIALIZER,
+	.tail = &scrub_queue.head,
+};
+
+static int scrub_ranges(struct scrub_job **jobs, size_t count)
+{
+	struct tee_scrub_req reqs[SCRUB_QUEUE_BATCH];
+	size_t i;
+	int ret;
+
+	for (i = 0; i < count; i++) {
+		reqs[i].fd = sedget_get_mem_fd(jobs[i]->prot_buf);
+		reqs[i].offset = jobs[i]->offset;
+		reqs[i].len = jobs[i]->len;
+	}
+
+	ret = tee_service_scrub(reqs, count);
+
+	for (i = 0; i < count; i++)
+		if (jobs[i]->done)
+			jobs[i]->done(jobs[i]->prot_buf, reqs[i].result,
+				      jobs[i]->arg);
+
+	return ret;
+}
+
+static void *scrub_thread(void *unused)
+{
+	struct scrub_job *jobs[SCRUB_QUEUE_BATCH];
+	size_t n, i;
+
+	(void)unused;
+
+	pthread_mutex_lock(&scrub_queue.lock);
+	for (;;) {
+		while (scrub_queue.head == NULL)
+			pthread_cond_wait(&scrub_queue.work, &scrub_queue.lock);
+
+		for (n = 0; n < SCRUB_QUEUE_BATCH && scrub_queue.head; n++) {
+			jobs[n] = scrub_queue.head;
+			scrub_queue.head = jobs[n]->next;
+		}
+		if (scrub_queue.head == NULL)
+			scrub_queue.tail = &scrub_queue.head;
+		scrub_queue.busy = true;
+		pthread_mutex_unlock(&scrub_queue.lock);
+
+		if (scrub_ranges(jobs, n))
+			ALOGE("Failed to scrub %zu protected buffers", n);
+		for (i = 0; i < n; i++)
+			free(jobs[i]);
+
+		pthread_mutex_lock(&scrub_queue.lock);
+		scrub_queue.busy = false;
+		if (scrub_queue.head == NULL)
+			pthread_cond_broadcast(&scrub_queue.idle);
+	}
+
+	return NULL;
+}
+
+int sedget_scrub_prot_buf(sedget_protected_buffer *prot_buf,
+			  size_t offset, size_t len)
+{
+	struct tee_scrub_req req;
+	int ret;
+
+	if (prot_buf == NULL)
+		return -EINVAL;
+
+	req.fd = sedget_get_mem_fd(prot_buf);
+	req.offset = offset;
+	req.len = len;
+
+	ret = tee_service_scrub(&req, 1);
+
+	return ret ? ret : req.result;
+}
+
+int sedget_scrub_prot_buf_async(sedget_protected_buffer *prot_buf,
+				size_t offset, size_t len,
+				sedget_scrub_done done, void *arg)
+{
+	struct scrub_job *job;
+	pthread_t thread;
+	int ret = 0;
+
+	if (prot_buf == NULL)
+		return -EINVAL;
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL)
+		return -ENOMEM;
+
+	job->prot_buf = prot_buf;
+	job->offset = offset;
+	job->len = len;
+	job->done = done;
+	job->arg = arg;
+
+	pthread_mutex_lock(&scrub_queue.lock);
+	if (!scrub_queue.started) {
+		ret = -pthread_create(&thread, NULL, scrub_thread, NULL);
+		if (ret == 0) {
+			pthread_detach(thread);
+			scrub_queue.started = true;
+		}
+	}
+	if (ret == 0) {
+		*scrub_queue.tail = job;
+		scrub_queue.tail = &job->next;
+		pthread_cond_signal(&scrub_queue.work);
+	}
+	pthread_mutex_unlock(&scrub_queue.lock);
+
+	if (ret != 0) {
+		ALOGE("Failed to start scrub thread: %d", ret);
+		free(job);
+	}
+
+	return ret;
+}
+
+void sedget_scrub_wait_idle(void)
+{
+	pthread_mutex_lock(&scrub_queue.lock);
+	while (scrub_queue.head != NULL || scrub_queue.busy)
+		pthread_cond_wait(&scrub_queue.idle, &scrub_queue.lock);
+	pthread_mutex_unlock(&scrub_queue.lock);
+}
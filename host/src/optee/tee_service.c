@@ -7,7 +7,9 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <errno.h>
 #include <string.h>
 
@@ -28,6 +30,37 @@ typedef struct _Tee_Inst {
 	TEEC_Session sess;
 } Tee_Inst;
 
+/* Entries sent per INJECT or SCRUB invocation */
+#define INJECT_BATCH	64
+#define SCRUB_BATCH	64
+
+/*
+ * Session kept for the process lifetime by commands on the playback hot
+ * path; the TA serializes commands of all sessions anyway.
+ */
+static Tee_Inst service_inst;
+static bool service_ready;
+static pthread_mutex_t service_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Secure buffers stay registered with the service session from their first
+ * use until tee_service_release_buffer(), which sedget_free_prot_buf()
+ * calls before closing their fd, so that each command does not pay for
+ * registering them again. Buffers beyond SHM_CACHE_SIZE are registered for
+ * each call. Slots are protected by the service lock.
+ */
+#define SHM_CACHE_SIZE	16
+
+struct shm_slot {
+	TEEC_SharedMemory shm;
+	int fd;
+	bool used;
+	bool released;		/* released while in use */
+	unsigned int users;
+};
+
+static struct shm_slot shm_cache[SHM_CACHE_SIZE];
+
 static int create_tee_instance(Tee_Inst *inst)
 {
 	TEEC_Result teerc;
@@ -40,12 +73,28 @@ static int create_tee_instance(Tee_Inst *inst)
 
 	teerc = TEEC_OpenSession(&inst->ctx, &inst->sess, &ta_uuid,
 				 TEEC_LOGIN_PUBLIC, NULL, NULL, &err_origin);
-	if (teerc != TEEC_SUCCESS)
+	if (teerc != TEEC_SUCCESS) {
 		ALOGE("Error: open session failed %x %d", teerc, err_origin);
+		TEEC_FinalizeContext(&inst->ctx);
+	}
 
 	return (teerc == TEEC_SUCCESS) ? 0 : -EFAULT;
 }
 
+static Tee_Inst *get_service_instance(void)
+{
+	Tee_Inst *inst = NULL;
+
+	pthread_mutex_lock(&service_lock);
+	if (!service_ready && create_tee_instance(&service_inst) == 0)
+		service_ready = true;
+	if (service_ready)
+		inst = &service_inst;
+	pthread_mutex_unlock(&service_lock);
+
+	return inst;
+}
+
 static void finalize_tee_instance(Tee_Inst *inst)
 {
 	if (inst) {
@@ -78,25 +127,124 @@ static void tee_deregister_buffer(Tee_Inst *inst, void *shm)
 	TEEC_ReleaseSharedMemory((TEEC_SharedMemory *)shm);
 }
 
-int tee_service_load_firmware(void *fw_data, size_t len,
-			      int mem_fd, size_t mem_len,
-			      void *fw_secure_desc, int fw_desc_size,
-			      uint32_t ncores)
+/* Called without the service lock on a slot nobody uses any longer */
+static void unregister_slot(struct shm_slot *slot)
 {
-	TEEC_SharedMemory shm;
+	tee_deregister_buffer(&service_inst, &slot->shm);
+
+	pthread_mutex_lock(&service_lock);
+	slot->used = false;
+	slot->released = false;
+	pthread_mutex_unlock(&service_lock);
+}
+
+/*
+ * Shared memory of the secure buffer 'mem_fd': the one kept registered
+ * with the service session if 'inst' is that session and a slot is left,
+ * else 'tmp' registered for this call. Give it back with put_buffer().
+ */
+static TEEC_SharedMemory *get_buffer(Tee_Inst *inst, int mem_fd,
+				     TEEC_SharedMemory *tmp)
+{
+	struct shm_slot *slot = NULL;
+	size_t i;
+
+	if (inst == &service_inst) {
+		pthread_mutex_lock(&service_lock);
+		for (i = 0; i < SHM_CACHE_SIZE; i++) {
+			if (shm_cache[i].used && !shm_cache[i].released &&
+			    shm_cache[i].fd == mem_fd) {
+				slot = &shm_cache[i];
+				break;
+			}
+			if (!shm_cache[i].used && slot == NULL)
+				slot = &shm_cache[i];
+		}
+		if (slot && !slot->used) {
+			if (tee_register_buffer(inst, &slot->shm, mem_fd) == 0) {
+				slot->fd = mem_fd;
+				slot->used = true;
+			} else {
+				slot = NULL;
+			}
+		}
+		if (slot)
+			slot->users++;
+		pthread_mutex_unlock(&service_lock);
+		if (slot)
+			return &slot->shm;
+	}
+
+	return tee_register_buffer(inst, tmp, mem_fd) == 0 ? tmp : NULL;
+}
+
+static void put_buffer(Tee_Inst *inst, TEEC_SharedMemory *shm,
+		       TEEC_SharedMemory *tmp)
+{
+	struct shm_slot *slot;
+	bool unregister;
+
+	if (shm == tmp) {
+		tee_deregister_buffer(inst, tmp);
+		return;
+	}
+
+	/* 'shm' is the first member of its slot */
+	slot = (struct shm_slot *)shm;
+	pthread_mutex_lock(&service_lock);
+	unregister = --slot->users == 0 && slot->released;
+	pthread_mutex_unlock(&service_lock);
+
+	if (unregister)
+		unregister_slot(slot);
+}
+
+void tee_service_release_buffer(int mem_fd)
+{
+	struct shm_slot *slot = NULL;
+	bool unregister = false;
+	size_t i;
+
+	pthread_mutex_lock(&service_lock);
+	for (i = 0; i < SHM_CACHE_SIZE; i++) {
+		if (shm_cache[i].used && !shm_cache[i].released &&
+		    shm_cache[i].fd == mem_fd) {
+			slot = &shm_cache[i];
+			slot->released = true;
+			unregister = slot->users == 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&service_lock);
+
+	/* otherwise the last user unregisters it */
+	if (unregister)
+		unregister_slot(slot);
+}
+
+static int load_firmware(Tee_Inst *inst, void *fw_data, size_t len,
+			 int mem_fd, size_t *mem_len,
+			 void *fw_secure_desc, size_t *fw_desc_size,
+			 uint32_t ncores)
+{
+	TEEC_SharedMemory tmp, *shm;
 	TEEC_Result teerc = TEEC_ERROR_GENERIC;
 	TEEC_Operation op;
-	Tee_Inst tee_inst;
 	uint32_t err_origin;
+	uint32_t cmd = SEDGET_VIDEO_TA_CMD_LOAD_FW;
 	int ret;
 
-	ret = create_tee_instance(&tee_inst);
-	if (ret != 0)
-		return ret;
+	/* segmented packages are decrypted on several cores when possible */
+	ret = tee_workers_decrypt(fw_data, len, mem_fd, *mem_len);
+	if (ret == 0)
+		cmd = SEDGET_VIDEO_TA_CMD_FINISH_FW;
+	else if (ret != -ENOTSUP)
+		ALOGD("Parallel firmware decryption failed %d, loading serially",
+		      ret);
 
-	ret = tee_register_buffer(&tee_inst, &shm, mem_fd);
-	if (ret != 0)
-		goto _finalize_exit;
+	shm = get_buffer(inst, mem_fd, &tmp);
+	if (shm == NULL)
+		return -EINVAL;
 
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
@@ -107,19 +255,31 @@ int tee_service_load_firmware(void *fw_data, size_t len,
 	op.params[0].tmpref.buffer = fw_data;
 	op.params[0].tmpref.size = len;
 
-	op.params[1].memref.parent = &shm;
-	op.params[1].memref.size = mem_len;
+	op.params[1].memref.parent = shm;
+	op.params[1].memref.size = *mem_len;
 	op.params[1].memref.offset = 0;
 
 	op.params[2].tmpref.buffer = fw_secure_desc;
-	op.params[2].tmpref.size = fw_desc_size;
+	op.params[2].tmpref.size = *fw_desc_size;
 
 	op.params[3].value.a = ncores;
 	op.params[3].value.b = 0;
 
-	teerc = TEEC_InvokeCommand(&tee_inst.sess,
-				   SEDGET_VIDEO_TA_CMD_LOAD_FW,
-				   &op, &err_origin);
+	teerc = TEEC_InvokeCommand(&inst->sess, cmd, &op, &err_origin);
+	if (teerc == TEEC_ERROR_SHORT_BUFFER &&
+	    op.params[1].memref.size > *mem_len) {
+		/* TA reports the secure buffer size it needs */
+		*mem_len = op.params[1].memref.size;
+		ret = -ENOSPC;
+		goto _deregister_exit;
+	}
+	if (teerc == TEEC_ERROR_SHORT_BUFFER &&
+	    op.params[2].tmpref.size > *fw_desc_size) {
+		/* TA reports the descriptor size it needs */
+		*fw_desc_size = op.params[2].tmpref.size;
+		ret = -EOVERFLOW;
+		goto _deregister_exit;
+	}
 	if (teerc != TEEC_SUCCESS) {
 		ALOGE("TA Load firmware failed %#x - %d", teerc, err_origin);
 		ret = -EINVAL;
@@ -128,6 +288,103 @@ int tee_service_load_firmware(void *fw_data, size_t len,
 
 	ret = 0;
 
+_deregister_exit:
+	put_buffer(inst, shm, &tmp);
+
+	return ret;
+}
+
+int tee_service_load_firmware(void *fw_data, size_t len,
+			      int mem_fd, size_t *mem_len,
+			      void *fw_secure_desc, size_t *fw_desc_size,
+			      uint32_t ncores)
+{
+	Tee_Inst tee_inst;
+	int ret;
+
+	ret = create_tee_instance(&tee_inst);
+	if (ret != 0)
+		return ret;
+
+	ret = load_firmware(&tee_inst, fw_data, len, mem_fd, mem_len,
+			    fw_secure_desc, fw_desc_size, ncores);
+
+	finalize_tee_instance(&tee_inst);
+
+	return ret;
+}
+
+int tee_service_reload_firmware(void *fw_data, size_t len,
+				int mem_fd, size_t *mem_len,
+				void *fw_secure_desc, size_t *fw_desc_size,
+				uint32_t ncores)
+{
+	Tee_Inst *inst = get_service_instance();
+
+	if (inst == NULL)
+		return -EACCES;
+
+	return load_firmware(inst, fw_data, len, mem_fd, mem_len,
+			     fw_secure_desc, fw_desc_size, ncores);
+}
+
+int tee_service_rescale_firmware(int mem_fd, size_t mem_len,
+				 void *fw_secure_desc, size_t *fw_desc_size,
+				 uint32_t ncores)
+{
+	TEEC_SharedMemory shm;
+	TEEC_Result teerc = TEEC_ERROR_GENERIC;
+	TEEC_Operation op;
+	Tee_Inst tee_inst;
+	uint32_t err_origin;
+	int ret;
+
+	ret = create_tee_instance(&tee_inst);
+	if (ret != 0)
+		return ret;
+
+	ret = tee_register_buffer(&tee_inst, &shm, mem_fd);
+	if (ret != 0)
+		goto _finalize_exit;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INOUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_NONE);
+
+	op.params[0].memref.parent = &shm;
+	op.params[0].memref.size = mem_len;
+	op.params[0].memref.offset = 0;
+
+	op.params[1].tmpref.buffer = fw_secure_desc;
+	op.params[1].tmpref.size = *fw_desc_size;
+
+	op.params[2].value.a = ncores;
+	op.params[2].value.b = 0;
+
+	teerc = TEEC_InvokeCommand(&tee_inst.sess,
+				   SEDGET_VIDEO_TA_CMD_RESCALE_FW,
+				   &op, &err_origin);
+	if (teerc != TEEC_SUCCESS) {
+		ALOGE("TA Rescale firmware failed %#x - %d", teerc, err_origin);
+		if (teerc == TEEC_ERROR_SHORT_BUFFER &&
+		    op.params[1].tmpref.size > *fw_desc_size) {
+			/* TA reports the descriptor size it needs */
+			*fw_desc_size = op.params[1].tmpref.size;
+			ret = -EOVERFLOW;
+		} else if (teerc == TEEC_ERROR_SHORT_BUFFER) {
+			ret = -ENOSPC;
+		} else if (teerc == TEEC_ERROR_NOT_SUPPORTED) {
+			ret = -ENOTSUP;
+		} else {
+			ret = -EINVAL;
+		}
+		goto _deregister_exit;
+	}
+
+	ret = 0;
+
 _deregister_exit:
 	tee_deregister_buffer(&tee_inst, &shm);
 _finalize_exit:
@@ -135,3 +392,296 @@ _finalize_exit:
 
 	return ret;
 }
+
+int tee_service_release_firmware(int mem_fd, size_t mem_len)
+{
+	TEEC_SharedMemory tmp, *shm;
+	TEEC_Result teerc;
+	TEEC_Operation op;
+	uint32_t err_origin;
+	Tee_Inst *inst;
+	int ret;
+
+	inst = get_service_instance();
+	if (inst == NULL)
+		return -EACCES;
+
+	shm = get_buffer(inst, mem_fd, &tmp);
+	if (shm == NULL)
+		return -EINVAL;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INOUT,
+					 TEEC_NONE, TEEC_NONE, TEEC_NONE);
+
+	op.params[0].memref.parent = shm;
+	op.params[0].memref.size = mem_len;
+	op.params[0].memref.offset = 0;
+
+	teerc = TEEC_InvokeCommand(&inst->sess, SEDGET_VIDEO_TA_CMD_RELEASE_FW,
+				   &op, &err_origin);
+	if (teerc == TEEC_ERROR_ITEM_NOT_FOUND) {
+		ret = -ENOENT;
+	} else if (teerc != TEEC_SUCCESS) {
+		ALOGE("TA Release firmware failed %#x - %d", teerc, err_origin);
+		ret = -EIO;
+	}
+
+	put_buffer(inst, shm, &tmp);
+
+	return ret;
+}
+
+/*
+ * Take the longest run of at most 'max_n' entries of 'fds' that refers to
+ * at most 'max_fds' distinct buffers. These are stored in 'run_fds' and
+ * their count in '*nfds'; 'slot[i]' is the index in 'run_fds' of entry i.
+ */
+static size_t take_fd_run(const int *fds, size_t count, size_t max_n,
+			  int *run_fds, size_t max_fds, size_t *nfds,
+			  uint32_t *slot)
+{
+	size_t n, k;
+
+	*nfds = 0;
+	for (n = 0; n < count && n < max_n; n++) {
+		for (k = 0; k < *nfds; k++)
+			if (run_fds[k] == fds[n])
+				break;
+		if (k == *nfds) {
+			if (*nfds == max_fds)
+				break;
+			run_fds[(*nfds)++] = fds[n];
+		}
+		slot[n] = k;
+	}
+
+	return n;
+}
+
+/* Get 'n' buffers, see get_buffer(); on failure none is kept */
+static int get_buffers(Tee_Inst *inst, TEEC_SharedMemory **shm,
+		       TEEC_SharedMemory *tmp, const int *fds, size_t n)
+{
+	size_t k;
+
+	for (k = 0; k < n; k++) {
+		shm[k] = get_buffer(inst, fds[k], &tmp[k]);
+		if (shm[k] == NULL) {
+			while (k--)
+				put_buffer(inst, shm[k], &tmp[k]);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static void put_buffers(Tee_Inst *inst, TEEC_SharedMemory **shm,
+			TEEC_SharedMemory *tmp, size_t n)
+{
+	while (n--)
+		put_buffer(inst, shm[n], &tmp[n]);
+}
+
+/*
+ * Send entries [start, start + n) whose destination buffers are already
+ * registered in 'dst_shm'. Source offsets are rebased on the staging span
+ * the entries use so that only that span is passed to the TA.
+ */
+static int inject_batch(Tee_Inst *inst, TEEC_SharedMemory *src_shm,
+			struct sedget_inject_entry *entries, size_t n,
+			TEEC_SharedMemory **dst_shm, size_t ndst)
+{
+	TEEC_Result teerc;
+	TEEC_Operation op;
+	uint32_t err_origin;
+	uint64_t lo = UINT32_MAX, hi = 0;
+	size_t k;
+
+	for (k = 0; k < n; k++) {
+		uint64_t end = (uint64_t)entries[k].src_offset + entries[k].len;
+
+		if (entries[k].src_offset < lo)
+			lo = entries[k].src_offset;
+		if (end > hi)
+			hi = end;
+	}
+	if (hi > src_shm->size)
+		hi = src_shm->size;
+	if (lo > hi)
+		lo = hi;
+
+	for (k = 0; k < n; k++)
+		entries[k].src_offset -= lo;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_TEMP_INOUT,
+					 TEEC_MEMREF_PARTIAL_OUTPUT,
+					 ndst > 1 ? TEEC_MEMREF_PARTIAL_OUTPUT :
+						    TEEC_NONE);
+
+	op.params[0].memref.parent = src_shm;
+	op.params[0].memref.offset = lo;
+	op.params[0].memref.size = hi - lo;
+
+	op.params[1].tmpref.buffer = entries;
+	op.params[1].tmpref.size = n * sizeof(*entries);
+
+	for (k = 0; k < ndst; k++) {
+		op.params[2 + k].memref.parent = dst_shm[k];
+		op.params[2 + k].memref.offset = 0;
+		op.params[2 + k].memref.size = dst_shm[k]->size;
+	}
+
+	teerc = TEEC_InvokeCommand(&inst->sess, SEDGET_VIDEO_TA_CMD_INJECT,
+				   &op, &err_origin);
+
+	for (k = 0; k < n; k++)
+		entries[k].src_offset += lo;
+
+	if (teerc != TEEC_SUCCESS) {
+		ALOGE("TA Inject failed %#x - %d", teerc, err_origin);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int tee_service_inject(const void *staging, size_t staging_size,
+		       struct sedget_inject_entry *entries,
+		       const int *dst_fds, size_t count)
+{
+	TEEC_SharedMemory src_shm, tmp[SEDGET_INJECT_MAX_DST];
+	TEEC_SharedMemory *dst_shm[SEDGET_INJECT_MAX_DST];
+	TEEC_Result teerc;
+	Tee_Inst *inst;
+	int fds[SEDGET_INJECT_MAX_DST];
+	uint32_t slot[INJECT_BATCH];
+	size_t start, n, k, ndst;
+	int ret = 0;
+
+	for (k = 0; k < count; k++)
+		entries[k].result = TEEC_ERROR_GENERIC;
+
+	inst = get_service_instance();
+	if (inst == NULL)
+		return -EACCES;
+
+	memset(&src_shm, 0, sizeof(src_shm));
+	src_shm.buffer = (void *)staging;
+	src_shm.size = staging_size;
+	src_shm.flags = TEEC_MEM_INPUT;
+	teerc = TEEC_RegisterSharedMemory(&inst->ctx, &src_shm);
+	if (teerc != TEEC_SUCCESS) {
+		ALOGE("Error: TEEC_RegisterSharedMemory failed %x", teerc);
+		return -EINVAL;
+	}
+
+	for (start = 0; start < count && ret == 0; start += n) {
+		/* consecutive entries going to at most two buffers */
+		n = take_fd_run(dst_fds + start, count - start, INJECT_BATCH,
+				fds, SEDGET_INJECT_MAX_DST, &ndst, slot);
+		for (k = 0; k < n; k++)
+			entries[start + k].dst = slot[k];
+
+		ret = get_buffers(inst, dst_shm, tmp, fds, ndst);
+		if (ret != 0)
+			break;
+
+		ret = inject_batch(inst, &src_shm, entries + start, n,
+				   dst_shm, ndst);
+
+		put_buffers(inst, dst_shm, tmp, ndst);
+	}
+
+	TEEC_ReleaseSharedMemory(&src_shm);
+
+	return ret;
+}
+
+int tee_service_scrub(struct tee_scrub_req *reqs, size_t count)
+{
+	TEEC_SharedMemory tmp[SEDGET_SCRUB_MAX_BUF];
+	TEEC_SharedMemory *shm[SEDGET_SCRUB_MAX_BUF];
+	struct sedget_scrub_entry entries[SCRUB_BATCH];
+	int fds[SCRUB_BATCH], run_fds[SEDGET_SCRUB_MAX_BUF];
+	uint32_t slot[SCRUB_BATCH];
+	TEEC_Result teerc;
+	TEEC_Operation op;
+	uint32_t err_origin;
+	Tee_Inst *inst;
+	size_t start, n, k, nbuf;
+	int ret = 0;
+
+	for (k = 0; k < count; k++)
+		reqs[k].result = -EIO;
+
+	inst = get_service_instance();
+	if (inst == NULL)
+		return -EACCES;
+
+	for (start = 0; start < count; start += n) {
+		for (k = 0; k < count - start && k < SCRUB_BATCH; k++)
+			fds[k] = reqs[start + k].fd;
+
+		/* consecutive requests on at most three buffers */
+		n = take_fd_run(fds, k, SCRUB_BATCH, run_fds,
+				SEDGET_SCRUB_MAX_BUF, &nbuf, slot);
+
+		ret = get_buffers(inst, shm, tmp, run_fds, nbuf);
+		if (ret != 0)
+			break;
+
+		for (k = 0; k < n; k++) {
+			struct tee_scrub_req *req = &reqs[start + k];
+			size_t size = shm[slot[k]]->size;
+
+			entries[k].buf = slot[k];
+			entries[k].offset = req->offset;
+			/* the TA rejects ranges not within the buffer */
+			entries[k].len = req->len ? req->len :
+				(req->offset < size ? size - req->offset : 0);
+			entries[k].result = TEEC_ERROR_GENERIC;
+			if (req->offset > UINT32_MAX || req->len > UINT32_MAX)
+				entries[k].buf = SEDGET_SCRUB_MAX_BUF;
+		}
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INOUT,
+			TEEC_MEMREF_PARTIAL_OUTPUT,
+			nbuf > 1 ? TEEC_MEMREF_PARTIAL_OUTPUT : TEEC_NONE,
+			nbuf > 2 ? TEEC_MEMREF_PARTIAL_OUTPUT : TEEC_NONE);
+
+		op.params[0].tmpref.buffer = entries;
+		op.params[0].tmpref.size = n * sizeof(entries[0]);
+
+		for (k = 0; k < nbuf; k++) {
+			op.params[1 + k].memref.parent = shm[k];
+			op.params[1 + k].memref.offset = 0;
+			op.params[1 + k].memref.size = shm[k]->size;
+		}
+
+		teerc = TEEC_InvokeCommand(&inst->sess,
+					   SEDGET_VIDEO_TA_CMD_SCRUB,
+					   &op, &err_origin);
+		put_buffers(inst, shm, tmp, nbuf);
+		if (teerc != TEEC_SUCCESS) {
+			ALOGE("TA Scrub failed %#x - %d", teerc, err_origin);
+			ret = -EINVAL;
+			break;
+		}
+
+		for (k = 0; k < n; k++) {
+			if (entries[k].result == TEEC_SUCCESS)
+				reqs[start + k].result = 0;
+			else if (entries[k].result == TEEC_ERROR_ACCESS_DENIED)
+				reqs[start + k].result = -EACCES;
+			else
+				reqs[start + k].result = -EINVAL;
+		}
+	}
+
+	return ret;
+}
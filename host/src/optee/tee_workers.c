@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#define LOG_TAG "SEDGET_VIDEO"
+#include <cutils/log.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+
+#include <tee_client_api_extensions.h>
+#include <sedget_video_ta.h>
+#include <mve_fw_package.h>
+
+#include "tee_service.h"
+
+/* Worker sessions, hence secure world threads, used for one package */
+#define WORKERS_MAX	8
+
+/*
+ * Worker sessions are opened on first use and kept for the process
+ * lifetime: each is a TA instance of its own, costly to create. Loads
+ * using them are serialized, they would compete for cores anyway.
+ */
+static struct {
+	TEEC_Context ctx;
+	TEEC_Session sess[WORKERS_MAX];
+	size_t count;
+	bool ready;
+	bool unavailable;
+} workers;
+static pthread_mutex_t workers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct worker_job {
+	TEEC_Session *sess;
+	TEEC_SharedMemory *pkg;
+	TEEC_SharedMemory *fw;
+	size_t mem_len;
+	uint32_t first;
+	uint32_t count;
+	TEEC_Result res;
+	pthread_t thread;
+	bool started;
+};
+
+/* Open up to 'wanted' sessions, called with workers_lock held */
+static size_t open_workers(size_t wanted)
+{
+	TEEC_UUID ta_uuid = SEDGET_WORKER_TA_UUID;
+	TEEC_Result teerc;
+	uint32_t err_origin;
+
+	if (workers.unavailable)
+		return 0;
+
+	if (!workers.ready) {
+		if (TEEC_InitializeContext(NULL, &workers.ctx) != TEEC_SUCCESS) {
+			workers.unavailable = true;
+			return 0;
+		}
+		workers.ready = true;
+	}
+
+	while (workers.count < wanted) {
+		teerc = TEEC_OpenSession(&workers.ctx,
+					 &workers.sess[workers.count],
+					 &ta_uuid, TEEC_LOGIN_PUBLIC, NULL,
+					 NULL, &err_origin);
+		if (teerc != TEEC_SUCCESS) {
+			ALOGE("Error: open worker session failed %x %d",
+			      teerc, err_origin);
+			/* most likely not installed, do not try again */
+			if (workers.count == 0)
+				workers.unavailable = true;
+			break;
+		}
+		workers.count++;
+	}
+
+	return workers.count < wanted ? workers.count : wanted;
+}
+
+static void *run_job(void *arg)
+{
+	struct worker_job *job = arg;
+	TEEC_Operation op;
+	uint32_t err_origin;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE,
+					 TEEC_MEMREF_PARTIAL_OUTPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_NONE);
+
+	op.params[0].memref.parent = job->pkg;
+
+	op.params[1].memref.parent = job->fw;
+	op.params[1].memref.size = job->mem_len;
+	op.params[1].memref.offset = 0;
+
+	op.params[2].value.a = job->first;
+	op.params[2].value.b = job->count;
+
+	job->res = TEEC_InvokeCommand(job->sess, SEDGET_WORKER_TA_CMD_DECRYPT,
+				      &op, &err_origin);
+	if (job->res != TEEC_SUCCESS)
+		ALOGE("Worker decrypt of segments %u+%u failed %#x - %d",
+		      job->first, job->count, job->res, err_origin);
+
+	return NULL;
+}
+
+/* Segments of a segmented package, 0 for other packages */
+static uint32_t count_segments(const void *fw_data, size_t len)
+{
+	struct mve_fw_pkg_header hdr;
+	struct mve_fw_pkg_segments segs;
+
+	if (len < sizeof(hdr) + sizeof(segs))
+		return 0;
+
+	memcpy(&hdr, fw_data, sizeof(hdr));
+	if (hdr.magic != MVE_FW_PKG_MAGIC ||
+	    hdr.cipher != MVE_FW_PKG_CIPHER_AES_CTR)
+		return 0;
+
+	memcpy(&segs, (const uint8_t *)fw_data + sizeof(hdr), sizeof(segs));
+	return segs.num_segments;
+}
+
+static int run_jobs(struct worker_job *jobs, size_t njobs)
+{
+	TEEC_Result res = TEEC_SUCCESS;
+	size_t i;
+
+	/* the calling thread takes the first job */
+	for (i = 1; i < njobs; i++)
+		jobs[i].started = pthread_create(&jobs[i].thread, NULL,
+						 run_job, &jobs[i]) == 0;
+	run_job(&jobs[0]);
+
+	for (i = 1; i < njobs; i++) {
+		if (jobs[i].started)
+			pthread_join(jobs[i].thread, NULL);
+		else
+			run_job(&jobs[i]);
+	}
+
+	for (i = 0; i < njobs && res == TEEC_SUCCESS; i++)
+		res = jobs[i].res;
+
+	if (res == TEEC_ERROR_SHORT_BUFFER)
+		return -ENOSPC;
+	/* segments too large for a worker, or a buffer holding firmware */
+	if (res == TEEC_ERROR_NOT_SUPPORTED)
+		return -ENOTSUP;
+	if (res == TEEC_ERROR_ACCESS_DENIED)
+		return -EACCES;
+	return res == TEEC_SUCCESS ? 0 : -EIO;
+}
+
+int tee_workers_decrypt(const void *fw_data, size_t len, int mem_fd,
+			size_t mem_len)
+{
+	struct worker_job jobs[WORKERS_MAX];
+	TEEC_SharedMemory pkg_shm, fw_shm;
+	uint32_t nseg = count_segments(fw_data, len);
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t i, njobs;
+	int ret = -ENOTSUP;
+
+	njobs = WORKERS_MAX;
+	if (ncpus > 0 && (size_t)ncpus < njobs)
+		njobs = ncpus;
+	if (nseg < njobs)
+		njobs = nseg;
+	/* LOAD_FW decrypts and verifies a single job in one pass */
+	if (njobs < 2)
+		return -ENOTSUP;
+
+	pthread_mutex_lock(&workers_lock);
+	njobs = open_workers(njobs);
+	if (njobs < 2)
+		goto out;
+
+	memset(&pkg_shm, 0, sizeof(pkg_shm));
+	pkg_shm.buffer = (void *)fw_data;
+	pkg_shm.size = len;
+	pkg_shm.flags = TEEC_MEM_INPUT;
+	if (TEEC_RegisterSharedMemory(&workers.ctx, &pkg_shm) != TEEC_SUCCESS)
+		goto out;
+
+	memset(&fw_shm, 0, sizeof(fw_shm));
+	fw_shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	if (TEEC_RegisterSharedMemoryFileDescriptor(&workers.ctx, &fw_shm,
+						    mem_fd) != TEEC_SUCCESS) {
+		TEEC_ReleaseSharedMemory(&pkg_shm);
+		goto out;
+	}
+
+	/* contiguous runs of segments, of even sizes */
+	memset(jobs, 0, sizeof(jobs));
+	for (i = 0; i < njobs; i++) {
+		jobs[i].sess = &workers.sess[i];
+		jobs[i].pkg = &pkg_shm;
+		jobs[i].fw = &fw_shm;
+		jobs[i].mem_len = mem_len;
+		jobs[i].first = (uint64_t)nseg * i / njobs;
+		jobs[i].count = (uint64_t)nseg * (i + 1) / njobs - jobs[i].first;
+	}
+
+	ret = run_jobs(jobs, njobs);
+
+	TEEC_ReleaseSharedMemory(&fw_shm);
+	TEEC_ReleaseSharedMemory(&pkg_shm);
+out:
+	pthread_mutex_unlock(&workers_lock);
+	return ret;
+}
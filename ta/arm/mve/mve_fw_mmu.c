@@ -5,12 +5,13 @@
 #include <string.h>
 #include <trace.h>
 #include <tee_api.h>
-
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 #include "sedget_video_ta.h"
 #include "mve_fw_mmu.h"
-
-typedef uint32_t phys_addr_t;
+#include "mve_fw_package.h"
 
 static mve_mmu_entry_t mve_mmu_make_l1l2_entry(enum mve_mmu_attrib attrib,
 					       phys_addr_t paddr,
@@ -21,99 +22,331 @@ static mve_mmu_entry_t mve_mmu_make_l1l2_entry(enum mve_mmu_attrib attrib,
 		((((mve_mmu_entry_t)access) << MVE_MMU_ACCESS_SHIFT) & MVE_MMU_ACCESS_MASK);
 }
 
-static uint8_t* write_pages(uint8_t* l2page, phys_addr_t paddr, uint32_t num_pages, bool bss) {
-	uint32_t i;
-	enum mve_mmu_access access = ACCESS_EXECUTABLE;
-	if(true == bss) {
-		access = ACCESS_READ_WRITE;
+/*
+ * Fill 'count' consecutive entries mapping consecutive pages from 'paddr'.
+ * Entries only differ by their physical address field, which grows by one
+ * page per entry, so whole vectors of them are produced at once.
+ */
+static void write_run(mve_mmu_entry_t *l2page, phys_addr_t paddr, uint32_t count,
+		      enum mve_mmu_access access)
+{
+	const mve_mmu_entry_t bits = mve_mmu_make_l1l2_entry(ATTRIB_PRIVATE, 0, access);
+	const uint32_t step = MVE_MMU_PAGE_SIZE >> (MVE_MMU_PAGE_SHIFT - MVE_MMU_PADDR_SHIFT);
+	uint32_t addr = (uint32_t)(paddr >> (MVE_MMU_PAGE_SHIFT - MVE_MMU_PADDR_SHIFT));
+	uint32_t i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+	uint32x4_t v_addr = vmlaq_n_u32(vdupq_n_u32(addr), vld1q_u32(lanes), step);
+	const uint32x4_t v_step = vdupq_n_u32(4 * step);
+	const uint32x4_t v_mask = vdupq_n_u32(MVE_MMU_PADDR_MASK);
+	const uint32x4_t v_bits = vdupq_n_u32(bits);
+
+	for (; i + 4 <= count; i += 4) {
+		vst1q_u32(l2page + i, vorrq_u32(vandq_u32(v_addr, v_mask), v_bits));
+		v_addr = vaddq_u32(v_addr, v_step);
 	}
+	addr += i * step;
+#endif
 
-	for(i=0; i<num_pages; i++) {
-		mve_mmu_entry_t entry = mve_mmu_make_l1l2_entry(ATTRIB_PRIVATE, paddr + (i*MVE_MMU_PAGE_SIZE), access);
-		*((uint32_t *)(void*)l2page) = entry;
-		l2page += MVE_MMU_PAGE_TABLE_ENTRY_SIZE;
+	for (; i < count; i++) {
+		l2page[i] = (addr & MVE_MMU_PADDR_MASK) | bits;
+		addr += step;
 	}
-	return l2page;
 }
 
-void fill_l2pages(uint8_t* fw_addr, uint8_t* fw_phys_addr, size_t fw_size, uint8_t *l2pages,
-		uint32_t ncores, struct mve_fw_secure_descriptor *fw_secure_desc)
+phys_addr_t mve_fw_page_phys(const struct mve_fw_phys *phys, size_t page)
 {
-	uint32_t i, j;
-	struct fw_header *header;
-	uint32_t num_pages, num_text_pages, num_shared_pages, num_bss_pages;
-	phys_addr_t data_start, shared_pages, bss_page;
-	uint8_t *l2page;
+	if (!phys->pfns)
+		return phys->base + ((phys_addr_t)page << MVE_MMU_PAGE_SHIFT);
 
-	header = (struct fw_header *)(void*)fw_addr;
-	fw_secure_desc->fw_version.major = header->protocol_major;
-	fw_secure_desc->fw_version.minor = header->protocol_minor;
+	return (phys_addr_t)phys->pfns[page] << MVE_MMU_PAGE_SHIFT;
+}
 
-	num_pages = (fw_size + MVE_MMU_PAGE_SIZE - 1) >> MVE_MMU_PAGE_SHIFT;
+bool mve_fw_phys_contiguous(const struct mve_fw_phys *phys, size_t page,
+			    size_t count)
+{
+	size_t i;
+
+	if (!phys->pfns)
+		return true;
+
+	for (i = 1; i < count; i++)
+		if (phys->pfns[page + i] != phys->pfns[page] + i)
+			return false;
+
+	return true;
+}
+
+/* Map 'count' buffer pages from 'page', splitting at physical discontinuities */
+static void map_pages(mve_mmu_entry_t *l2page, const struct mve_fw_phys *phys,
+		      uint32_t page, uint32_t count, enum mve_mmu_access access)
+{
+	uint32_t n;
+
+	if (!phys->pfns) {
+		write_run(l2page, mve_fw_page_phys(phys, page), count, access);
+		return;
+	}
+
+	while (count) {
+		for (n = 1; n < count && phys->pfns[page + n] == phys->pfns[page] + n; n++)
+			;
+		write_run(l2page, mve_fw_page_phys(phys, page), n, access);
+		l2page += n;
+		page += n;
+		count -= n;
+	}
+}
+
+static bool is_shared_page(const struct fw_header *header, uint32_t addr)
+{
+	return addr >= header->master_rw_start_address &&
+		addr < header->master_rw_start_address + header->master_rw_size;
+}
+
+/* Extend the last segment with one entry or start a new one */
+static void add_segment_entry(struct mve_fw_layout *layout, uint32_t entry,
+			      uint32_t page, uint32_t type)
+{
+	struct mve_fw_segment *seg = layout->segments + layout->num_segments;
+
+	if (layout->num_segments) {
+		struct mve_fw_segment *last = seg - 1;
+
+		if (last->type == type && last->entry + last->count == entry &&
+		    last->page + last->count == page) {
+			last->count++;
+			return;
+		}
+	}
+
+	seg->entry = entry;
+	seg->count = 1;
+	seg->page = page;
+	seg->type = type;
+	layout->num_segments++;
+}
+
+/*
+ * Check the firmware header and set the page counts it determines. Returns
+ * the number of L2 entries the firmware may use, 0 if the header is invalid.
+ */
+static uint32_t init_layout(const struct fw_header *header, size_t fw_size,
+			    struct mve_fw_layout *layout)
+{
+	uint32_t num_entries;
+
+	layout->segments = NULL;
+	layout->num_segments = 0;
+
+	if (fw_size < sizeof(*header) || header->text_length > fw_size ||
+	    header->bss_bitmap_size > sizeof(header->bss_bitmap) * 8) {
+		EMSG("Invalid firmware header");
+		return 0;
+	}
+
+	layout->num_pages = (fw_size + MVE_MMU_PAGE_SIZE - 1) >> MVE_MMU_PAGE_SHIFT;
+	layout->num_text_pages = (header->text_length + MVE_MMU_PAGE_SIZE - 1) / MVE_MMU_PAGE_SIZE;
+	layout->num_shared_pages = 0;
+	layout->num_bss_pages = 0;
+
+	/* first mmu table entry is left blank */
+	num_entries = 1 + layout->num_text_pages + header->bss_bitmap_size;
+	layout->num_l2pages = (num_entries + MVE_MMU_PAGE_TABLE_ENTRIES - 1) /
+			      MVE_MMU_PAGE_TABLE_ENTRIES;
+
+	return num_entries;
+}
+
+TEE_Result mve_fw_get_layout(const uint8_t *fw_addr, size_t fw_size,
+			     struct mve_fw_layout *layout)
+{
+	const struct fw_header *header = (const void *)fw_addr;
+	uint32_t i, j, entry;
 
-	num_text_pages = (header->text_length + MVE_MMU_PAGE_SIZE - 1) / MVE_MMU_PAGE_SIZE;
+	if (!init_layout(header, fw_size, layout))
+		return TEE_ERROR_BAD_FORMAT;
+
+	/* at worst one text segment plus one per bitmap bit */
+	layout->segments = TEE_Malloc((1 + header->bss_bitmap_size) *
+				      sizeof(*layout->segments),
+				      TEE_MALLOC_FILL_ZERO);
+	if (!layout->segments)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	/* Leave first mmu table entry blank */
+	if (layout->num_text_pages) {
+		layout->segments[0].entry = 1;
+		layout->segments[0].count = layout->num_text_pages;
+		layout->segments[0].page = 0;
+		layout->segments[0].type = MVE_FW_SEG_TEXT;
+		layout->num_segments = 1;
+	}
 
 	i = header->bss_start_address >> MVE_MMU_PAGE_SHIFT;
-	num_shared_pages = 0;
-	num_bss_pages = 0;
+	entry = 1 + layout->num_text_pages;
 
-	/* dry run to get number of shared bss and non shared bss pages */
+	/* Mark each BSS page as either a BSS page or a shared page */
 	for (j = 0; j < header->bss_bitmap_size; j++)
 	{
 		uint32_t word_idx = j >> 5;
 		uint32_t bit_idx = j & 0x1f;
 		uint32_t addr = i << MVE_MMU_PAGE_SHIFT;
 
-		if (addr >= header->master_rw_start_address &&
-				addr < header->master_rw_start_address + header->master_rw_size)
+		if (is_shared_page(header, addr))
 		{
 			/* Shared pages can be shared between all cores running the same session. */
-			num_shared_pages++;
+			add_segment_entry(layout, entry, layout->num_shared_pages++,
+					  MVE_FW_SEG_SHARED);
 		}
-		else if ((header->bss_bitmap[word_idx] & (1 << bit_idx)) != 0)
+		else if ((header->bss_bitmap[word_idx] & (1u << bit_idx)) != 0)
 		{
-			num_bss_pages++;
+			/* Non-shared BSS pages. These pages need to be allocated for each core
+			 * and session. */
+			add_segment_entry(layout, entry, layout->num_bss_pages++,
+					  MVE_FW_SEG_BSS);
 		}
 		i++;
+		entry++;
 	}
 
-	data_start = (uintptr_t)fw_phys_addr;
-	shared_pages = data_start + (num_pages << MVE_MMU_PAGE_SHIFT);
-	bss_page = shared_pages + (num_shared_pages << MVE_MMU_PAGE_SHIFT);
+	return TEE_SUCCESS;
+}
 
-	for(i=0; i<ncores;i++) {
-		uint32_t bss_start_address = header->bss_start_address >> MVE_MMU_PAGE_SHIFT;
-		phys_addr_t shared_page = shared_pages;
-		l2page = l2pages + (i*MVE_MMU_PAGE_SIZE) + MVE_MMU_PAGE_TABLE_ENTRY_SIZE; /*Leave first mmu table entry blank*/
-		l2page = write_pages(l2page, data_start, num_text_pages, false);
-		for (j = 0; j < header->bss_bitmap_size; j++)
-		{
-			uint32_t word_idx = j >> 5;
-			uint32_t bit_idx = j & 0x1f;
-			uint32_t addr = bss_start_address << MVE_MMU_PAGE_SHIFT;
-
-			/* Mark this page as either a BSS page or a shared page */
-			if (addr >= header->master_rw_start_address &&
-					addr < header->master_rw_start_address + header->master_rw_size)
-			{
-				/* Shared pages can be shared between all cores running the same session. */
-				write_pages(l2page, shared_page, 1, true);
-				shared_page += (1 << MVE_MMU_PAGE_SHIFT);
-			}
-			else if ((header->bss_bitmap[word_idx] & (1 << bit_idx)) != 0)
-			{
-				/* Non-shared BSS pages. These pages need to be allocated for each core
-				 * and session. */
-				write_pages(l2page, bss_page, 1, true);
-				bss_page += (1 << MVE_MMU_PAGE_SHIFT);
-			}
-			else
-			{
-				DMSG("skip");
-			}
-			bss_start_address++;
-
-			l2page += MVE_MMU_PAGE_TABLE_ENTRY_SIZE;
+TEE_Result mve_fw_get_pkg_layout(const uint8_t *fw_addr, size_t fw_size,
+				 const void *section, size_t section_len,
+				 struct mve_fw_layout *layout)
+{
+	const struct fw_header *header = (const void *)fw_addr;
+	const struct mve_fw_pkg_layout *pkg = section;
+	const struct mve_fw_pkg_run *run;
+	uint32_t i, num_entries, limit[3];
+
+	num_entries = init_layout(header, fw_size, layout);
+	if (!num_entries)
+		return TEE_ERROR_BAD_FORMAT;
+
+	/*
+	 * The section is authenticated, yet only trusted as far as the
+	 * firmware header bounds it: counts stay within what the bitmap could
+	 * have produced and runs within the tables and pages they refer to.
+	 */
+	if (section_len < sizeof(*pkg) ||
+	    pkg->num_runs > 1 + header->bss_bitmap_size ||
+	    section_len != sizeof(*pkg) + pkg->num_runs * sizeof(*run) ||
+	    pkg->num_pages != layout->num_pages ||
+	    pkg->num_text_pages != layout->num_text_pages ||
+	    pkg->num_l2pages != layout->num_l2pages ||
+	    pkg->num_shared_pages > header->bss_bitmap_size ||
+	    pkg->num_bss_pages > header->bss_bitmap_size - pkg->num_shared_pages) {
+		EMSG("Invalid firmware layout");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+
+	limit[MVE_FW_SEG_TEXT] = layout->num_text_pages;
+	limit[MVE_FW_SEG_SHARED] = pkg->num_shared_pages;
+	limit[MVE_FW_SEG_BSS] = pkg->num_bss_pages;
+
+	for (i = 0; i < pkg->num_runs; i++) {
+		run = &pkg->runs[i];
+		if (!run->entry || !run->count || run->entry >= num_entries ||
+		    run->count > num_entries - run->entry ||
+		    run->type > MVE_FW_SEG_BSS ||
+		    run->page > limit[run->type] ||
+		    run->count > limit[run->type] - run->page) {
+			EMSG("Invalid firmware layout run %u", i);
+			return TEE_ERROR_BAD_FORMAT;
+		}
+	}
+
+	if (pkg->num_runs) {
+		layout->segments = TEE_Malloc(pkg->num_runs *
+					      sizeof(*layout->segments),
+					      TEE_MALLOC_FILL_ZERO);
+		if (!layout->segments)
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	for (i = 0; i < pkg->num_runs; i++) {
+		layout->segments[i].entry = pkg->runs[i].entry;
+		layout->segments[i].count = pkg->runs[i].count;
+		layout->segments[i].page = pkg->runs[i].page;
+		layout->segments[i].type = pkg->runs[i].type;
+	}
+	layout->num_segments = pkg->num_runs;
+	layout->num_shared_pages = pkg->num_shared_pages;
+	layout->num_bss_pages = pkg->num_bss_pages;
+
+	return TEE_SUCCESS;
+}
+
+void mve_fw_put_layout(struct mve_fw_layout *layout)
+{
+	TEE_Free(layout->segments);
+	layout->segments = NULL;
+	layout->num_segments = 0;
+}
+
+size_t mve_fw_data_size(const struct mve_fw_layout *layout, uint32_t ncores)
+{
+	return (size_t)(layout->num_pages + layout->num_shared_pages +
+			ncores * layout->num_bss_pages) << MVE_MMU_PAGE_SHIFT;
+}
+
+size_t mve_fw_tables_size(const struct mve_fw_layout *layout, uint32_t ncores,
+			  bool l1)
+{
+	return (size_t)ncores * (layout->num_l2pages + (l1 ? 1 : 0)) << MVE_MMU_PAGE_SHIFT;
+}
+
+void fill_l2pages(uint8_t* fw_addr, const struct mve_fw_phys *phys, const struct mve_fw_layout *layout,
+		  uint8_t *l2pages, uint32_t ncores, struct mve_fw_secure_descriptor *fw_secure_desc)
+{
+	uint32_t i, j;
+	struct fw_header *header;
+	uint32_t base[3];
+	mve_mmu_entry_t *l2page;
+
+	header = (struct fw_header *)(void*)fw_addr;
+	fw_secure_desc->fw_version.major = header->protocol_major;
+	fw_secure_desc->fw_version.minor = header->protocol_minor;
+
+	/* first buffer page of each type */
+	base[MVE_FW_SEG_TEXT] = 0;
+	base[MVE_FW_SEG_SHARED] = layout->num_pages;
+	base[MVE_FW_SEG_BSS] = layout->num_pages + layout->num_shared_pages;
+
+	for (i = 0; i < ncores; i++) {
+		/* the L2 tables of a core are consecutive, entries run across them */
+		l2page = (mve_mmu_entry_t *)(void *)(l2pages + (i * layout->num_l2pages * MVE_MMU_PAGE_SIZE));
+
+		for (j = 0; j < layout->num_segments; j++) {
+			const struct mve_fw_segment *seg = &layout->segments[j];
+
+			map_pages(l2page + seg->entry, phys, base[seg->type] + seg->page,
+				  seg->count,
+				  seg->type == MVE_FW_SEG_TEXT ? ACCESS_EXECUTABLE : ACCESS_READ_WRITE);
 		}
+
+		/* Non-shared BSS pages are allocated for each core */
+		base[MVE_FW_SEG_BSS] += layout->num_bss_pages;
+	}
+}
+
+void fill_l1pages(uint8_t *l1pages, const struct mve_fw_phys *phys,
+		  uint32_t l2pages_page, const struct mve_fw_layout *layout,
+		  uint32_t ncores)
+{
+	uint32_t i, j;
+	mve_mmu_entry_t *l1page;
+
+	for (i = 0; i < ncores; i++) {
+		l1page = (mve_mmu_entry_t *)(void *)(l1pages + (i * MVE_MMU_PAGE_SIZE));
+
+		for (j = 0; j < layout->num_l2pages; j++)
+			l1page[j] = mve_mmu_make_l1l2_entry(ATTRIB_PRIVATE,
+							    mve_fw_page_phys(phys, l2pages_page++),
+							    ACCESS_READ_ONLY);
 	}
 }
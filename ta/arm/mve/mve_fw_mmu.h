@@ -58,6 +58,7 @@ struct fw_header
     uint32_t master_rw_size;
 };
 
+/* Descriptors are mirrored for Client Applications in host/include/sedget_video.h */
 struct mve_fw_version
 {
     uint8_t major;                    /**< Firmware major version. */
@@ -70,15 +71,80 @@ struct mve_fw_secure_descriptor
     uint32_t l2pages;                 /**< Physical address of l2pages created by secure OS */
 };
 
+/**
+ * Descriptor returned instead of mve_fw_secure_descriptor when the caller
+ * provides room for it. Each core gets an L1 page table whose first
+ * num_l2pages entries map the firmware through num_l2pages consecutive L2
+ * page tables; the driver copies these entries into the L1 table of the
+ * session.
+ */
+struct mve_fw_secure_descriptor_ext
+{
+    struct mve_fw_secure_descriptor base; /**< l2pages is 0 unless it can describe the tables alone */
+    uint32_t num_l2pages;             /**< L2 page tables per core */
+    uint32_t reserved;                /**< Always 0 */
+    uint64_t l1pages;                 /**< Physical address of the L1 page tables, one per core */
+    uint64_t l2pages;                 /**< Physical address of the L2 page tables, num_l2pages per core */
+};
+
+enum mve_fw_segment_type
+{
+    MVE_FW_SEG_TEXT = 0,              /**< Executable image pages */
+    MVE_FW_SEG_SHARED = 1,            /**< BSS pages shared by all cores */
+    MVE_FW_SEG_BSS = 2                /**< BSS pages private to each core */
+};
+
+/**
+ * Run of consecutive L2 entries mapping consecutive pages of one type.
+ */
+struct mve_fw_segment
+{
+    uint32_t entry;                   /**< First L2 entry index */
+    uint32_t count;                   /**< Number of entries */
+    uint32_t page;                    /**< First page among the pages of this type */
+    uint32_t type;                    /**< enum mve_fw_segment_type */
+};
+
+/**
+ * Page usage of a firmware loaded into the secure buffer. The buffer holds,
+ * in this order, the decrypted image, the shared BSS pages, the private BSS
+ * pages of each core and finally the page tables, followed by the TA's
+ * load record in the last page. The page tables are num_l2pages L2 page
+ * tables per core then, when an L1 table is used, one L1 page table per
+ * core. Only the tables the descriptor points to need to be physically
+ * contiguous; other pages may be scattered.
+ */
+struct mve_fw_layout
+{
+    uint32_t num_pages;               /**< Pages holding the decrypted image */
+    uint32_t num_text_pages;          /**< Executable pages of the image */
+    uint32_t num_shared_pages;        /**< BSS pages shared by all cores */
+    uint32_t num_bss_pages;           /**< BSS pages private to each core */
+    uint32_t num_l2pages;             /**< L2 page tables needed per core */
+    uint32_t num_segments;            /**< Entries in segments */
+    struct mve_fw_segment *segments;  /**< L2 entries to fill, same for every core */
+};
+
+/* Maximum number of MVE cores a firmware can be loaded for */
+#define MVE_MAX_CORES 8
+
 /* The following code assumes 4 kB pages and that the MVE uses a 32-bit
  * virtual address space. */
 
+typedef uint64_t phys_addr_t;
+
+/* Page table entries hold physical addresses of up to 40 bits */
+#define MVE_MMU_PADDR_MAX ((1ULL << 40) - 1)
+
 #define MVE_MMU_PAGE_SHIFT 12
 #define MVE_MMU_PAGE_SIZE (1 << MVE_MMU_PAGE_SHIFT)
 
 /* Size of the MVE MMU page table entry in bytes */
 #define MVE_MMU_PAGE_TABLE_ENTRY_SIZE 4
 
+/* Number of entries in one L2 page table */
+#define MVE_MMU_PAGE_TABLE_ENTRIES (MVE_MMU_PAGE_SIZE / MVE_MMU_PAGE_TABLE_ENTRY_SIZE)
+
 enum mve_mmu_attrib
 {
     ATTRIB_PRIVATE = 0,
@@ -105,7 +171,51 @@ typedef uint32_t mve_mmu_entry_t;
 #define MVE_MMU_ACCESS_SHIFT 0
 
 
-void fill_l2pages(uint8_t* fw_addr, uint8_t* fw_phys_addr, size_t fw_size, uint8_t *l2pages,
-                         uint32_t ncores, struct mve_fw_secure_descriptor *fw_secure_desc);
+/* Decode the firmware header; release the result with mve_fw_put_layout() */
+TEE_Result mve_fw_get_layout(const uint8_t *fw_addr, size_t fw_size,
+                             struct mve_fw_layout *layout);
+
+/*
+ * Same from the layout section of the package the image was decrypted
+ * from, see mve_fw_package.h, without walking the header bitmap
+ */
+TEE_Result mve_fw_get_pkg_layout(const uint8_t *fw_addr, size_t fw_size,
+                                 const void *section, size_t section_len,
+                                 struct mve_fw_layout *layout);
+
+void mve_fw_put_layout(struct mve_fw_layout *layout);
+
+/* Bytes used by the image, shared and per-core BSS pages; tables excluded */
+size_t mve_fw_data_size(const struct mve_fw_layout *layout, uint32_t ncores);
+
+/* Bytes used by the page tables of all cores, with or without L1 tables */
+size_t mve_fw_tables_size(const struct mve_fw_layout *layout, uint32_t ncores,
+                          bool l1);
+
+/**
+ * Physical pages of the secure buffer, indexed from its first page: the
+ * buffer is contiguous from base when pfns is NULL, else page i is at
+ * pfns[i] << MVE_MMU_PAGE_SHIFT.
+ */
+struct mve_fw_phys
+{
+    phys_addr_t base;                 /**< Physical address of the first page */
+    const uint32_t *pfns;             /**< Frame number of each page, or NULL */
+};
+
+phys_addr_t mve_fw_page_phys(const struct mve_fw_phys *phys, size_t page);
+
+/* Whether 'count' buffer pages from 'page' are physically contiguous */
+bool mve_fw_phys_contiguous(const struct mve_fw_phys *phys, size_t page,
+                            size_t count);
+
+/* Fill num_l2pages consecutive L2 page tables per core */
+void fill_l2pages(uint8_t* fw_addr, const struct mve_fw_phys *phys, const struct mve_fw_layout *layout,
+                  uint8_t *l2pages, uint32_t ncores, struct mve_fw_secure_descriptor *fw_secure_desc);
+
+/* Fill one L1 page table per core pointing to the L2 tables from buffer page 'l2pages_page' */
+void fill_l1pages(uint8_t *l1pages, const struct mve_fw_phys *phys,
+                  uint32_t l2pages_page, const struct mve_fw_layout *layout,
+                  uint32_t ncores);
 
 #endif
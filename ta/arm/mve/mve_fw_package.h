@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __MVE_FW_PACKAGE_H
+#define __MVE_FW_PACKAGE_H
+
+/*
+ * Encrypted firmware package (.efwb) layout.
+ *
+ * Legacy packages carry no header: the whole file is the AES-ECB encrypted
+ * firmware image followed by its SHA1 signature. Newer packages start with
+ * a clear 'struct mve_fw_pkg_header', followed by the encrypted image and
+ * a trailer whose meaning depends on the cipher:
+ *
+ *   +----------------------+ 0
+ *   | mve_fw_pkg_header    |
+ *   | (extension sections) |
+ *   +----------------------+ header_size
+ *   | encrypted image      |
+ *   +----------------------+ header_size + payload_size
+ *   | trailer              |
+ *   +----------------------+
+ *
+ * All header bytes, including any extension up to header_size, are
+ * authenticated together with the image.
+ *
+ * AES-CTR packages are cut into segments that can be decrypted
+ * independently, by several secure world threads at once. The header is
+ * followed by a 'struct mve_fw_pkg_segments' holding an HMAC of each plain
+ * segment, and the trailer is an HMAC of the header bytes. Both HMACs are
+ * keyed with keys derived from the firmware key.
+ *
+ * When MVE_FW_PKG_FLAG_LAYOUT is set, the header ends with a
+ * 'struct mve_fw_pkg_layout' describing how the image is mapped, so that
+ * the TA does not have to derive it from the firmware header bitmap. It
+ * follows the segment table of AES-CTR packages, the header itself
+ * otherwise, and runs up to header_size.
+ */
+
+#define MVE_FW_PKG_MAGIC	0x42574653	/* "SFWB" */
+#define MVE_FW_PKG_VERSION	1
+
+enum mve_fw_pkg_cipher
+{
+    /** AES-GCM; the header is AAD and the trailer is the 16 byte tag. */
+    MVE_FW_PKG_CIPHER_AES_GCM = 1,
+
+    /**
+     * AES-CTR in segments; the header extension is a segment table and the
+     * trailer the 32 byte HMAC-SHA256 of the header.
+     */
+    MVE_FW_PKG_CIPHER_AES_CTR = 2,
+};
+
+/* The header ends with a struct mve_fw_pkg_layout */
+#define MVE_FW_PKG_FLAG_LAYOUT	(1 << 0)
+
+#define MVE_FW_PKG_GCM_IV_LEN	12
+#define MVE_FW_PKG_GCM_TAG_LEN	16
+
+/**
+ * Encrypted firmware package header. All fields are little endian.
+ */
+struct mve_fw_pkg_header
+{
+    /** MVE_FW_PKG_MAGIC */
+    uint32_t magic;
+
+    /** MVE_FW_PKG_VERSION */
+    uint16_t version;
+
+    /** Offset of the encrypted image from the start of the package. */
+    uint16_t header_size;
+
+    /** One of enum mve_fw_pkg_cipher. */
+    uint32_t cipher;
+
+    /** MVE_FW_PKG_FLAG_* bits, others are 0. */
+    uint32_t flags;
+
+    /** Size in bytes of the encrypted image. */
+    uint32_t payload_size;
+
+    /** Reserved for future use. Always 0. */
+    uint32_t reserved;
+
+    /** Cipher initial vector, left aligned and zero padded. */
+    uint8_t iv[16];
+};
+
+/* Segments start on page boundaries of the decrypted image */
+#define MVE_FW_PKG_SEGMENT_ALIGN	4096
+#define MVE_FW_PKG_MAC_LEN		32
+
+/**
+ * Segment table of MVE_FW_PKG_CIPHER_AES_CTR packages, right after
+ * struct mve_fw_pkg_header. Segment i covers bytes
+ * [i * segment_size, (i + 1) * segment_size) of the image, the last one
+ * ends with the image. The CTR counter block of image byte 'n' is the
+ * header 'iv' plus n / 16, as a 128 bit big endian number.
+ */
+struct mve_fw_pkg_segments
+{
+    /** Multiple of MVE_FW_PKG_SEGMENT_ALIGN. */
+    uint32_t segment_size;
+
+    /** Number of segments, the image size rounded up to segments. */
+    uint32_t num_segments;
+
+    /** HMAC-SHA256 of each plain segment. */
+    uint8_t mac[][MVE_FW_PKG_MAC_LEN];
+};
+
+/**
+ * Run of consecutive MMU entries mapping consecutive pages of one type,
+ * as struct mve_fw_segment in mve_fw_mmu.h.
+ */
+struct mve_fw_pkg_run
+{
+    /** First L2 entry, counted across the L2 tables of a core. */
+    uint32_t entry;
+
+    /** Number of entries. */
+    uint32_t count;
+
+    /** First page among the pages of this type. */
+    uint32_t page;
+
+    /** enum mve_fw_segment_type: 0 text, 1 shared BSS, 2 private BSS. */
+    uint32_t type;
+};
+
+/**
+ * Page layout of the image, as the TA would derive it from the bitmap of
+ * the firmware header. Page counts have the meaning of the fields of
+ * struct mve_fw_layout in mve_fw_mmu.h.
+ */
+struct mve_fw_pkg_layout
+{
+    uint32_t num_pages;
+    uint32_t num_text_pages;
+    uint32_t num_shared_pages;
+    uint32_t num_bss_pages;
+    uint32_t num_l2pages;
+
+    /** Number of runs. */
+    uint32_t num_runs;
+
+    struct mve_fw_pkg_run runs[];
+};
+
+#endif
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __TEST_TEE_API_H
+#define __TEST_TEE_API_H
+
+/* The part of the GP TEE internal API mve_fw_mmu.c uses, for host tests */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint32_t TEE_Result;
+
+#define TEE_SUCCESS			0x00000000
+#define TEE_ERROR_BAD_FORMAT		0xFFFF0005
+#define TEE_ERROR_OUT_OF_MEMORY		0xFFFF000C
+
+#define TEE_MALLOC_FILL_ZERO		0x00000000
+
+static inline void *TEE_Malloc(size_t size, uint32_t hint)
+{
+	(void)hint;
+	return calloc(1, size ? size : 1);
+}
+
+static inline void TEE_Free(void *buffer)
+{
+	free(buffer);
+}
+
+#endif
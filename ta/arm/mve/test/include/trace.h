@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __TEST_TRACE_H
+#define __TEST_TRACE_H
+
+/* Invalid headers are expected in tests, keep them quiet */
+#define EMSG(...)	do { } while (0)
+#define DMSG(...)	do { } while (0)
+
+#endif
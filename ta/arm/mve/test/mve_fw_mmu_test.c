@@ -0,0 +1,477 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+/*
+ * Checks that fill_l2pages(), which maps runs of pages described by the
+ * firmware layout, builds the same L2 page tables as the original builder
+ * that walked the BSS bitmap and wrote one entry at a time. See the Makefile
+ * for the scalar and NEON builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee_api.h>
+
+#include "mve_fw_mmu.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#ifdef MVE_TEST_NEON_EMULATED
+#define BUILDER_PATH "neon (emulated)"
+#else
+#define BUILDER_PATH "neon"
+#endif
+#else
+#define BUILDER_PATH "scalar"
+#endif
+
+#define TABLE_FILL 0xa5
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (uint32_t)(rng_state >> 16);
+}
+
+/* Uniform enough in [lo, hi] for test inputs */
+static uint32_t rnd_range(uint32_t lo, uint32_t hi)
+{
+	return lo + rnd() % (hi - lo + 1);
+}
+
+/*
+ * The builder as it was before layouts, unchanged but for the physical
+ * address of the buffer being passed as a value and an unsigned bitmap
+ * mask: 32-bit physical addresses, contiguous buffer and a single L2 table
+ * per core.
+ */
+typedef uint32_t old_phys_addr_t;
+
+static mve_mmu_entry_t old_make_l1l2_entry(enum mve_mmu_attrib attrib,
+					   old_phys_addr_t paddr,
+					   enum mve_mmu_access access)
+{
+	return ((((mve_mmu_entry_t)attrib) << MVE_MMU_ATTRIBUTE_SHIFT) & MVE_MMU_ATTRIBUTE_MASK) |
+		((mve_mmu_entry_t)((paddr >> (MVE_MMU_PAGE_SHIFT - MVE_MMU_PADDR_SHIFT)) & MVE_MMU_PADDR_MASK)) |
+		((((mve_mmu_entry_t)access) << MVE_MMU_ACCESS_SHIFT) & MVE_MMU_ACCESS_MASK);
+}
+
+static uint8_t* old_write_pages(uint8_t* l2page, old_phys_addr_t paddr, uint32_t num_pages, bool bss) {
+	uint32_t i;
+	enum mve_mmu_access access = ACCESS_EXECUTABLE;
+	if(true == bss) {
+		access = ACCESS_READ_WRITE;
+	}
+
+	for(i=0; i<num_pages; i++) {
+		mve_mmu_entry_t entry = old_make_l1l2_entry(ATTRIB_PRIVATE, paddr + (i*MVE_MMU_PAGE_SIZE), access);
+		*((uint32_t *)(void*)l2page) = entry;
+		l2page += MVE_MMU_PAGE_TABLE_ENTRY_SIZE;
+	}
+	return l2page;
+}
+
+static void old_fill_l2pages(uint8_t* fw_addr, old_phys_addr_t fw_phys_addr, size_t fw_size, uint8_t *l2pages,
+		uint32_t ncores, struct mve_fw_secure_descriptor *fw_secure_desc)
+{
+	uint32_t i, j;
+	struct fw_header *header;
+	uint32_t num_pages, num_text_pages, num_shared_pages, num_bss_pages;
+	old_phys_addr_t data_start, shared_pages, bss_page;
+	uint8_t *l2page;
+
+	header = (struct fw_header *)(void*)fw_addr;
+	fw_secure_desc->fw_version.major = header->protocol_major;
+	fw_secure_desc->fw_version.minor = header->protocol_minor;
+
+	num_pages = (fw_size + MVE_MMU_PAGE_SIZE - 1) >> MVE_MMU_PAGE_SHIFT;
+
+	num_text_pages = (header->text_length + MVE_MMU_PAGE_SIZE - 1) / MVE_MMU_PAGE_SIZE;
+
+	i = header->bss_start_address >> MVE_MMU_PAGE_SHIFT;
+	num_shared_pages = 0;
+	num_bss_pages = 0;
+
+	/* dry run to get number of shared bss and non shared bss pages */
+	for (j = 0; j < header->bss_bitmap_size; j++)
+	{
+		uint32_t word_idx = j >> 5;
+		uint32_t bit_idx = j & 0x1f;
+		uint32_t addr = i << MVE_MMU_PAGE_SHIFT;
+
+		if (addr >= header->master_rw_start_address &&
+				addr < header->master_rw_start_address + header->master_rw_size)
+		{
+			/* Shared pages can be shared between all cores running the same session. */
+			num_shared_pages++;
+		}
+		else if ((header->bss_bitmap[word_idx] & (1u << bit_idx)) != 0)
+		{
+			num_bss_pages++;
+		}
+		i++;
+	}
+
+	data_start = fw_phys_addr;
+	shared_pages = data_start + (num_pages << MVE_MMU_PAGE_SHIFT);
+	bss_page = shared_pages + (num_shared_pages << MVE_MMU_PAGE_SHIFT);
+
+	for(i=0; i<ncores;i++) {
+		uint32_t bss_start_address = header->bss_start_address >> MVE_MMU_PAGE_SHIFT;
+		old_phys_addr_t shared_page = shared_pages;
+		l2page = l2pages + (i*MVE_MMU_PAGE_SIZE) + MVE_MMU_PAGE_TABLE_ENTRY_SIZE; /*Leave first mmu table entry blank*/
+		l2page = old_write_pages(l2page, data_start, num_text_pages, false);
+		for (j = 0; j < header->bss_bitmap_size; j++)
+		{
+			uint32_t word_idx = j >> 5;
+			uint32_t bit_idx = j & 0x1f;
+			uint32_t addr = bss_start_address << MVE_MMU_PAGE_SHIFT;
+
+			/* Mark this page as either a BSS page or a shared page */
+			if (addr >= header->master_rw_start_address &&
+					addr < header->master_rw_start_address + header->master_rw_size)
+			{
+				/* Shared pages can be shared between all cores running the same session. */
+				old_write_pages(l2page, shared_page, 1, true);
+				shared_page += (1 << MVE_MMU_PAGE_SHIFT);
+			}
+			else if ((header->bss_bitmap[word_idx] & (1u << bit_idx)) != 0)
+			{
+				/* Non-shared BSS pages. These pages need to be allocated for each core
+				 * and session. */
+				old_write_pages(l2page, bss_page, 1, true);
+				bss_page += (1 << MVE_MMU_PAGE_SHIFT);
+			}
+			bss_start_address++;
+
+			l2page += MVE_MMU_PAGE_TABLE_ENTRY_SIZE;
+		}
+	}
+}
+
+/*
+ * The same walk generalised to what the old builder could not express:
+ * buffer page i is at pfns[i], which may be above 4 GiB or scattered, and
+ * each core has 'num_l2pages' consecutive L2 tables.
+ */
+static void ref_fill_l2pages(const struct fw_header *header, const uint32_t *pfns,
+			     size_t fw_size, uint32_t num_l2pages, uint8_t *l2pages,
+			     uint32_t ncores)
+{
+	uint32_t num_pages = (fw_size + MVE_MMU_PAGE_SIZE - 1) >> MVE_MMU_PAGE_SHIFT;
+	uint32_t num_text_pages = (header->text_length + MVE_MMU_PAGE_SIZE - 1) / MVE_MMU_PAGE_SIZE;
+	uint32_t num_shared_pages = 0;
+	uint32_t bss_page, i, j;
+
+	for (j = 0; j < header->bss_bitmap_size; j++) {
+		uint32_t addr = header->bss_start_address + (j << MVE_MMU_PAGE_SHIFT);
+
+		if (addr >= header->master_rw_start_address &&
+		    addr < header->master_rw_start_address + header->master_rw_size)
+			num_shared_pages++;
+	}
+
+	bss_page = num_pages + num_shared_pages;
+
+	for (i = 0; i < ncores; i++) {
+		mve_mmu_entry_t *l2page = (mve_mmu_entry_t *)(void *)
+			(l2pages + i * num_l2pages * MVE_MMU_PAGE_SIZE);
+		uint32_t entry = 1;
+		uint32_t shared_page = num_pages;
+
+		for (j = 0; j < num_text_pages; j++)
+			l2page[entry++] = old_make_l1l2_entry(ATTRIB_PRIVATE, 0, ACCESS_EXECUTABLE) |
+				((mve_mmu_entry_t)(((uint64_t)pfns[j] << MVE_MMU_PADDR_SHIFT) & MVE_MMU_PADDR_MASK));
+
+		for (j = 0; j < header->bss_bitmap_size; j++, entry++) {
+			uint32_t addr = header->bss_start_address + (j << MVE_MMU_PAGE_SHIFT);
+			uint32_t page;
+
+			if (addr >= header->master_rw_start_address &&
+			    addr < header->master_rw_start_address + header->master_rw_size)
+				page = shared_page++;
+			else if (header->bss_bitmap[j >> 5] & (1u << (j & 0x1f)))
+				page = bss_page++;
+			else
+				continue;
+
+			l2page[entry] = old_make_l1l2_entry(ATTRIB_PRIVATE, 0, ACCESS_READ_WRITE) |
+				((mve_mmu_entry_t)(((uint64_t)pfns[page] << MVE_MMU_PADDR_SHIFT) & MVE_MMU_PADDR_MASK));
+		}
+	}
+}
+
+enum bitmap_kind {
+	BITMAP_RANDOM,
+	BITMAP_ONES,
+	BITMAP_ZEROS,
+	BITMAP_ALTERNATE,
+	BITMAP_RUNS,
+	BITMAP_KINDS
+};
+
+static void make_bitmap(struct fw_header *header, enum bitmap_kind kind)
+{
+	uint32_t j;
+	bool bit = false;
+	uint32_t run = 0;
+
+	memset(header->bss_bitmap, 0, sizeof(header->bss_bitmap));
+
+	for (j = 0; j < header->bss_bitmap_size; j++) {
+		switch (kind) {
+		case BITMAP_RANDOM:
+			bit = rnd() & 1;
+			break;
+		case BITMAP_ONES:
+			bit = true;
+			break;
+		case BITMAP_ZEROS:
+			bit = false;
+			break;
+		case BITMAP_ALTERNATE:
+			bit = j & 1;
+			break;
+		default:
+			if (!run) {
+				bit = !bit;
+				run = rnd_range(1, 9);
+			}
+			run--;
+			break;
+		}
+		if (bit)
+			header->bss_bitmap[j >> 5] |= 1u << (j & 0x1f);
+	}
+}
+
+/* Random but valid header; returns the image size */
+static size_t make_header(struct fw_header *header, uint32_t num_text_pages,
+			  uint32_t bitmap_size, enum bitmap_kind kind)
+{
+	uint32_t bss_pages_start;
+	size_t fw_size;
+
+	memset(header, 0, sizeof(*header));
+	header->protocol_major = rnd();
+	header->protocol_minor = rnd();
+
+	if (num_text_pages)
+		header->text_length = num_text_pages * MVE_MMU_PAGE_SIZE -
+				      rnd_range(0, MVE_MMU_PAGE_SIZE - 1);
+
+	bss_pages_start = num_text_pages + rnd_range(0, 4);
+	header->bss_start_address = bss_pages_start << MVE_MMU_PAGE_SHIFT;
+	header->bss_bitmap_size = bitmap_size;
+	make_bitmap(header, kind);
+
+	switch (rnd() % 4) {
+	case 0:
+		/* no shared pages */
+		break;
+	case 1:
+		/* all BSS pages shared */
+		header->master_rw_start_address = header->bss_start_address;
+		header->master_rw_size = bitmap_size << MVE_MMU_PAGE_SHIFT;
+		break;
+	default:
+		/* some, possibly unaligned and overlapping the ends */
+		header->master_rw_start_address =
+			header->bss_start_address - MVE_MMU_PAGE_SIZE +
+			rnd_range(0, (bitmap_size + 1) << MVE_MMU_PAGE_SHIFT);
+		header->master_rw_size = rnd_range(0, (bitmap_size / 2 + 1) << MVE_MMU_PAGE_SHIFT);
+		break;
+	}
+
+	fw_size = header->text_length + rnd_range(0, 3 * MVE_MMU_PAGE_SIZE);
+	if (fw_size < sizeof(*header))
+		fw_size = sizeof(*header) + rnd_range(0, 100);
+
+	return fw_size;
+}
+
+/* Physical frames of 'count' buffer pages, in runs of 1 to 9 pages */
+static void make_scattered(uint32_t *pfns, size_t count, uint32_t max_pfn)
+{
+	size_t i = 0;
+
+	while (i < count) {
+		uint32_t run = rnd_range(1, 9);
+		uint32_t pfn = rnd_range(0, max_pfn - run);
+
+		for (; run && i < count; run--)
+			pfns[i++] = pfn++;
+	}
+}
+
+struct stats {
+	unsigned int layouts;
+	unsigned int compared;
+	unsigned int failed;
+};
+
+static void report(const char *what, const struct fw_header *header,
+		   uint32_t ncores, const uint8_t *got, const uint8_t *want,
+		   size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size && got[i] == want[i]; i++)
+		;
+	fprintf(stderr,
+		"%s mismatch: text_length %u bss_start 0x%x bitmap_size %u master_rw 0x%x+0x%x ncores %u\n"
+		"  first difference in entry %zu of table %zu\n",
+		what, header->text_length, header->bss_start_address,
+		header->bss_bitmap_size, header->master_rw_start_address,
+		header->master_rw_size, ncores,
+		(i % MVE_MMU_PAGE_SIZE) / MVE_MMU_PAGE_TABLE_ENTRY_SIZE,
+		i / MVE_MMU_PAGE_SIZE);
+}
+
+static void check_layout(struct fw_header *header, size_t fw_size,
+			 uint32_t ncores, struct stats *stats)
+{
+	struct mve_fw_secure_descriptor desc, old_desc;
+	struct mve_fw_layout layout;
+	struct mve_fw_phys phys;
+	uint8_t *got, *want;
+	uint32_t *pfns;
+	size_t tables_size, num_pages, i;
+	uint32_t base_pfn;
+
+	if (mve_fw_get_layout((uint8_t *)header, fw_size, &layout) != TEE_SUCCESS) {
+		fprintf(stderr, "layout rejected a valid header\n");
+		stats->failed++;
+		return;
+	}
+	stats->layouts++;
+
+	tables_size = mve_fw_tables_size(&layout, ncores, false);
+	num_pages = mve_fw_data_size(&layout, ncores) >> MVE_MMU_PAGE_SHIFT;
+	got = malloc(tables_size);
+	want = malloc(tables_size);
+	pfns = malloc((num_pages + 1) * sizeof(*pfns));
+	if (!got || !want || !pfns) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	/* Contiguous below 4 GiB with a single table: the old builder itself */
+	if (layout.num_l2pages == 1) {
+		base_pfn = rnd_range(0, (1u << 20) - 1 - num_pages);
+		phys.base = (phys_addr_t)base_pfn << MVE_MMU_PAGE_SHIFT;
+		phys.pfns = NULL;
+		memset(got, TABLE_FILL, tables_size);
+		memset(want, TABLE_FILL, tables_size);
+		memset(&desc, 0, sizeof(desc));
+		memset(&old_desc, 0, sizeof(old_desc));
+		fill_l2pages((uint8_t *)header, &phys, &layout, got, ncores, &desc);
+		old_fill_l2pages((uint8_t *)header, (old_phys_addr_t)phys.base,
+				 fw_size, want, ncores, &old_desc);
+		stats->compared++;
+		if (memcmp(got, want, tables_size) ||
+		    memcmp(&desc, &old_desc, sizeof(desc))) {
+			report("old builder", header, ncores, got, want, tables_size);
+			stats->failed++;
+		}
+	}
+
+	/* Contiguous anywhere in the 40-bit space */
+	base_pfn = rnd_range(0, (uint32_t)(MVE_MMU_PADDR_MAX >> MVE_MMU_PAGE_SHIFT) - num_pages);
+	for (i = 0; i < num_pages; i++)
+		pfns[i] = base_pfn + i;
+	phys.base = (phys_addr_t)base_pfn << MVE_MMU_PAGE_SHIFT;
+	phys.pfns = NULL;
+	memset(got, TABLE_FILL, tables_size);
+	memset(want, TABLE_FILL, tables_size);
+	fill_l2pages((uint8_t *)header, &phys, &layout, got, ncores, &desc);
+	ref_fill_l2pages(header, pfns, fw_size, layout.num_l2pages, want, ncores);
+	stats->compared++;
+	if (memcmp(got, want, tables_size)) {
+		report("contiguous", header, ncores, got, want, tables_size);
+		stats->failed++;
+	}
+
+	/* Same pages given one by one */
+	phys.pfns = pfns;
+	memset(got, TABLE_FILL, tables_size);
+	fill_l2pages((uint8_t *)header, &phys, &layout, got, ncores, &desc);
+	stats->compared++;
+	if (memcmp(got, want, tables_size)) {
+		report("page list", header, ncores, got, want, tables_size);
+		stats->failed++;
+	}
+
+	/* Scattered */
+	make_scattered(pfns, num_pages,
+		       (uint32_t)(MVE_MMU_PADDR_MAX >> MVE_MMU_PAGE_SHIFT));
+	memset(got, TABLE_FILL, tables_size);
+	memset(want, TABLE_FILL, tables_size);
+	fill_l2pages((uint8_t *)header, &phys, &layout, got, ncores, &desc);
+	ref_fill_l2pages(header, pfns, fw_size, layout.num_l2pages, want, ncores);
+	stats->compared++;
+	if (memcmp(got, want, tables_size)) {
+		report("scattered", header, ncores, got, want, tables_size);
+		stats->failed++;
+	}
+
+	free(pfns);
+	free(want);
+	free(got);
+	mve_fw_put_layout(&layout);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fw_header header;
+	struct stats stats = { 0, 0, 0 };
+	unsigned int rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+	uint32_t text, bitmap, ncores;
+	unsigned int n;
+	size_t fw_size;
+
+	if (argc > 2)
+		rng_state = strtoull(argv[2], NULL, 0) | 1;
+
+	/* Every short run length around the vector width */
+	for (text = 0; text <= 12; text++)
+		for (bitmap = 0; bitmap <= 12; bitmap++)
+			for (ncores = 1; ncores <= 3; ncores++) {
+				fw_size = make_header(&header, text, bitmap, BITMAP_ONES);
+				check_layout(&header, fw_size, ncores, &stats);
+				fw_size = make_header(&header, text, bitmap, BITMAP_RUNS);
+				check_layout(&header, fw_size, ncores, &stats);
+			}
+
+	for (n = 0; n < rounds; n++) {
+		switch (rnd() % 4) {
+		case 0:
+			text = 0;
+			break;
+		case 1:
+			/* more entries than one L2 table holds */
+			text = rnd_range(MVE_MMU_PAGE_TABLE_ENTRIES - 600,
+					 2 * MVE_MMU_PAGE_TABLE_ENTRIES);
+			break;
+		default:
+			text = rnd_range(1, 200);
+			break;
+		}
+		bitmap = rnd() % 3 ? rnd_range(0, 512) : 512;
+		ncores = rnd_range(1, MVE_MAX_CORES);
+
+		fw_size = make_header(&header, text, bitmap, rnd() % BITMAP_KINDS);
+		check_layout(&header, fw_size, ncores, &stats);
+	}
+
+	printf("%s: %u layouts, %u table sets compared, %u mismatches\n",
+	       BUILDER_PATH, stats.layouts, stats.compared, stats.failed);
+
+	return stats.failed ? 1 : 0;
+}
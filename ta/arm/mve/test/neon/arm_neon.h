@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __TEST_ARM_NEON_H
+#define __TEST_ARM_NEON_H
+
+/*
+ * Lane by lane C versions of the NEON intrinsics mve_fw_mmu.c uses, so that
+ * its NEON path can be built and checked on hosts without NEON. Only used
+ * when the compiler is not targeting ARM, see the Makefile.
+ */
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t val[4];
+} uint32x4_t;
+
+static inline uint32x4_t vdupq_n_u32(uint32_t value)
+{
+	uint32x4_t r = { { value, value, value, value } };
+
+	return r;
+}
+
+static inline uint32x4_t vld1q_u32(const uint32_t *ptr)
+{
+	uint32x4_t r = { { ptr[0], ptr[1], ptr[2], ptr[3] } };
+
+	return r;
+}
+
+static inline void vst1q_u32(uint32_t *ptr, uint32x4_t v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		ptr[i] = v.val[i];
+}
+
+static inline uint32x4_t vmlaq_n_u32(uint32x4_t a, uint32x4_t b, uint32_t c)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		a.val[i] += b.val[i] * c;
+	return a;
+}
+
+static inline uint32x4_t vaddq_u32(uint32x4_t a, uint32x4_t b)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		a.val[i] += b.val[i];
+	return a;
+}
+
+static inline uint32x4_t vandq_u32(uint32x4_t a, uint32x4_t b)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		a.val[i] &= b.val[i];
+	return a;
+}
+
+static inline uint32x4_t vorrq_u32(uint32x4_t a, uint32x4_t b)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		a.val[i] |= b.val[i];
+	return a;
+}
+
+#endif
@@ -6,9 +6,139 @@
 #ifndef __SEDGET_VIDEO_TA_H
 #define __SEDGET_VIDEO_TA_H
 
+#include <stdint.h>
+
 #define SEDGET_VIDEO_TA_UUID { 0x0b7a14e0, 0xb667, 0x4b3d, { \
 		0x84, 0x04, 0xc3, 0xd0,	 0xf8, 0xdc, 0x12, 0x44 } }
 
 #define SEDGET_VIDEO_TA_CMD_LOAD_FW		0
 
+/*
+ * Largest secure firmware buffer LOAD_FW, FINISH_FW and RESCALE_FW take,
+ * others get TEE_ERROR_NOT_SUPPORTED. The TA heap is sized for the page
+ * list of a scattered buffer of that size.
+ */
+#define SEDGET_FW_BUF_MAX_SIZE			(64 * 1024 * 1024)
+
+/*
+ * RESCALE_FW: rebuild the page tables of a firmware loaded by LOAD_FW for
+ *	       another number of cores, without decrypting it again
+ *	[inout] memref[0]	secure firmware buffer given to LOAD_FW
+ *	[out]   memref[1]	fw load descriptor
+ *	[in]    value[2]	a: number of cores
+ * The image keeps the page layout it was loaded with. TEE_ERROR_NOT_SUPPORTED
+ * means that layout came from a package layout section too large to keep,
+ * and the firmware must be loaded again.
+ */
+#define SEDGET_VIDEO_TA_CMD_RESCALE_FW		1
+
+/*
+ * INJECT: copy a batch of access units from a non secure staging buffer
+ *	   into up to two secure buffers
+ *	[in]    memref[0]	non secure staging buffer
+ *	[inout] memref[1]	array of struct sedget_inject_entry
+ *	[out]   memref[2]	secure buffer, entry dst 0
+ *	[out]   memref[3]	secure buffer, entry dst 1, or none
+ * Each entry gets its own result; the command fails only when the
+ * parameters themselves are invalid. Secure buffers overlapping pages
+ * firmware was loaded into are refused with TEE_ERROR_ACCESS_DENIED.
+ */
+#define SEDGET_VIDEO_TA_CMD_INJECT		2
+
+#define SEDGET_INJECT_MAX_DST			2
+
+struct sedget_inject_entry {
+	uint32_t src_offset;	/* in the staging buffer */
+	uint32_t dst;		/* secure buffer, 0 to SEDGET_INJECT_MAX_DST - 1 */
+	uint32_t dst_offset;	/* in the secure buffer */
+	uint32_t len;
+	uint32_t result;	/* [out] TEE_Result of this entry */
+};
+
+/*
+ * SCRUB: zero ranges of up to three secure buffers
+ *	[inout] memref[0]	array of struct sedget_scrub_entry
+ *	[out]   memref[1]	secure buffer, entry buf 0
+ *	[out]   memref[2]	secure buffer, entry buf 1, or none
+ *	[out]   memref[3]	secure buffer, entry buf 2, or none
+ * Each entry gets its own result; the command fails only when the
+ * parameters themselves are invalid. Entries of buffers firmware was loaded
+ * into get TEE_ERROR_ACCESS_DENIED, see RELEASE_FW.
+ */
+#define SEDGET_VIDEO_TA_CMD_SCRUB		3
+
+#define SEDGET_SCRUB_MAX_BUF			3
+
+struct sedget_scrub_entry {
+	uint32_t buf;		/* secure buffer, 0 to SEDGET_SCRUB_MAX_BUF - 1 */
+	uint32_t offset;	/* in the secure buffer */
+	uint32_t len;
+	uint32_t result;	/* [out] TEE_Result of this entry */
+};
+
+/*
+ * FINISH_FW: complete the load of a segmented firmware package whose image
+ *	      was decrypted in place by worker TA sessions: verify it and
+ *	      build the page tables. Parameters are those of LOAD_FW. The
+ *	      image is verified from a private copy that is then written
+ *	      back, so what is kept is what was verified.
+ */
+#define SEDGET_VIDEO_TA_CMD_FINISH_FW		4
+
+/*
+ * RELEASE_FW: wipe a firmware buffer about to be freed, so that its pages
+ *	       are no longer refused as firmware pages
+ *	[inout] memref[0]	secure firmware buffer given to LOAD_FW
+ * TEE_ERROR_ITEM_NOT_FOUND means the buffer holds no firmware, e.g. its
+ * load failed. The MVE must not run the firmware anymore.
+ */
+#define SEDGET_VIDEO_TA_CMD_RELEASE_FW		5
+
+/*
+ * Commands of worker TA sessions only, other clients get
+ * TEE_ERROR_ACCESS_DENIED.
+ *
+ * CLAIM: claim the pages of a secure buffer the worker is about to write,
+ *	  replacing the session's last claim. TEE_ERROR_ACCESS_DENIED means
+ *	  some of them hold firmware. LOAD_FW and FINISH_FW refuse claimed
+ *	  pages with TEE_ERROR_BUSY.
+ *	[in]  memref[0]	secure buffer
+ *
+ * UNCLAIM: drop the session's claim, as closing the session does.
+ */
+#define SEDGET_VIDEO_TA_CMD_CLAIM		6
+#define SEDGET_VIDEO_TA_CMD_UNCLAIM		7
+
+/*
+ * Worker TA decrypting segments of segmented firmware packages. Each
+ * session is a TA instance of its own, so sessions run in parallel.
+ */
+#define SEDGET_WORKER_TA_UUID { 0x5d3c8e1a, 0x2f47, 0x4c09, { \
+		0x9b, 0x61, 0x7e, 0x0a, 0xd4, 0x35, 0xc2, 0x8f } }
+
+/*
+ * DECRYPT: decrypt segments of a segmented package to their place in the
+ *	    image at the start of the secure firmware buffer. The result is
+ *	    only trusted once FINISH_FW verified it. The pages written are
+ *	    claimed from the main TA meanwhile; TEE_ERROR_ACCESS_DENIED
+ *	    means some of them hold firmware.
+ *	[in]  memref[0]	encrypted firmware
+ *	[out] memref[1]	secure firmware buffer
+ *	[in]  value[2]	a: first segment, b: number of segments
+ */
+#define SEDGET_WORKER_TA_CMD_DECRYPT		0
+
+/*
+ * Micro benchmark commands, only built with CFG_SEDGET_BENCH=y
+ *
+ * BENCH_ZERO: time zeroing of a firmware buffer, whole buffer versus
+ *	       regions left unwritten by decryption, cache maintenance of the
+ *	       zeroed bytes included in both
+ *	[in]  memref[0]	encrypted firmware
+ *	[out] memref[1]	secure firmware buffer, wiped on return
+ *	[in]  value[2]	a: number of cores, b: iterations
+ *	[out] value[3]	a: whole buffer ms, b: regions only ms
+ */
+#define SEDGET_VIDEO_TA_CMD_BENCH_ZERO		0x8000
+
 #endif /* __SEDGET_VIDEO_TA_H */
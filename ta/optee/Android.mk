@@ -3,3 +3,6 @@ LOCAL_PATH := $(call my-dir)
 local_module := 0b7a14e0-b667-4b3d-8404-c3d0f8dc1244.ta
 
 include $(BUILD_OPTEE_MK)
+
+# worker Trusted Application
+include $(call all-makefiles-under,$(LOCAL_PATH))
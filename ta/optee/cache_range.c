@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <tee_api.h>
+#include <tee_internal_api_extensions.h>
+#include <trace.h>
+
+#include "cache_range.h"
+
+static uint8_t *range_end(const struct cache_range_set *set, size_t i)
+{
+	return set->r[i].va + set->r[i].len;
+}
+
+/* Distance between range i and [va, end); 0 if they touch or overlap */
+static size_t range_gap(const struct cache_range_set *set, size_t i,
+			uint8_t *va, uint8_t *end)
+{
+	if (end < set->r[i].va)
+		return set->r[i].va - end;
+	if (va > range_end(set, i))
+		return va - range_end(set, i);
+	return 0;
+}
+
+static void merge_range(struct cache_range_set *set, size_t i,
+			uint8_t *va, uint8_t *end)
+{
+	if (range_gap(set, i, va, end))
+		set->r[i].bridged = true;
+	if (end < range_end(set, i))
+		end = range_end(set, i);
+	if (va > set->r[i].va)
+		va = set->r[i].va;
+
+	set->r[i].va = va;
+	set->r[i].len = end - va;
+}
+
+void cache_range_init(struct cache_range_set *set)
+{
+	set->count = 0;
+}
+
+void cache_range_add(struct cache_range_set *set, void *va, size_t len)
+{
+	uint8_t *start = va;
+	uint8_t *end = start + len;
+	size_t i, best = 0, best_gap = SIZE_MAX;
+
+	if (!len)
+		return;
+
+	for (i = 0; i < set->count; i++) {
+		size_t gap = range_gap(set, i, start, end);
+
+		if (gap < best_gap) {
+			best = i;
+			best_gap = gap;
+		}
+	}
+
+	if (best_gap && set->count < CACHE_RANGE_MAX) {
+		set->r[set->count].va = start;
+		set->r[set->count].len = len;
+		set->r[set->count].bridged = false;
+		set->count++;
+		return;
+	}
+
+	merge_range(set, best, start, end);
+
+	/* the grown range may now touch others */
+	for (i = 0; i < set->count; i++) {
+		if (i == best || range_gap(set, i, set->r[best].va,
+					   range_end(set, best)))
+			continue;
+		merge_range(set, best, set->r[i].va, range_end(set, i));
+		set->r[best].bridged |= set->r[i].bridged;
+		set->r[i] = set->r[--set->count];
+		if (best == set->count)
+			best = i;
+		i = (size_t)-1;
+	}
+}
+
+TEE_Result cache_range_flush(const struct cache_range_set *set)
+{
+#ifdef CFG_CACHE_API
+	TEE_Result rc;
+	size_t i;
+
+	for (i = 0; i < set->count; i++) {
+		rc = TEE_CacheFlush((char *)set->r[i].va, set->r[i].len);
+		if (rc != TEE_SUCCESS) {
+			EMSG("TEE_CacheFlush(%p, %zx) failed: 0x%x\n",
+			     set->r[i].va, set->r[i].len, rc);
+			return rc;
+		}
+	}
+#else
+	(void)set;
+#endif /* CFG_CACHE_API */
+	return TEE_SUCCESS;
+}
+
+TEE_Result cache_range_invalidate(const struct cache_range_set *set)
+{
+#ifdef CFG_CACHE_API
+	TEE_Result rc;
+	size_t i;
+
+	for (i = 0; i < set->count; i++) {
+		/* never discard what was written between merged ranges */
+		if (set->r[i].bridged)
+			rc = TEE_CacheFlush((char *)set->r[i].va,
+					    set->r[i].len);
+		else
+			rc = TEE_CacheInvalidate((char *)set->r[i].va,
+						 set->r[i].len);
+		if (rc != TEE_SUCCESS) {
+			EMSG("TEE_CacheInvalidate(%p, %zx) failed: 0x%x\n",
+			     set->r[i].va, set->r[i].len, rc);
+			return rc;
+		}
+	}
+#else
+	(void)set;
+#endif /* CFG_CACHE_API */
+	return TEE_SUCCESS;
+}
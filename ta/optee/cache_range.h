@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __CACHE_RANGE_H
+#define __CACHE_RANGE_H
+
+#include <tee_api.h>
+
+#define CACHE_RANGE_MAX		8
+
+/*
+ * Set of byte ranges a command wrote, so cache maintenance can be limited
+ * to them instead of whole buffers. Overlapping or adjacent ranges are
+ * merged; once the set is full a new range is merged into the closest one,
+ * which then also covers the bytes between them.
+ */
+struct cache_range_set {
+	size_t count;
+	struct {
+		uint8_t *va;
+		size_t len;
+		bool bridged;	/* covers bytes no range was added for */
+	} r[CACHE_RANGE_MAX];
+};
+
+void cache_range_init(struct cache_range_set *set);
+
+void cache_range_add(struct cache_range_set *set, void *va, size_t len);
+
+/* Clean and invalidate every range of the set */
+TEE_Result cache_range_flush(const struct cache_range_set *set);
+
+/*
+ * Invalidate every range of the set. Ranges that bridged a gap are cleaned
+ * too, so dirty lines of the bytes in between are written back rather than
+ * discarded.
+ */
+TEE_Result cache_range_invalidate(const struct cache_range_set *set);
+
+#endif /* __CACHE_RANGE_H */
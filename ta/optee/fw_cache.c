@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <string.h>
+#include <sys/queue.h>
+#include <tee_api.h>
+#include <trace.h>
+
+#include "fw_cache.h"
+
+struct fw_cache_entry {
+	TAILQ_ENTRY(fw_cache_entry) link;
+	uint8_t pkg_digest[FW_DIGEST_LEN];
+	uint8_t image_digest[FW_DIGEST_LEN];
+	uint32_t len;
+	uint8_t *image;
+	struct fw_pkg_layout layout;
+};
+
+/* Most recently used first */
+static TAILQ_HEAD(fw_cache_head, fw_cache_entry) fw_cache =
+	TAILQ_HEAD_INITIALIZER(fw_cache);
+static size_t fw_cache_used;
+
+static struct fw_cache_entry *find_entry(const uint8_t *pkg_digest)
+{
+	struct fw_cache_entry *e;
+
+	TAILQ_FOREACH(e, &fw_cache, link)
+		if (!TEE_MemCompare(e->pkg_digest, pkg_digest, FW_DIGEST_LEN))
+			return e;
+
+	return NULL;
+}
+
+static void drop_entry(struct fw_cache_entry *e)
+{
+	TAILQ_REMOVE(&fw_cache, e, link);
+	fw_cache_used -= e->len + e->layout.len;
+	TEE_MemFill(e->image, 0, e->len);
+	TEE_Free(e->image);
+	fw_pkg_layout_put(&e->layout);
+	TEE_Free(e);
+}
+
+TEE_Result fw_cache_get(const uint8_t *pkg_digest, void *dst, uint32_t *len,
+			uint8_t *image_digest, struct fw_pkg_layout *layout)
+{
+	struct fw_cache_entry *e = find_entry(pkg_digest);
+
+	layout->data = NULL;
+	layout->len = 0;
+
+	if (!e)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	if (e->len > *len)
+		return TEE_ERROR_SHORT_BUFFER;
+
+	if (e->layout.data) {
+		layout->data = TEE_Malloc(e->layout.len, TEE_MALLOC_FILL_ZERO);
+		if (!layout->data)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		TEE_MemMove(layout->data, e->layout.data, e->layout.len);
+		layout->len = e->layout.len;
+	}
+
+	TEE_MemMove(dst, e->image, e->len);
+	TEE_MemMove(image_digest, e->image_digest, FW_DIGEST_LEN);
+	*len = e->len;
+
+	TAILQ_REMOVE(&fw_cache, e, link);
+	TAILQ_INSERT_HEAD(&fw_cache, e, link);
+	return TEE_SUCCESS;
+}
+
+void fw_cache_put(const uint8_t *pkg_digest, const void *image, uint32_t len,
+		  const uint8_t *image_digest,
+		  const struct fw_pkg_layout *layout)
+{
+	struct fw_cache_entry *e;
+	size_t size = (size_t)len + layout->len;
+
+	if (size > CFG_SEDGET_FW_CACHE_SIZE || find_entry(pkg_digest))
+		return;
+
+	while (fw_cache_used + size > CFG_SEDGET_FW_CACHE_SIZE)
+		drop_entry(TAILQ_LAST(&fw_cache, fw_cache_head));
+
+	e = TEE_Malloc(sizeof(*e), TEE_MALLOC_FILL_ZERO);
+	if (!e)
+		return;
+	e->image = TEE_Malloc(len, TEE_MALLOC_FILL_ZERO);
+	if (!e->image) {
+		DMSG("No memory to cache a %u bytes firmware image", len);
+		TEE_Free(e);
+		return;
+	}
+	if (layout->data) {
+		e->layout.data = TEE_Malloc(layout->len, TEE_MALLOC_FILL_ZERO);
+		if (!e->layout.data) {
+			TEE_Free(e->image);
+			TEE_Free(e);
+			return;
+		}
+		TEE_MemMove(e->layout.data, layout->data, layout->len);
+		e->layout.len = layout->len;
+	}
+
+	TEE_MemMove(e->pkg_digest, pkg_digest, FW_DIGEST_LEN);
+	TEE_MemMove(e->image_digest, image_digest, FW_DIGEST_LEN);
+	TEE_MemMove(e->image, image, len);
+	e->len = len;
+	fw_cache_used += size;
+	TAILQ_INSERT_HEAD(&fw_cache, e, link);
+}
+
+void fw_cache_release(void)
+{
+	while (!TAILQ_EMPTY(&fw_cache))
+		drop_entry(TAILQ_FIRST(&fw_cache));
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __FW_CACHE_H
+#define __FW_CACHE_H
+
+#include <stdbool.h>
+#include <tee_api.h>
+
+#include "fw_crypto.h"
+
+/*
+ * Budget in bytes of decrypted images kept in the TA heap, 0 disables the
+ * cache. TA_DATA_SIZE grows accordingly.
+ */
+#ifndef CFG_SEDGET_FW_CACHE_SIZE
+#define CFG_SEDGET_FW_CACHE_SIZE	0
+#endif
+
+/*
+ * Verified decrypted firmware images, keyed by the SHA-256 of the package
+ * they were decrypted from, so that loading the same package again skips
+ * decryption and verification. The least recently used images are evicted
+ * to stay within CFG_SEDGET_FW_CACHE_SIZE. Entries live as long as the TA
+ * instance.
+ */
+static inline bool fw_cache_enabled(void)
+{
+	return CFG_SEDGET_FW_CACHE_SIZE > 0;
+}
+
+/*
+ * Copy the image decrypted from the package of digest 'pkg_digest' to
+ * 'dst', which has room for '*len' bytes, and return its length in '*len',
+ * its digest in 'image_digest' and a copy of the package layout section in
+ * 'layout'. TEE_ERROR_ITEM_NOT_FOUND on a miss.
+ */
+TEE_Result fw_cache_get(const uint8_t *pkg_digest, void *dst, uint32_t *len,
+			uint8_t *image_digest, struct fw_pkg_layout *layout);
+
+/*
+ * Keep a copy of a verified image and of the layout section of its
+ * package. Images larger than the budget, or for which memory runs out,
+ * are silently not cached.
+ */
+void fw_cache_put(const uint8_t *pkg_digest, const void *image, uint32_t len,
+		  const uint8_t *image_digest,
+		  const struct fw_pkg_layout *layout);
+
+/* Wipe and free every cached image */
+void fw_cache_release(void);
+
+#endif /* __FW_CACHE_H */
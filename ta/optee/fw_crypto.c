@@ -0,0 +1,610 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <string.h>
+#include <tee_api.h>
+#include <trace.h>
+
+#include "mve_fw_package.h"
+#include "fw_crypto.h"
+#include "fw_keys.h"
+#include "fw_segments.h"
+
+#define FIRMWARE_SIGNATURE_LEN		32
+#define AES_BLOCK_SIZE			16
+
+#define MIN(a, b)			((a) < (b) ? (a) : (b))
+
+/*
+ * Operations kept for the lifetime of the TA instance, keys already set.
+ * The TA is single instance and OP-TEE serializes its entry points, so no
+ * two commands ever use them at the same time. Each user resets the
+ * operation it takes since a failed command may leave it mid-way.
+ */
+static struct {
+	TEE_OperationHandle ecb;	/* legacy package cipher */
+	TEE_OperationHandle gcm;	/* headed package cipher */
+	TEE_OperationHandle ctr;	/* segmented package cipher */
+	TEE_OperationHandle header_mac;	/* segmented package header */
+	TEE_OperationHandle segment_mac;	/* segmented package segments */
+	TEE_OperationHandle sha1;	/* legacy package signature */
+	TEE_OperationHandle sha256;	/* image digests */
+	TEE_OperationHandle package_sha256;	/* package digests */
+	TEE_OperationHandle record_mac;	/* HMAC under the record key */
+} fw_ops;
+
+/*
+ * Reads of the non secure package. When its digest is wanted, each piece
+ * is first copied to secure memory and hashed there, so that the digest
+ * covers exactly the bytes that were decrypted and verified. Pieces must
+ * be read in order, each byte once, at most FW_CRYPTO_CHUNK_SIZE at a time.
+ */
+struct pkg_reader {
+	const uint8_t *src;
+	uint8_t *bounce;
+	TEE_OperationHandle digest;
+};
+
+static const uint8_t *pkg_read(struct pkg_reader *r, size_t off, size_t len)
+{
+	if (!r->bounce)
+		return r->src + off;
+
+	TEE_MemMove(r->bounce, r->src + off, len);
+	TEE_DigestUpdate(r->digest, r->bounce, len);
+	return r->bounce;
+}
+
+/*
+ * Hand out a secure copy of the layout section of an authenticated header,
+ * which starts at 'off' once the sections of the cipher are skipped.
+ */
+static TEE_Result get_layout_section(const uint8_t *header, size_t off,
+				     struct fw_pkg_layout *layout)
+{
+	const struct mve_fw_pkg_header *hdr = (const void *)header;
+
+	if (!layout || !(hdr->flags & MVE_FW_PKG_FLAG_LAYOUT))
+		return TEE_SUCCESS;
+
+	if (hdr->header_size < off + sizeof(struct mve_fw_pkg_layout)) {
+		EMSG("Truncated firmware layout");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+
+	layout->len = hdr->header_size - off;
+	layout->data = TEE_Malloc(layout->len, TEE_MALLOC_FILL_ZERO);
+	if (!layout->data)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	TEE_MemMove(layout->data, header + off, layout->len);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Legacy package: AES-ECB encrypted image whose last FIRMWARE_SIGNATURE_LEN
+ * bytes hold the SHA1 of the preceding plain text. Each decrypted chunk is
+ * fed to the digest right away instead of hashing the whole image again.
+ */
+static TEE_Result decrypt_legacy_firmware(struct pkg_reader *src,
+					  size_t srclen,
+					  uint8_t *dst, uint32_t *dstlen,
+					  TEE_OperationHandle image_digest)
+{
+	TEE_Result res;
+	TEE_OperationHandle cipher = fw_ops.ecb;
+	TEE_OperationHandle digest = fw_ops.sha1;
+	uint8_t hash[FIRMWARE_SIGNATURE_LEN];
+	uint32_t hashlen = sizeof(hash);
+	size_t signed_len, off, done = 0;
+	uint32_t outlen;
+
+	if (srclen <= FIRMWARE_SIGNATURE_LEN || srclen % AES_BLOCK_SIZE)
+		return TEE_ERROR_BAD_FORMAT;
+	if (*dstlen < srclen)
+		return TEE_ERROR_SHORT_BUFFER;
+
+	signed_len = srclen - FIRMWARE_SIGNATURE_LEN;
+
+	TEE_ResetOperation(digest);
+	TEE_CipherInit(cipher, NULL, 0);
+	for (off = 0; off < srclen; off += FW_CRYPTO_CHUNK_SIZE) {
+		size_t prev = done;
+		size_t n = MIN(FW_CRYPTO_CHUNK_SIZE, srclen - off);
+
+		outlen = *dstlen - done;
+		res = TEE_CipherUpdate(cipher, pkg_read(src, off, n), n,
+				       dst + done, &outlen);
+		if (res != TEE_SUCCESS) {
+			EMSG("Can not do AES %x", res);
+			goto out;
+		}
+		done += outlen;
+
+		if (prev < signed_len)
+			TEE_DigestUpdate(digest, dst + prev,
+					 MIN(done, signed_len) - prev);
+		if (image_digest)
+			TEE_DigestUpdate(image_digest, dst + prev, outlen);
+	}
+
+	outlen = *dstlen - done;
+	res = TEE_CipherDoFinal(cipher, NULL, 0, dst + done, &outlen);
+	if (res != TEE_SUCCESS) {
+		EMSG("Can not do AES %x", res);
+		goto out;
+	}
+	/* whole blocks in, whole blocks out: nothing is left to flush */
+	done += outlen;
+	if (done != srclen) {
+		res = TEE_ERROR_BAD_FORMAT;
+		goto out;
+	}
+
+	res = TEE_DigestDoFinal(digest, NULL, 0, hash, &hashlen);
+	if (res != TEE_SUCCESS) {
+		EMSG("Digest failed!");
+		goto out;
+	}
+
+	if (TEE_MemCompare(dst + signed_len, hash, hashlen) != 0) {
+		EMSG("Verify firmware hash failed!");
+		res = TEE_ERROR_CORRUPT_OBJECT;
+		goto out;
+	}
+
+	*dstlen = done;
+out:
+	if (res != TEE_SUCCESS)
+		TEE_MemFill(dst, 0, done);
+	return res;
+}
+
+/*
+ * AES-GCM package: the header is the AAD and the tag follows the payload,
+ * so verification completes with the last decrypted chunk. The AAD is a
+ * secure copy of the header, from which the layout section is taken.
+ */
+static TEE_Result decrypt_gcm_firmware(const struct mve_fw_pkg_header *hdr,
+				       struct pkg_reader *src, size_t srclen,
+				       uint8_t *dst, uint32_t *dstlen,
+				       TEE_OperationHandle image_digest,
+				       struct fw_pkg_layout *layout)
+{
+	TEE_Result res;
+	TEE_OperationHandle op = fw_ops.gcm;
+	const size_t payload = hdr->header_size;
+	uint8_t tag[MVE_FW_PKG_GCM_TAG_LEN];
+	uint8_t *header;
+	size_t off, n, done = 0;
+	uint32_t outlen;
+
+	if (srclen != (size_t)hdr->header_size + hdr->payload_size +
+		      MVE_FW_PKG_GCM_TAG_LEN)
+		return TEE_ERROR_BAD_FORMAT;
+	if (*dstlen < hdr->payload_size)
+		return TEE_ERROR_SHORT_BUFFER;
+
+	header = TEE_Malloc(hdr->header_size, TEE_MALLOC_FILL_ZERO);
+	if (!header)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	TEE_MemMove(header, src->src, hdr->header_size);
+	/* the fields used below must be those authenticated */
+	if (TEE_MemCompare(header, hdr, sizeof(*hdr))) {
+		EMSG("Firmware package header changed while read");
+		res = TEE_ERROR_SECURITY;
+		goto out;
+	}
+	if (src->bounce)
+		TEE_DigestUpdate(src->digest, header, hdr->header_size);
+
+	TEE_ResetOperation(op);
+	res = TEE_AEInit(op, hdr->iv, MVE_FW_PKG_GCM_IV_LEN,
+			 MVE_FW_PKG_GCM_TAG_LEN * 8, hdr->header_size,
+			 hdr->payload_size);
+	if (res != TEE_SUCCESS) {
+		EMSG("AE init failed %x", res);
+		goto out;
+	}
+	TEE_AEUpdateAAD(op, header, hdr->header_size);
+
+	for (off = 0; off < hdr->payload_size; off += n) {
+		n = MIN(FW_CRYPTO_CHUNK_SIZE, hdr->payload_size - off);
+		outlen = *dstlen - done;
+		res = TEE_AEUpdate(op, pkg_read(src, payload + off, n), n,
+				   dst + done, &outlen);
+		if (res != TEE_SUCCESS) {
+			EMSG("Can not do AES-GCM %x", res);
+			goto out;
+		}
+		if (image_digest)
+			TEE_DigestUpdate(image_digest, dst + done, outlen);
+		done += outlen;
+	}
+
+	/* non secure memory: work on a private copy of the tag */
+	TEE_MemMove(tag, pkg_read(src, payload + hdr->payload_size,
+				  sizeof(tag)), sizeof(tag));
+	outlen = *dstlen - done;
+	res = TEE_AEDecryptFinal(op, NULL, 0, dst + done, &outlen, tag,
+				 sizeof(tag));
+	if (res != TEE_SUCCESS) {
+		EMSG("Verify firmware tag failed! %x", res);
+		goto out;
+	}
+	if (image_digest)
+		TEE_DigestUpdate(image_digest, dst + done, outlen);
+	done += outlen;
+
+	res = get_layout_section(header, sizeof(*hdr), layout);
+	if (res == TEE_SUCCESS)
+		*dstlen = done;
+out:
+	if (res != TEE_SUCCESS)
+		TEE_MemFill(dst, 0, done);
+	TEE_Free(header);
+	return res;
+}
+
+/*
+ * AES-CTR package: the header HMAC is checked before anything is
+ * decrypted, and each segment against its HMAC as soon as it is.
+ */
+static TEE_Result decrypt_ctr_firmware(struct pkg_reader *src, size_t srclen,
+				       uint8_t *dst, uint32_t *dstlen,
+				       TEE_OperationHandle image_digest,
+				       struct fw_pkg_layout *layout)
+{
+	TEE_Result res;
+	TEE_OperationHandle mac = fw_ops.segment_mac;
+	struct fw_seg_header h;
+	size_t off, n, end, done = 0;
+	uint32_t i;
+
+	res = fw_seg_header_get(src->src, srclen, fw_ops.header_mac, &h);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (*dstlen < h.hdr->payload_size) {
+		res = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
+
+	/* the header was read to secure memory already */
+	if (src->bounce)
+		TEE_DigestUpdate(src->digest, h.bytes, h.hdr->header_size);
+
+	fw_seg_cipher_init(&h, fw_ops.ctr, 0);
+	for (i = 0; i < h.segs->num_segments; i++) {
+		end = fw_seg_offset(&h, i) + fw_seg_size(&h, i);
+
+		TEE_MACInit(mac, NULL, 0);
+		for (off = done; off < end; off += n) {
+			n = MIN(FW_CRYPTO_CHUNK_SIZE, end - off);
+			res = fw_seg_cipher_update(fw_ops.ctr,
+						   pkg_read(src, h.hdr->header_size + off, n),
+						   n, dst + off,
+						   off + n == h.hdr->payload_size);
+			if (res != TEE_SUCCESS)
+				goto out;
+			done = off + n;
+
+			TEE_MACUpdate(mac, dst + off, n);
+			if (image_digest)
+				TEE_DigestUpdate(image_digest, dst + off, n);
+		}
+
+		res = TEE_MACCompareFinal(mac, NULL, 0, h.segs->mac[i],
+					  MVE_FW_PKG_MAC_LEN);
+		if (res != TEE_SUCCESS) {
+			EMSG("Verify firmware segment %u failed! %x", i, res);
+			goto out;
+		}
+	}
+
+	if (src->bounce)
+		TEE_DigestUpdate(src->digest, h.mac, sizeof(h.mac));
+
+	res = get_layout_section(h.bytes, fw_seg_header_end(&h), layout);
+	if (res == TEE_SUCCESS)
+		*dstlen = done;
+out:
+	if (res != TEE_SUCCESS)
+		TEE_MemFill(dst, 0, done);
+	fw_seg_header_put(&h);
+	return res;
+}
+
+static TEE_Result decrypt_package(struct pkg_reader *src, size_t srclen,
+				  void *destdata, uint32_t *destlen,
+				  TEE_OperationHandle image_digest,
+				  struct fw_pkg_layout *layout)
+{
+	struct mve_fw_pkg_header hdr;
+
+	if (srclen < sizeof(hdr))
+		return decrypt_legacy_firmware(src, srclen, destdata,
+					       destlen, image_digest);
+
+	/* non secure memory: work on a private copy of the header */
+	TEE_MemMove(&hdr, src->src, sizeof(hdr));
+	if (hdr.magic != MVE_FW_PKG_MAGIC)
+		return decrypt_legacy_firmware(src, srclen, destdata,
+					       destlen, image_digest);
+
+	if (hdr.version != MVE_FW_PKG_VERSION ||
+	    hdr.header_size < sizeof(hdr) || hdr.header_size > srclen) {
+		EMSG("Unsupported firmware package v%u", hdr.version);
+		return TEE_ERROR_BAD_FORMAT;
+	}
+
+	switch (hdr.cipher) {
+	case MVE_FW_PKG_CIPHER_AES_GCM:
+		return decrypt_gcm_firmware(&hdr, src, srclen, destdata,
+					    destlen, image_digest, layout);
+	case MVE_FW_PKG_CIPHER_AES_CTR:
+		return decrypt_ctr_firmware(src, srclen, destdata, destlen,
+					    image_digest, layout);
+	default:
+		EMSG("Unsupported firmware cipher %u", hdr.cipher);
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+}
+
+TEE_Result fw_decrypt_image(const void *srcdata, size_t srclen,
+			    void *destdata, uint32_t *destlen,
+			    uint8_t *image_digest, uint8_t *package_digest,
+			    struct fw_pkg_layout *layout)
+{
+	struct pkg_reader src = { .src = srcdata };
+	TEE_OperationHandle op = TEE_HANDLE_NULL;
+	uint32_t digestlen = FW_DIGEST_LEN;
+	TEE_Result res;
+
+	if (layout) {
+		layout->data = NULL;
+		layout->len = 0;
+	}
+
+	if (image_digest) {
+		op = fw_ops.sha256;
+		TEE_ResetOperation(op);
+	}
+
+	if (package_digest) {
+		src.bounce = TEE_Malloc(FW_CRYPTO_CHUNK_SIZE,
+					TEE_MALLOC_FILL_ZERO);
+		if (!src.bounce)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		src.digest = fw_ops.package_sha256;
+		TEE_ResetOperation(src.digest);
+	}
+
+	res = decrypt_package(&src, srclen, destdata, destlen, op, layout);
+	if (res == TEE_SUCCESS && image_digest)
+		res = TEE_DigestDoFinal(op, NULL, 0, image_digest, &digestlen);
+
+	digestlen = FW_DIGEST_LEN;
+	if (res == TEE_SUCCESS && package_digest)
+		res = TEE_DigestDoFinal(src.digest, NULL, 0, package_digest,
+					&digestlen);
+
+	if (res != TEE_SUCCESS && layout)
+		fw_pkg_layout_put(layout);
+	TEE_Free(src.bounce);
+	return res;
+}
+
+/*
+ * HMAC of a segment of an image decrypted outside of the TA, taken on a
+ * private copy made FW_CRYPTO_CHUNK_SIZE at a time. Each chunk is written
+ * back once hashed, so the image ends up holding exactly the bytes
+ * verified whatever else writes it meanwhile.
+ */
+static TEE_Result verify_segment(TEE_OperationHandle mac, uint8_t *seg,
+				 size_t len, const uint8_t *expected,
+				 uint8_t *bounce)
+{
+	size_t off, n;
+
+	TEE_MACInit(mac, NULL, 0);
+	for (off = 0; off < len; off += n) {
+		n = MIN(FW_CRYPTO_CHUNK_SIZE, len - off);
+		TEE_MemMove(bounce, seg + off, n);
+		TEE_MACUpdate(mac, bounce, n);
+		TEE_MemMove(seg + off, bounce, n);
+	}
+	return TEE_MACCompareFinal(mac, NULL, 0, expected, MVE_FW_PKG_MAC_LEN);
+}
+
+TEE_Result fw_verify_image(const void *package, size_t package_len,
+			   void *image, uint32_t *len,
+			   uint8_t *image_digest, uint32_t *seg_size,
+			   struct fw_pkg_layout *layout)
+{
+	TEE_OperationHandle mac = fw_ops.segment_mac;
+	TEE_OperationHandle digest = fw_ops.sha256;
+	uint8_t *dst = image;
+	uint32_t digestlen = FW_DIGEST_LEN;
+	struct fw_seg_header h;
+	uint8_t *bounce;
+	TEE_Result res;
+	uint32_t i;
+
+	layout->data = NULL;
+	layout->len = 0;
+
+	res = fw_seg_header_get(package, package_len, fw_ops.header_mac, &h);
+	if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+		EMSG("Only segmented packages can be decrypted by workers");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (*len < h.hdr->payload_size) {
+		res = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
+
+	bounce = TEE_Malloc(FW_CRYPTO_CHUNK_SIZE, TEE_MALLOC_FILL_ZERO);
+	if (!bounce) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	/* a matching HMAC stands for its segment in the image digest */
+	TEE_ResetOperation(digest);
+	for (i = 0; i < h.segs->num_segments; i++) {
+		res = verify_segment(mac, dst + fw_seg_offset(&h, i),
+				     fw_seg_size(&h, i), h.segs->mac[i],
+				     bounce);
+		if (res != TEE_SUCCESS) {
+			EMSG("Verify firmware segment %u failed! %x", i, res);
+			break;
+		}
+		TEE_DigestUpdate(digest, h.segs->mac[i], MVE_FW_PKG_MAC_LEN);
+	}
+	TEE_MemFill(bounce, 0x0, FW_CRYPTO_CHUNK_SIZE);
+	TEE_Free(bounce);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = TEE_DigestDoFinal(digest, NULL, 0, image_digest, &digestlen);
+	if (res == TEE_SUCCESS)
+		res = get_layout_section(h.bytes, fw_seg_header_end(&h), layout);
+	if (res == TEE_SUCCESS) {
+		*len = h.hdr->payload_size;
+		*seg_size = h.segs->segment_size;
+	}
+out:
+	fw_seg_header_put(&h);
+	return res;
+}
+
+void fw_pkg_layout_put(struct fw_pkg_layout *layout)
+{
+	TEE_Free(layout->data);
+	layout->data = NULL;
+	layout->len = 0;
+}
+
+TEE_Result fw_package_digest(const void *package, size_t len, uint8_t *digest)
+{
+	uint32_t digestlen = FW_DIGEST_LEN;
+
+	TEE_ResetOperation(fw_ops.package_sha256);
+	return TEE_DigestDoFinal(fw_ops.package_sha256, package, len, digest,
+				 &digestlen);
+}
+
+TEE_Result fw_image_digest(const void *image, size_t len, uint8_t *digest)
+{
+	uint32_t digestlen = FW_DIGEST_LEN;
+
+	TEE_ResetOperation(fw_ops.sha256);
+	return TEE_DigestDoFinal(fw_ops.sha256, image, len, digest,
+				 &digestlen);
+}
+
+TEE_Result fw_image_seg_digest(const void *image, size_t len,
+			       uint32_t seg_size, uint8_t *digest)
+{
+	uint8_t mac[MVE_FW_PKG_MAC_LEN];
+	uint32_t maclen, digestlen = FW_DIGEST_LEN;
+	const uint8_t *src = image;
+	size_t off, n;
+	TEE_Result res;
+
+	TEE_ResetOperation(fw_ops.sha256);
+	for (off = 0; off < len; off += n) {
+		n = MIN(seg_size, len - off);
+		maclen = sizeof(mac);
+		TEE_MACInit(fw_ops.segment_mac, NULL, 0);
+		res = TEE_MACComputeFinal(fw_ops.segment_mac, src + off, n, mac,
+					  &maclen);
+		if (res != TEE_SUCCESS)
+			return res;
+		TEE_DigestUpdate(fw_ops.sha256, mac, maclen);
+	}
+
+	return TEE_DigestDoFinal(fw_ops.sha256, NULL, 0, digest, &digestlen);
+}
+
+TEE_Result fw_record_mac(const void *data, size_t len, uint8_t *mac)
+{
+	uint32_t maclen = FW_DIGEST_LEN;
+
+	TEE_MACInit(fw_ops.record_mac, NULL, 0);
+	return TEE_MACComputeFinal(fw_ops.record_mac, data, len, mac, &maclen);
+}
+
+TEE_Result fw_crypto_init(void)
+{
+	TEE_Result res;
+
+	res = fw_keys_alloc_aes(&fw_ops.ecb, TEE_ALG_AES_ECB_NOPAD,
+				TEE_MODE_DECRYPT);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = fw_keys_alloc_aes(&fw_ops.gcm, TEE_ALG_AES_GCM, TEE_MODE_DECRYPT);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = fw_keys_alloc_aes(&fw_ops.ctr, TEE_ALG_AES_CTR, TEE_MODE_DECRYPT);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = fw_keys_alloc_mac(&fw_ops.header_mac, FW_KEY_LABEL_PKG_HEADER);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = fw_keys_alloc_mac(&fw_ops.segment_mac, FW_KEY_LABEL_PKG_SEGMENT);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = TEE_AllocateOperation(&fw_ops.sha1, TEE_ALG_SHA1,
+				    TEE_MODE_DIGEST, 0);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = TEE_AllocateOperation(&fw_ops.sha256, TEE_ALG_SHA256,
+				    TEE_MODE_DIGEST, 0);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	res = TEE_AllocateOperation(&fw_ops.package_sha256, TEE_ALG_SHA256,
+				    TEE_MODE_DIGEST, 0);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	/* same key whatever instance wrote the record */
+	res = fw_keys_alloc_mac(&fw_ops.record_mac, FW_KEY_LABEL_RECORD);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	return TEE_SUCCESS;
+err:
+	fw_crypto_release();
+	return res;
+}
+
+void fw_crypto_release(void)
+{
+	TEE_OperationHandle *ops[] = {
+		&fw_ops.ecb, &fw_ops.gcm, &fw_ops.ctr, &fw_ops.header_mac,
+		&fw_ops.segment_mac, &fw_ops.sha1, &fw_ops.sha256,
+		&fw_ops.package_sha256, &fw_ops.record_mac,
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (*ops[i] != TEE_HANDLE_NULL) {
+			TEE_FreeOperation(*ops[i]);
+			*ops[i] = TEE_HANDLE_NULL;
+		}
+	}
+}
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __FW_CRYPTO_H
+#define __FW_CRYPTO_H
+
+#include <tee_api.h>
+
+/* Size of SHA-256 digests and HMAC-SHA256 MACs */
+#define FW_DIGEST_LEN			32
+
+/* Size of the blocks decrypted and hashed in one go; sized to stay in L1/L2 */
+#define FW_CRYPTO_CHUNK_SIZE		(16 * 1024)
+
+/*
+ * Allocate and key the operations used by the functions below; they are
+ * kept until fw_crypto_release(), for the lifetime of the TA instance.
+ */
+TEE_Result fw_crypto_init(void);
+
+void fw_crypto_release(void);
+
+/*
+ * Layout section of a headed package, see mve_fw_package.h, copied to
+ * secure memory once the package is authenticated. 'data' is NULL when the
+ * package has none. Release with fw_pkg_layout_put().
+ */
+struct fw_pkg_layout {
+	void *data;
+	uint32_t len;
+};
+
+void fw_pkg_layout_put(struct fw_pkg_layout *layout);
+
+/*
+ * Decrypt and verify an encrypted firmware package into 'destdata'.
+ *
+ * Legacy (AES-ECB + SHA1 trailer) packages, and headed AES-GCM or
+ * segmented AES-CTR packages (see mve_fw_package.h) are accepted. The image is processed in
+ * FW_CRYPTO_CHUNK_SIZE blocks so every byte is verified while still hot
+ * in cache. On input '*destlen' is the room in 'destdata'; on success it
+ * is updated with the size of the decrypted image. On failure whatever
+ * was decrypted is wiped. If 'image_digest' is not NULL, it receives the
+ * SHA-256 of the decrypted image, computed in the same pass. If
+ * 'package_digest' is not NULL, it receives the SHA-256 of the package
+ * bytes that were actually decrypted, which are then read through a
+ * secure bounce buffer. If 'layout' is not NULL, it receives the layout
+ * section of the package on success.
+ */
+TEE_Result fw_decrypt_image(const void *srcdata, size_t srclen,
+			    void *destdata, uint32_t *destlen,
+			    uint8_t *image_digest, uint8_t *package_digest,
+			    struct fw_pkg_layout *layout);
+
+/*
+ * Verify an image decrypted from the segmented package 'package' outside
+ * of the TA, see mve_fw_package.h. On input '*len' is the room for the
+ * image at 'image'; on success it is updated with the image size,
+ * 'image_digest' receives the digest fw_image_seg_digest() computes for
+ * segments of '*seg_size' bytes and 'layout' the layout section of the
+ * package. Each piece of the image is copied to a secure bounce buffer,
+ * hashed there and written back, so that the image holds exactly what was
+ * verified even if something else writes to it meanwhile. On failure the
+ * image may be partly verified and must be wiped.
+ */
+TEE_Result fw_verify_image(const void *package, size_t package_len,
+			   void *image, uint32_t *len,
+			   uint8_t *image_digest, uint32_t *seg_size,
+			   struct fw_pkg_layout *layout);
+
+/* SHA-256 of an encrypted package, comparable to fw_decrypt_image() output */
+TEE_Result fw_package_digest(const void *package, size_t len, uint8_t *digest);
+
+/* SHA-256 of a decrypted image, comparable to fw_decrypt_image() output */
+TEE_Result fw_image_digest(const void *image, size_t len, uint8_t *digest);
+
+/*
+ * SHA-256 of the HMACs of the 'seg_size' byte segments of a decrypted
+ * image, comparable to fw_verify_image() output.
+ */
+TEE_Result fw_image_seg_digest(const void *image, size_t len,
+			       uint32_t seg_size, uint8_t *digest);
+
+/*
+ * HMAC-SHA256 authenticating metadata the TA stores in secure memory and
+ * reads back later. The key is private to the TA.
+ */
+TEE_Result fw_record_mac(const void *data, size_t len, uint8_t *mac);
+
+#endif /* __FW_CRYPTO_H */
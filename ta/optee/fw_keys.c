@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <string.h>
+#include <tee_api.h>
+#include <trace.h>
+
+#include "fw_keys.h"
+
+#define DERIVED_KEY_LEN			32
+
+/* TODO: remove this test purpose key into formal formal process */
+static const uint8_t fw_encryption_key[] = {
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, /* 01234567 */
+	0x38, 0x39, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, /* 89ABCDEF */
+};
+
+static TEE_Result set_secret_key(TEE_OperationHandle op, uint32_t type,
+				 const uint8_t *key, size_t keylen)
+{
+	TEE_Result res;
+	TEE_ObjectHandle trans_key;
+	TEE_Attribute attrs;
+
+	attrs.attributeID = TEE_ATTR_SECRET_VALUE;
+	attrs.content.ref.buffer = (void *)key;
+	attrs.content.ref.length = keylen;
+
+	res = TEE_AllocateTransientObject(type, keylen * 8, &trans_key);
+	if (res != TEE_SUCCESS) {
+		EMSG("Can not allocate transient object 0x%x", res);
+		return res;
+	}
+
+	res = TEE_PopulateTransientObject(trans_key, &attrs, 1);
+	if (res != TEE_SUCCESS) {
+		EMSG("Populate transient object error");
+		goto out;
+	}
+
+	res = TEE_SetOperationKey(op, trans_key);
+	if (res != TEE_SUCCESS)
+		EMSG("Can not set operation key");
+out:
+	/* the operation keeps its own copy of the key */
+	TEE_FreeTransientObject(trans_key);
+	return res;
+}
+
+static TEE_Result alloc_keyed_op(TEE_OperationHandle *op, uint32_t algo,
+				 uint32_t mode, uint32_t type,
+				 const uint8_t *key, size_t keylen)
+{
+	TEE_Result res;
+
+	res = TEE_AllocateOperation(op, algo, mode, keylen * 8);
+	if (res != TEE_SUCCESS) {
+		EMSG("Can not allocate operation (0x%x)", res);
+		return res;
+	}
+
+	res = set_secret_key(*op, type, key, keylen);
+	if (res != TEE_SUCCESS) {
+		TEE_FreeOperation(*op);
+		*op = TEE_HANDLE_NULL;
+	}
+	return res;
+}
+
+TEE_Result fw_keys_alloc_aes(TEE_OperationHandle *op, uint32_t algo,
+			     uint32_t mode)
+{
+	return alloc_keyed_op(op, algo, mode, TEE_TYPE_AES, fw_encryption_key,
+			      sizeof(fw_encryption_key));
+}
+
+TEE_Result fw_keys_alloc_mac(TEE_OperationHandle *op, const char *label)
+{
+	TEE_OperationHandle kdf = TEE_HANDLE_NULL;
+	uint8_t key[DERIVED_KEY_LEN];
+	uint32_t keylen = sizeof(key);
+	TEE_Result res;
+
+	res = alloc_keyed_op(&kdf, TEE_ALG_HMAC_SHA256, TEE_MODE_MAC,
+			     TEE_TYPE_HMAC_SHA256, fw_encryption_key,
+			     sizeof(fw_encryption_key));
+	if (res != TEE_SUCCESS)
+		return res;
+
+	TEE_MACInit(kdf, NULL, 0);
+	res = TEE_MACComputeFinal(kdf, label, strlen(label) + 1, key, &keylen);
+	TEE_FreeOperation(kdf);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = alloc_keyed_op(op, TEE_ALG_HMAC_SHA256, TEE_MODE_MAC,
+			     TEE_TYPE_HMAC_SHA256, key, sizeof(key));
+	TEE_MemFill(key, 0, sizeof(key));
+	return res;
+}
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __FW_KEYS_H
+#define __FW_KEYS_H
+
+#include <tee_api.h>
+
+/* Labels of the keys derived from the firmware key */
+#define FW_KEY_LABEL_RECORD		"sedget firmware load record"
+#define FW_KEY_LABEL_PKG_HEADER		"sedget firmware package header"
+#define FW_KEY_LABEL_PKG_SEGMENT	"sedget firmware package segment"
+
+/* Allocate an AES operation keyed with the firmware key */
+TEE_Result fw_keys_alloc_aes(TEE_OperationHandle *op, uint32_t algo,
+			     uint32_t mode);
+
+/*
+ * Allocate an HMAC-SHA256 operation keyed with the HMAC-SHA256 of 'label',
+ * NUL included, under the firmware key. Every TA built with the same
+ * firmware key derives the same key.
+ */
+TEE_Result fw_keys_alloc_mac(TEE_OperationHandle *op, const char *label);
+
+#endif /* __FW_KEYS_H */
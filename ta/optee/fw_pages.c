@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <tee_api.h>
+#include <trace.h>
+
+#include "fw_pages.h"
+
+/* Grow the set by this many runs at a time, up to the TA heap budget */
+#define FW_PAGES_GROW		16
+#define FW_PAGES_MAX_RUNS	4096
+
+/* Runs of a set are sorted, disjoint and non adjacent */
+struct fw_page_run {
+	uint64_t pfn;
+	uint64_t count;
+};
+
+/* Index of the first run of 'set' ending at or after 'pfn' */
+static size_t find_run(const struct fw_page_set *set, uint64_t pfn)
+{
+	const struct fw_page_run *runs = set->runs;
+	size_t lo = 0, hi = set->num_runs, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (runs[mid].pfn + runs[mid].count < pfn)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Make room for one more run */
+static TEE_Result reserve_run(struct fw_page_set *set)
+{
+	void *p;
+
+	if (set->num_runs < set->max_runs)
+		return TEE_SUCCESS;
+
+	if (set->max_runs == FW_PAGES_MAX_RUNS) {
+		EMSG("Too many page runs");
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	p = TEE_Realloc(set->runs,
+			(set->max_runs + FW_PAGES_GROW) * sizeof(*set->runs));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	set->runs = p;
+	set->max_runs += FW_PAGES_GROW;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result add_run(struct fw_page_set *set, uint64_t pfn,
+			  uint64_t count)
+{
+	struct fw_page_run *runs = set->runs;
+	size_t num_runs = set->num_runs;
+	size_t i = find_run(set, pfn), j;
+	uint64_t end = pfn + count;
+	TEE_Result rc;
+
+	/* merge with every run it overlaps or touches */
+	for (j = i; j < num_runs && runs[j].pfn <= end; j++) {
+		if (runs[j].pfn < pfn)
+			pfn = runs[j].pfn;
+		if (runs[j].pfn + runs[j].count > end)
+			end = runs[j].pfn + runs[j].count;
+	}
+
+	if (j == i) {
+		rc = reserve_run(set);
+		if (rc != TEE_SUCCESS)
+			return rc;
+		runs = set->runs;
+		TEE_MemMove(runs + i + 1, runs + i,
+			    (num_runs - i) * sizeof(*runs));
+		set->num_runs++;
+	} else if (j > i + 1) {
+		TEE_MemMove(runs + i + 1, runs + j,
+			    (num_runs - j) * sizeof(*runs));
+		set->num_runs -= j - i - 1;
+	}
+
+	runs[i].pfn = pfn;
+	runs[i].count = end - pfn;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result remove_run(struct fw_page_set *set, uint64_t pfn,
+			     uint64_t count)
+{
+	struct fw_page_run *runs = set->runs;
+	size_t i = find_run(set, pfn);
+	uint64_t end = pfn + count;
+	uint64_t run_end;
+	TEE_Result rc;
+
+	while (i < set->num_runs && runs[i].pfn < end) {
+		run_end = runs[i].pfn + runs[i].count;
+		if (run_end <= pfn) {
+			i++;
+		} else if (runs[i].pfn >= pfn && run_end <= end) {
+			TEE_MemMove(runs + i, runs + i + 1,
+				    (set->num_runs - i - 1) * sizeof(*runs));
+			set->num_runs--;
+		} else if (runs[i].pfn < pfn && run_end > end) {
+			/* split around the removed pages */
+			rc = reserve_run(set);
+			if (rc != TEE_SUCCESS)
+				return rc;
+			runs = set->runs;
+			TEE_MemMove(runs + i + 2, runs + i + 1,
+				    (set->num_runs - i - 1) * sizeof(*runs));
+			set->num_runs++;
+			runs[i + 1].pfn = end;
+			runs[i + 1].count = run_end - end;
+			runs[i].count = pfn - runs[i].pfn;
+			return TEE_SUCCESS;
+		} else if (runs[i].pfn < pfn) {
+			runs[i].count = pfn - runs[i].pfn;
+			i++;
+		} else {
+			runs[i].count = run_end - end;
+			runs[i].pfn = end;
+			i++;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
+/* TEE_ERROR_ACCESS_CONFLICT if 'set' has any of the 'count' pages */
+static TEE_Result check_run(struct fw_page_set *set, uint64_t pfn,
+			    uint64_t count)
+{
+	size_t i = find_run(set, pfn);
+
+	/* a run ending at 'pfn' is followed by one starting past it */
+	for (; i < set->num_runs && set->runs[i].pfn < pfn + count; i++)
+		if (set->runs[i].pfn + set->runs[i].count > pfn)
+			return TEE_ERROR_ACCESS_CONFLICT;
+	return TEE_SUCCESS;
+}
+
+/* Apply 'fn' to each physically contiguous run of the pages */
+static TEE_Result for_each_run(struct fw_page_set *set,
+			       const struct sdp_phys_pages *pages,
+			       size_t npages,
+			       TEE_Result (*fn)(struct fw_page_set *set,
+						uint64_t pfn, uint64_t count))
+{
+	TEE_Result rc;
+	size_t p, n;
+
+	if (!pages->pfns)
+		return fn(set, pages->base >> SDP_PHYS_PAGE_SHIFT, npages);
+
+	for (p = 0; p < npages; p += n) {
+		for (n = 1; p + n < npages &&
+			    pages->pfns[p + n] == pages->pfns[p] + n; n++)
+			;
+		rc = fn(set, pages->pfns[p], n);
+		if (rc != TEE_SUCCESS)
+			return rc;
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result fw_pages_add(struct fw_page_set *set,
+			const struct sdp_phys_pages *pages, size_t npages)
+{
+	return for_each_run(set, pages, npages, add_run);
+}
+
+TEE_Result fw_pages_remove(struct fw_page_set *set,
+			   const struct sdp_phys_pages *pages, size_t npages)
+{
+	return for_each_run(set, pages, npages, remove_run);
+}
+
+bool fw_pages_contain(const struct fw_page_set *set, uint64_t pa)
+{
+	uint64_t pfn = pa >> SDP_PHYS_PAGE_SHIFT;
+	size_t i = find_run(set, pfn);
+
+	return i < set->num_runs && set->runs[i].pfn <= pfn &&
+	       pfn < set->runs[i].pfn + set->runs[i].count;
+}
+
+bool fw_pages_overlap(struct fw_page_set *set,
+		      const struct sdp_phys_pages *pages, size_t npages)
+{
+	return for_each_run(set, pages, npages, check_run) != TEE_SUCCESS;
+}
+
+void fw_pages_release(struct fw_page_set *set)
+{
+	TEE_Free(set->runs);
+	set->runs = NULL;
+	set->num_runs = 0;
+	set->max_runs = 0;
+}
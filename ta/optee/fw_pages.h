@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __FW_PAGES_H
+#define __FW_PAGES_H
+
+#include <tee_api.h>
+
+#include "sdp_phys.h"
+
+/*
+ * Sets of physical pages, kept as runs of contiguous page frames so that
+ * the pages of buffers from contiguous heaps cost one run each. Sets start
+ * zeroed and grow up to a bound fitting the TA heap.
+ */
+struct fw_page_run;
+
+struct fw_page_set {
+	struct fw_page_run *runs;
+	size_t num_runs;
+	size_t max_runs;
+};
+
+/* Add the 'npages' pages of a buffer */
+TEE_Result fw_pages_add(struct fw_page_set *set,
+			const struct sdp_phys_pages *pages, size_t npages);
+
+/* Remove the 'npages' pages of a buffer, whether in the set or not */
+TEE_Result fw_pages_remove(struct fw_page_set *set,
+			   const struct sdp_phys_pages *pages, size_t npages);
+
+/* Whether physical address 'pa' is in a page of the set */
+bool fw_pages_contain(const struct fw_page_set *set, uint64_t pa);
+
+/* Whether any of the 'npages' pages of a buffer is in the set */
+bool fw_pages_overlap(struct fw_page_set *set,
+		      const struct sdp_phys_pages *pages, size_t npages);
+
+/* Empty the set and free its runs */
+void fw_pages_release(struct fw_page_set *set);
+
+#endif /* __FW_PAGES_H */
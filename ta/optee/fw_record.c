@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <stddef.h>
+#include <tee_api.h>
+#include <trace.h>
+
+#include "mve_fw_package.h"
+#include "fw_record.h"
+
+TEE_Result fw_record_write(uint8_t *fw_addr, size_t size,
+			   struct fw_load_record *rec,
+			   const struct fw_pkg_layout *layout)
+{
+	uint8_t *page;
+	TEE_Result rc;
+
+	if (size < FW_RECORD_SIZE)
+		return TEE_ERROR_SHORT_BUFFER;
+
+	page = fw_addr + size - FW_RECORD_SIZE;
+	rec->magic = FW_RECORD_MAGIC;
+	rec->layout_len = 0;
+	TEE_MemFill(rec->layout_digest, 0, sizeof(rec->layout_digest));
+	if (layout && layout->data) {
+		rec->flags |= FW_RECORD_FLAG_PKG_LAYOUT;
+		if (layout->len <= FW_RECORD_LAYOUT_MAX) {
+			rc = fw_image_digest(layout->data, layout->len,
+					     rec->layout_digest);
+			if (rc != TEE_SUCCESS)
+				return rc;
+			rec->layout_len = layout->len;
+			TEE_MemMove(page + sizeof(*rec), layout->data,
+				    layout->len);
+		}
+	} else {
+		rec->flags &= ~FW_RECORD_FLAG_PKG_LAYOUT;
+	}
+
+	rc = fw_record_mac(rec, offsetof(struct fw_load_record, mac),
+			   rec->mac);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	TEE_MemMove(page, rec, sizeof(*rec));
+	return TEE_SUCCESS;
+}
+
+static TEE_Result read_layout(const uint8_t *page,
+			      const struct fw_load_record *rec,
+			      struct fw_pkg_layout *layout)
+{
+	uint8_t digest[FW_DIGEST_LEN];
+	TEE_Result rc;
+
+	layout->data = NULL;
+	layout->len = 0;
+	if (!rec->layout_len)
+		return TEE_SUCCESS;
+
+	/* private copy, checked once */
+	layout->data = TEE_Malloc(rec->layout_len, TEE_MALLOC_FILL_ZERO);
+	if (!layout->data)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	layout->len = rec->layout_len;
+	TEE_MemMove(layout->data, page + sizeof(*rec), layout->len);
+
+	rc = fw_image_digest(layout->data, layout->len, digest);
+	if (rc == TEE_SUCCESS &&
+	    TEE_MemCompare(digest, rec->layout_digest, sizeof(digest))) {
+		EMSG("Firmware layout changed since it was loaded");
+		rc = TEE_ERROR_SECURITY;
+	}
+	if (rc != TEE_SUCCESS)
+		fw_pkg_layout_put(layout);
+	return rc;
+}
+
+TEE_Result fw_record_check(const uint8_t *fw_addr, size_t size,
+			   uint64_t phys_addr, struct fw_load_record *rec)
+{
+	uint8_t digest[FW_DIGEST_LEN];
+	TEE_Result rc;
+
+	if (size < FW_RECORD_SIZE)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	TEE_MemMove(rec, fw_addr + size - FW_RECORD_SIZE, sizeof(*rec));
+	if (rec->magic != FW_RECORD_MAGIC)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	rc = fw_record_mac(rec, offsetof(struct fw_load_record, mac), digest);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	if (TEE_MemCompare(digest, rec->mac, sizeof(digest)) ||
+	    rec->phys_addr != phys_addr || rec->size != size ||
+	    rec->ncores == 0 || rec->ncores > MVE_MAX_CORES ||
+	    (rec->flags & ~(FW_RECORD_FLAG_L1 | FW_RECORD_FLAG_PKG_LAYOUT)) ||
+	    rec->digest_seg_size % MVE_FW_PKG_SEGMENT_ALIGN ||
+	    rec->layout_len > FW_RECORD_LAYOUT_MAX ||
+	    (rec->layout_len && !(rec->flags & FW_RECORD_FLAG_PKG_LAYOUT)) ||
+	    rec->image_len > size - FW_RECORD_SIZE) {
+		EMSG("Invalid firmware load record");
+		return TEE_ERROR_SECURITY;
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result fw_record_read(uint8_t *fw_addr, size_t size, uint64_t phys_addr,
+			  struct fw_load_record *rec,
+			  struct fw_pkg_layout *layout)
+{
+	uint8_t digest[FW_DIGEST_LEN];
+	TEE_Result rc;
+
+	rc = fw_record_check(fw_addr, size, phys_addr, rec);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	if (rec->digest_seg_size)
+		rc = fw_image_seg_digest(fw_addr, rec->image_len,
+					 rec->digest_seg_size, digest);
+	else
+		rc = fw_image_digest(fw_addr, rec->image_len, digest);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	if (TEE_MemCompare(digest, rec->image_digest, sizeof(digest))) {
+		EMSG("Firmware image changed since it was loaded");
+		return TEE_ERROR_SECURITY;
+	}
+
+	return read_layout(fw_addr + size - FW_RECORD_SIZE, rec, layout);
+}
+
+bool fw_record_present(const uint8_t *fw_addr, size_t size)
+{
+	struct fw_load_record rec;
+	uint8_t digest[FW_DIGEST_LEN];
+
+	if (size < FW_RECORD_SIZE)
+		return false;
+
+	TEE_MemMove(&rec, fw_addr + size - FW_RECORD_SIZE, sizeof(rec));
+	if (rec.magic != FW_RECORD_MAGIC)
+		return false;
+
+	/* err on the side of a firmware buffer if the MAC can not be made */
+	if (fw_record_mac(&rec, offsetof(struct fw_load_record, mac),
+			  digest) != TEE_SUCCESS)
+		return true;
+
+	return !TEE_MemCompare(digest, rec.mac, sizeof(digest));
+}
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __FW_RECORD_H
+#define __FW_RECORD_H
+
+#include <tee_api.h>
+
+#include "mve_fw_mmu.h"
+#include "fw_crypto.h"
+
+#define FW_RECORD_MAGIC		0x52574653	/* "SFWR" */
+
+/* Page tables include one L1 table per core */
+#define FW_RECORD_FLAG_L1	(1 << 0)
+/*
+ * The image was mapped from the layout section of its package, which is
+ * kept after the record when it fits, see fw_load_record.layout_len
+ */
+#define FW_RECORD_FLAG_PKG_LAYOUT	(1 << 1)
+
+/* The record takes the last page of a firmware buffer */
+#define FW_RECORD_SIZE		MVE_MMU_PAGE_SIZE
+
+/*
+ * What the TA needs to operate on a firmware buffer it loaded earlier.
+ * Stored in the last page of the buffer, which is never mapped to the MVE,
+ * and authenticated with fw_record_mac() since the TA can not tell whether
+ * the buffer was freed and reused in between.
+ */
+struct fw_load_record {
+	uint32_t magic;
+	uint32_t image_len;		/* bytes of decrypted image */
+	uint32_t ncores;		/* cores page tables are built for */
+	uint32_t flags;			/* FW_RECORD_FLAG_* */
+	/*
+	 * 0 when image_digest is the SHA-256 of the image, else the size of
+	 * the segments whose HMACs it is made of, see fw_image_seg_digest()
+	 */
+	uint32_t digest_seg_size;
+	/* bytes of layout section following the record, 0 if not kept */
+	uint32_t layout_len;
+	uint64_t phys_addr;		/* physical address of the buffer */
+	uint64_t size;			/* size of the buffer */
+	uint8_t image_digest[FW_DIGEST_LEN];
+	uint8_t layout_digest[FW_DIGEST_LEN];	/* of the layout section */
+	uint8_t mac[FW_DIGEST_LEN];	/* covers all fields above */
+};
+
+/* Largest layout section kept in the record page */
+#define FW_RECORD_LAYOUT_MAX	\
+	(FW_RECORD_SIZE - sizeof(struct fw_load_record))
+
+/*
+ * Authenticate 'rec' and store it in the buffer, along with the package
+ * layout section 'layout' the image was mapped from, if any. A section
+ * larger than FW_RECORD_LAYOUT_MAX is not kept, the record only tells the
+ * image was mapped from one.
+ */
+TEE_Result fw_record_write(uint8_t *fw_addr, size_t size,
+			   struct fw_load_record *rec,
+			   const struct fw_pkg_layout *layout);
+
+/*
+ * Read back the record of the buffer at 'fw_addr'/'phys_addr' and check
+ * that it is authentic and describes that very buffer, whatever the image
+ * now holds. TEE_ERROR_ITEM_NOT_FOUND means the buffer ends with no record.
+ */
+TEE_Result fw_record_check(const uint8_t *fw_addr, size_t size,
+			   uint64_t phys_addr, struct fw_load_record *rec);
+
+/*
+ * Read back the record of the buffer at 'fw_addr'/'phys_addr' and check
+ * that it is authentic and that the image it describes is unchanged.
+ * 'layout' receives a copy of the layout section kept with the record, if
+ * any; release it with fw_pkg_layout_put().
+ */
+TEE_Result fw_record_read(uint8_t *fw_addr, size_t size, uint64_t phys_addr,
+			  struct fw_load_record *rec,
+			  struct fw_pkg_layout *layout);
+
+/*
+ * Whether the buffer at 'fw_addr' ends with a record the TA wrote, i.e. is
+ * or was a firmware buffer. Only the magic and MAC are checked, so stale
+ * records of freed buffers count too.
+ */
+bool fw_record_present(const uint8_t *fw_addr, size_t size);
+
+#endif /* __FW_RECORD_H */
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <string.h>
+#include <tee_api.h>
+#include <trace.h>
+
+#include "fw_segments.h"
+
+#define AES_BLOCK_SIZE			16
+
+/* Size of the blocks decrypted in one go; sized to stay in L1/L2 */
+#define FW_SEG_CHUNK_SIZE		(16 * 1024)
+
+#define MIN(a, b)			((a) < (b) ? (a) : (b))
+
+TEE_Result fw_seg_header_get(const uint8_t *pkg, size_t pkg_size,
+			     TEE_OperationHandle header_mac,
+			     struct fw_seg_header *h)
+{
+	struct mve_fw_pkg_header hdr;
+	struct mve_fw_pkg_segments segs;
+	uint64_t num_segments;
+	TEE_Result res;
+
+	h->bytes = NULL;
+
+	if (pkg_size < sizeof(hdr))
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	/* non secure memory: only ever use private copies */
+	TEE_MemMove(&hdr, pkg, sizeof(hdr));
+	if (hdr.magic != MVE_FW_PKG_MAGIC ||
+	    hdr.cipher != MVE_FW_PKG_CIPHER_AES_CTR)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	if (hdr.version != MVE_FW_PKG_VERSION ||
+	    hdr.header_size < sizeof(hdr) + sizeof(segs) ||
+	    (uint64_t)hdr.header_size + hdr.payload_size +
+	    MVE_FW_PKG_MAC_LEN != pkg_size || hdr.payload_size == 0) {
+		EMSG("Invalid segmented firmware package");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+
+	TEE_MemMove(&segs, pkg + sizeof(hdr), sizeof(segs));
+	if (segs.segment_size == 0 ||
+	    segs.segment_size % MVE_FW_PKG_SEGMENT_ALIGN)
+		return TEE_ERROR_BAD_FORMAT;
+
+	num_segments = ((uint64_t)hdr.payload_size + segs.segment_size - 1) /
+		       segs.segment_size;
+	if (segs.num_segments != num_segments ||
+	    hdr.header_size < sizeof(hdr) + sizeof(segs) +
+			      num_segments * MVE_FW_PKG_MAC_LEN) {
+		EMSG("Invalid firmware segment table");
+		return TEE_ERROR_BAD_FORMAT;
+	}
+
+	h->bytes = TEE_Malloc(hdr.header_size, TEE_MALLOC_FILL_ZERO);
+	if (!h->bytes)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	TEE_MemMove(h->bytes, pkg, hdr.header_size);
+	TEE_MemMove(h->mac, pkg + pkg_size - MVE_FW_PKG_MAC_LEN,
+		    MVE_FW_PKG_MAC_LEN);
+	h->hdr = (const void *)h->bytes;
+	h->segs = (const void *)(h->bytes + sizeof(hdr));
+
+	/* the copy may differ from what was checked above */
+	if (TEE_MemCompare(h->hdr, &hdr, sizeof(hdr)) ||
+	    TEE_MemCompare(h->segs, &segs, sizeof(segs))) {
+		res = TEE_ERROR_BAD_FORMAT;
+		goto err;
+	}
+
+	TEE_MACInit(header_mac, NULL, 0);
+	res = TEE_MACCompareFinal(header_mac, h->bytes, hdr.header_size,
+				  h->mac, MVE_FW_PKG_MAC_LEN);
+	if (res != TEE_SUCCESS) {
+		EMSG("Verify firmware header MAC failed! %x", res);
+		goto err;
+	}
+
+	return TEE_SUCCESS;
+err:
+	fw_seg_header_put(h);
+	return res;
+}
+
+void fw_seg_header_put(struct fw_seg_header *h)
+{
+	TEE_Free(h->bytes);
+	h->bytes = NULL;
+	h->hdr = NULL;
+	h->segs = NULL;
+}
+
+size_t fw_seg_offset(const struct fw_seg_header *h, uint32_t i)
+{
+	return (size_t)i * h->segs->segment_size;
+}
+
+size_t fw_seg_header_end(const struct fw_seg_header *h)
+{
+	return sizeof(*h->hdr) + sizeof(*h->segs) +
+		(size_t)h->segs->num_segments * MVE_FW_PKG_MAC_LEN;
+}
+
+size_t fw_seg_size(const struct fw_seg_header *h, uint32_t i)
+{
+	size_t offset = fw_seg_offset(h, i);
+	size_t left = h->hdr->payload_size - offset;
+
+	return left < h->segs->segment_size ? left : h->segs->segment_size;
+}
+
+void fw_seg_cipher_init(const struct fw_seg_header *h, TEE_OperationHandle ctr,
+			size_t offset)
+{
+	uint8_t counter[AES_BLOCK_SIZE];
+	uint64_t add = offset / AES_BLOCK_SIZE;
+	int i;
+
+	/* 128 bit big endian addition */
+	TEE_MemMove(counter, h->hdr->iv, sizeof(counter));
+	for (i = AES_BLOCK_SIZE - 1; i >= 0 && add; i--) {
+		add += counter[i];
+		counter[i] = add & 0xff;
+		add >>= 8;
+	}
+
+	TEE_ResetOperation(ctr);
+	TEE_CipherInit(ctr, counter, sizeof(counter));
+}
+
+TEE_Result fw_seg_cipher_update(TEE_OperationHandle ctr, const void *src,
+				size_t len, void *dst, bool last)
+{
+	uint32_t outlen = len;
+	TEE_Result res;
+
+	if (last)
+		res = TEE_CipherDoFinal(ctr, src, len, dst, &outlen);
+	else
+		res = TEE_CipherUpdate(ctr, src, len, dst, &outlen);
+	if (res != TEE_SUCCESS) {
+		EMSG("Can not do AES-CTR %x", res);
+		return res;
+	}
+
+	/* CTR is a stream mode, nothing is held back */
+	return outlen == len ? TEE_SUCCESS : TEE_ERROR_GENERIC;
+}
+
+TEE_Result fw_seg_decrypt(const struct fw_seg_header *h,
+			  TEE_OperationHandle ctr, TEE_OperationHandle mac,
+			  const uint8_t *pkg, uint8_t *image, uint32_t first,
+			  uint32_t count)
+{
+	const uint8_t *payload = pkg + h->hdr->header_size;
+	size_t start, end, off, size, done, n;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *seg;
+	uint32_t i;
+
+	if (count == 0 || first >= h->segs->num_segments ||
+	    count > h->segs->num_segments - first)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (h->segs->segment_size > FW_SEG_MAX_PRIVATE_SIZE)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	seg = TEE_Malloc(h->segs->segment_size, TEE_MALLOC_FILL_ZERO);
+	if (!seg)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	start = fw_seg_offset(h, first);
+	end = start;
+
+	/* segments are consecutive, the counter runs on from one to the next */
+	fw_seg_cipher_init(h, ctr, start);
+	for (i = first; i < first + count; i++) {
+		off = fw_seg_offset(h, i);
+		size = fw_seg_size(h, i);
+
+		for (done = 0; done < size; done += n) {
+			n = MIN(FW_SEG_CHUNK_SIZE, size - done);
+			res = fw_seg_cipher_update(ctr, payload + off + done, n,
+						   seg + done,
+						   off + done + n ==
+						   h->hdr->payload_size);
+			if (res != TEE_SUCCESS)
+				goto out;
+		}
+
+		TEE_MACInit(mac, NULL, 0);
+		res = TEE_MACCompareFinal(mac, seg, size, h->segs->mac[i],
+					  MVE_FW_PKG_MAC_LEN);
+		if (res != TEE_SUCCESS) {
+			EMSG("Verify firmware segment %u failed! %x", i, res);
+			goto out;
+		}
+
+		TEE_MemMove(image + off, seg, size);
+		end = off + size;
+	}
+out:
+	if (res != TEE_SUCCESS)
+		TEE_MemFill(image + start, 0, end - start);
+	TEE_MemFill(seg, 0, h->segs->segment_size);
+	TEE_Free(seg);
+	return res;
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __FW_SEGMENTS_H
+#define __FW_SEGMENTS_H
+
+#include <tee_api.h>
+
+#include "mve_fw_package.h"
+
+/*
+ * Secure copy of the header and segment table of an AES-CTR package, see
+ * mve_fw_package.h. Shared by the TA and the decryption workers.
+ */
+/* Largest segment fw_seg_decrypt() takes; the workers' heap is sized for it */
+#define FW_SEG_MAX_PRIVATE_SIZE		(256 * 1024)
+
+struct fw_seg_header {
+	uint8_t *bytes;				/* header_size bytes */
+	const struct mve_fw_pkg_header *hdr;	/* in 'bytes' */
+	const struct mve_fw_pkg_segments *segs;	/* in 'bytes' */
+	uint8_t mac[MVE_FW_PKG_MAC_LEN];	/* package trailer */
+};
+
+/*
+ * Copy the header of the AES-CTR package 'pkg' to secure memory, check
+ * the segment table and verify the header HMAC with 'header_mac'. Release
+ * with fw_seg_header_put(). TEE_ERROR_ITEM_NOT_FOUND means the package is
+ * of another kind.
+ */
+TEE_Result fw_seg_header_get(const uint8_t *pkg, size_t pkg_size,
+			     TEE_OperationHandle header_mac,
+			     struct fw_seg_header *h);
+
+void fw_seg_header_put(struct fw_seg_header *h);
+
+/* Offset in the header of what follows the segment table */
+size_t fw_seg_header_end(const struct fw_seg_header *h);
+
+/* Offset and size of segment 'i' in the image */
+size_t fw_seg_offset(const struct fw_seg_header *h, uint32_t i);
+size_t fw_seg_size(const struct fw_seg_header *h, uint32_t i);
+
+/* Start 'ctr' decrypting at image byte 'offset', a multiple of 16 */
+void fw_seg_cipher_init(const struct fw_seg_header *h, TEE_OperationHandle ctr,
+			size_t offset);
+
+/*
+ * Decrypt the next 'len' bytes with 'ctr'. 'last' tells they end the
+ * image, which may end in the middle of a block.
+ */
+TEE_Result fw_seg_cipher_update(TEE_OperationHandle ctr, const void *src,
+				size_t len, void *dst, bool last);
+
+/*
+ * Decrypt segments 'first' to 'first + count - 1' of 'pkg' to their place
+ * in 'image'. Each segment is decrypted to private memory and checked
+ * against its HMAC with 'mac' before it is copied out, so only authentic
+ * bytes ever reach 'image'; whether they are the segments of the package
+ * the image is finished with is still for FINISH_FW to check. Segments
+ * larger than FW_SEG_MAX_PRIVATE_SIZE are refused with
+ * TEE_ERROR_NOT_SUPPORTED. On failure whatever was copied out is wiped.
+ */
+TEE_Result fw_seg_decrypt(const struct fw_seg_header *h,
+			  TEE_OperationHandle ctr, TEE_OperationHandle mac,
+			  const uint8_t *pkg, uint8_t *image, uint32_t first,
+			  uint32_t count);
+
+#endif /* __FW_SEGMENTS_H */
@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <tee_api.h>
+#include <trace.h>
+#include <sdp_pta.h>
+
+#include "sdp_phys.h"
+
+/*
+ * SDP PTAs implementing it tell whether a range is physically contiguous:
+ * memref input, then the physical address of its start and, in value a of
+ * the third parameter, 1 when the whole range follows it. Others report the
+ * command as not supported or not implemented.
+ */
+#ifndef PTA_CMD_SDP_VIRT_TO_PHYS_CONTIG
+#define PTA_CMD_SDP_VIRT_TO_PHYS_CONTIG	1
+#endif
+
+/* Held for the TA instance lifetime, see sdp_phys_close() */
+static TEE_TASessionHandle sdp_pta_sess = TEE_HANDLE_NULL;
+
+/* Set once the PTA turned PTA_CMD_SDP_VIRT_TO_PHYS_CONTIG down */
+static bool pta_no_contig;
+
+static TEE_Result open_sdp_pta(void)
+{
+	TEE_UUID pta_uuid = PTA_SDP_PTA_UUID;
+	TEE_Result rc;
+
+	if (sdp_pta_sess != TEE_HANDLE_NULL)
+		return TEE_SUCCESS;
+
+	rc = TEE_OpenTASession(&pta_uuid, 0, 0, NULL, &sdp_pta_sess, NULL);
+	if (rc != TEE_SUCCESS) {
+		EMSG("Can not open SDP PTA session 0x%x", rc);
+		sdp_pta_sess = TEE_HANDLE_NULL;
+	}
+	return rc;
+}
+
+/* A TA have no reason to retrieve physical address of buffers;
+ * call helper PTA to retrieve this */
+static TEE_Result invoke_virt_to_phys(void *va, size_t size, uint64_t *pa)
+{
+	TEE_Result rc;
+	uint32_t param_types;
+	TEE_Param p[TEE_NUM_PARAMS];
+
+	param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				      TEE_PARAM_TYPE_VALUE_OUTPUT,
+				      TEE_PARAM_TYPE_NONE,
+				      TEE_PARAM_TYPE_NONE);
+	p[0].memref.buffer = va;
+	p[0].memref.size = size;
+
+	rc = TEE_InvokeTACommand(sdp_pta_sess, 0, PTA_CMD_SDP_VIRT_TO_PHYS,
+				 param_types, p, NULL);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	*pa = (uint64_t)p[1].value.a << 32 | p[1].value.b;
+	return TEE_SUCCESS;
+}
+
+/* Whether the 'size' bytes at 'va' are physically contiguous from '*pa' */
+static TEE_Result invoke_virt_to_phys_contig(void *va, size_t size,
+					     uint64_t *pa, bool *contiguous)
+{
+	TEE_Result rc;
+	uint32_t param_types;
+	TEE_Param p[TEE_NUM_PARAMS];
+
+	param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				      TEE_PARAM_TYPE_VALUE_OUTPUT,
+				      TEE_PARAM_TYPE_VALUE_OUTPUT,
+				      TEE_PARAM_TYPE_NONE);
+	p[0].memref.buffer = va;
+	p[0].memref.size = size;
+
+	rc = TEE_InvokeTACommand(sdp_pta_sess, 0,
+				 PTA_CMD_SDP_VIRT_TO_PHYS_CONTIG,
+				 param_types, p, NULL);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	*pa = (uint64_t)p[1].value.a << 32 | p[1].value.b;
+	*contiguous = p[2].value.a == 1;
+	return TEE_SUCCESS;
+}
+
+TEE_Result sdp_phys_pages_get(void *va, size_t npages,
+			      struct sdp_phys_pages *pages)
+{
+	uint8_t *addr = va;
+	bool contiguous = true;
+	uint64_t pa;
+	TEE_Result rc;
+	size_t p;
+
+	pages->base = 0;
+	pages->pfns = NULL;
+
+	if (!npages)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	rc = open_sdp_pta();
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	/* one invocation for the buffers of contiguous heaps */
+	if (!pta_no_contig) {
+		rc = invoke_virt_to_phys_contig(va, npages * SDP_PHYS_PAGE_SIZE,
+						&pa, &contiguous);
+		if (rc == TEE_SUCCESS && contiguous) {
+			pages->base = pa;
+			return TEE_SUCCESS;
+		}
+		if (rc == TEE_ERROR_NOT_SUPPORTED ||
+		    rc == TEE_ERROR_NOT_IMPLEMENTED) {
+			IMSG("SDP PTA does not tell contiguity, translating pages");
+			pta_no_contig = true;
+		} else if (rc != TEE_SUCCESS) {
+			EMSG("SDP virt to phys of %p failed 0x%x", va, rc);
+			return rc;
+		}
+		contiguous = true;
+	}
+
+	pages->pfns = TEE_Malloc(npages * sizeof(*pages->pfns),
+				 TEE_MALLOC_FILL_ZERO);
+	if (!pages->pfns)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	/*
+	 * The plain translation returns the address of the start of a range
+	 * without telling whether the rest follows it, so every page of a
+	 * scattered buffer, or of any buffer with an older PTA, is translated.
+	 */
+	for (p = 0; p < npages; p++) {
+		rc = invoke_virt_to_phys(addr + p * SDP_PHYS_PAGE_SIZE,
+					 SDP_PHYS_PAGE_SIZE, &pa);
+		if (rc != TEE_SUCCESS ||
+		    (pa >> SDP_PHYS_PAGE_SHIFT) > UINT32_MAX) {
+			EMSG("SDP virt to phys of %p failed 0x%x",
+			     addr + p * SDP_PHYS_PAGE_SIZE, rc);
+			sdp_phys_pages_put(pages);
+			return rc != TEE_SUCCESS ? rc : TEE_ERROR_NOT_SUPPORTED;
+		}
+
+		pages->pfns[p] = pa >> SDP_PHYS_PAGE_SHIFT;
+		if (p && pages->pfns[p] != pages->pfns[p - 1] + 1)
+			contiguous = false;
+	}
+
+	pages->base = (uint64_t)pages->pfns[0] << SDP_PHYS_PAGE_SHIFT;
+	if (contiguous)
+		sdp_phys_pages_put(pages);
+
+	return TEE_SUCCESS;
+}
+
+void sdp_phys_pages_put(struct sdp_phys_pages *pages)
+{
+	TEE_Free(pages->pfns);
+	pages->pfns = NULL;
+}
+
+TEE_Result sdp_phys_addr(void *va, uint64_t *pa)
+{
+	TEE_Result rc;
+
+	rc = open_sdp_pta();
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	return invoke_virt_to_phys(va, 1, pa);
+}
+
+void sdp_phys_close(void)
+{
+	if (sdp_pta_sess != TEE_HANDLE_NULL) {
+		TEE_CloseTASession(sdp_pta_sess);
+		sdp_pta_sess = TEE_HANDLE_NULL;
+	}
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+#ifndef __SDP_PHYS_H
+#define __SDP_PHYS_H
+
+#include <tee_api.h>
+
+#define SDP_PHYS_PAGE_SHIFT	12
+#define SDP_PHYS_PAGE_SIZE	(1 << SDP_PHYS_PAGE_SHIFT)
+
+/*
+ * Physical pages of a secure buffer. 'pfns' is NULL when the buffer is
+ * physically contiguous from 'base', else it holds the frame number of each
+ * page and 'base' is the address of the first one.
+ */
+struct sdp_phys_pages {
+	uint64_t base;
+	uint32_t *pfns;
+};
+
+/*
+ * Translate the 'npages' pages of the buffer at 'va', which needs not be
+ * physically contiguous. A contiguous buffer takes one PTA invocation when
+ * the PTA can tell it is; a scattered one, or any with a PTA that can not,
+ * takes one per page. Release with sdp_phys_pages_put().
+ */
+TEE_Result sdp_phys_pages_get(void *va, size_t npages,
+			      struct sdp_phys_pages *pages);
+
+void sdp_phys_pages_put(struct sdp_phys_pages *pages);
+
+/* Physical address of the byte at 'va' of a secure buffer */
+TEE_Result sdp_phys_addr(void *va, uint64_t *pa);
+
+/* The SDP PTA session is opened on first use and kept until then */
+void sdp_phys_close(void);
+
+#endif /* __SDP_PHYS_H */
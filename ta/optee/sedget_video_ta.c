@@ -9,181 +9,339 @@
 #include <tee_internal_api.h>
 #include <tee_ta_api.h>
 #include <trace.h>
-#include <sdp_pta.h>
 
 #include "sedget_video_ta.h"
 #include "mve_fw_mmu.h"
+#include "fw_crypto.h"
+#include "sdp_phys.h"
+#include "cache_range.h"
+#include "fw_record.h"
+#include "fw_pages.h"
+#include "fw_cache.h"
 
-#define FIRMWARE_SIGNATURE_LEN		32
+#define MIN(a, b)			((a) < (b) ? (a) : (b))
 
-/* TODO: remove this test purpose key into formal formal process */
-static const uint8_t fw_encryption_key[] = {
-	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, /* 01234567 */
-	0x38, 0x39, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, /* 89ABCDEF */
+/*
+ * Physical pages this TA instance loaded firmware into. Commands writing
+ * caller chosen data refuse them, whatever part of a firmware buffer the
+ * caller passes, and SCRUB does too: a client could otherwise scrub a
+ * firmware the MVE still runs and then write into it. Pages are only
+ * removed by RELEASE_FW, which wipes the whole buffer, page tables
+ * included, so the pages can serve as input buffers once freed.
+ */
+static struct fw_page_set fw_loaded;
+
+/*
+ * Sessions opened by worker TAs. Before decrypting, a worker claims the
+ * pages it writes: the claim is refused on firmware pages, and LOAD_FW and
+ * FINISH_FW refuse claimed pages until the worker drops its claim or its
+ * session. Commands of all sessions are serialized, so nothing changes
+ * between a check and the update it guards.
+ */
+struct worker_session {
+	struct fw_page_set claim;
+	struct worker_session *next;
 };
 
-static TEE_Result decrypt_firmware(void *srcdata, size_t srclen,
-		   void *destdata, uint32_t *destlen)
+static struct worker_session *worker_sessions;
+
+/*
+ * Offset of the page tables in a firmware buffer of 'fw_size' bytes: they
+ * end just below the load record in the last page.
+ */
+static size_t fw_tables_offset(size_t fw_size, size_t tables_size)
 {
-	TEE_Result res = TEE_ERROR_GENERIC;
-	TEE_ObjectHandle trans_key;
-	TEE_Attribute attrs;
-	TEE_OperationHandle op;
-	uint32_t maxkeylen = 16;
-
-	attrs.attributeID = TEE_ATTR_SECRET_VALUE;
-	attrs.content.ref.buffer = (void *)fw_encryption_key;
-	attrs.content.ref.length = sizeof(fw_encryption_key);
-
-	res = TEE_AllocateOperation(&op,
-				    TEE_ALG_AES_ECB_NOPAD,
-				    TEE_MODE_DECRYPT,
-				    (maxkeylen * 8));
-	if (res != TEE_SUCCESS) {
-		EMSG("Can not allocate operation (0x%x)", res);
-		goto out;
-	}
+	return fw_size - FW_RECORD_SIZE - tables_size;
+}
 
-	res = TEE_AllocateTransientObject(TEE_TYPE_AES,
-					  (maxkeylen * 8),
-					  &trans_key);
-	if (res != TEE_SUCCESS) {
-		EMSG("Can not allocate transient object 0x%x", res);
-		goto out1;
-	}
+/* Buffer size a firmware needs for 'ncores' cores, record included */
+static size_t fw_required_size(const struct mve_fw_layout *layout,
+			       uint32_t ncores, bool l1)
+{
+	return mve_fw_data_size(layout, ncores) +
+		mve_fw_tables_size(layout, ncores, l1) + FW_RECORD_SIZE;
+}
 
-	res = TEE_PopulateTransientObject(trans_key, &attrs, 1);
-	if (res != TEE_SUCCESS) {
-		EMSG("Populate transient object error");
-		goto out2;
-	}
-	res = TEE_SetOperationKey(op, trans_key);
-	if (res != TEE_SUCCESS) {
-		EMSG("Can not set operation key");
-		goto out2;
-	}
+/*
+ * Whether the legacy descriptor can describe the tables from buffer page
+ * 'tables_page': a single L2 table per core, the tables of all cores
+ * physically contiguous at a 32-bit address.
+ */
+static bool fits_v1_desc(const struct mve_fw_layout *layout, uint32_t ncores,
+			 const struct mve_fw_phys *phys, size_t tables_page)
+{
+	return layout->num_l2pages == 1 &&
+		mve_fw_phys_contiguous(phys, tables_page, ncores) &&
+		mve_fw_page_phys(phys, tables_page) +
+		ncores * MVE_MMU_PAGE_SIZE - 1 <= UINT32_MAX;
+}
+
+/*
+ * Without room for the extended descriptor, the caller expects tables the
+ * legacy descriptor describes. Report the descriptor size needed when that
+ * does not hold. The extended descriptor needs the L1 tables of all cores
+ * physically contiguous.
+ */
+static TEE_Result check_fw_desc(const struct mve_fw_layout *layout,
+				uint32_t ncores, bool l1,
+				const struct mve_fw_phys *phys, size_t tables,
+				TEE_Param *desc)
+{
+	size_t tables_page = tables >> MVE_MMU_PAGE_SHIFT;
 
-	TEE_CipherInit(op, NULL, 0);
-	res = TEE_CipherDoFinal(op, srcdata, srclen, destdata, destlen);
-	if (res != TEE_SUCCESS) {
-		EMSG("Can not do AES %x", res);
-		goto out2;
+	if (l1) {
+		if (mve_fw_phys_contiguous(phys, tables_page +
+					   ncores * layout->num_l2pages,
+					   ncores))
+			return TEE_SUCCESS;
+
+		EMSG("Firmware L1 page tables are not physically contiguous");
+		return TEE_ERROR_NOT_SUPPORTED;
 	}
-out2:
-	TEE_FreeTransientObject(trans_key);
-out1:
-	TEE_FreeOperation(op);
-out:
-	return res;
+
+	if (fits_v1_desc(layout, ncores, phys, tables_page))
+		return TEE_SUCCESS;
+
+	EMSG("Firmware page tables need the extended descriptor");
+	desc->memref.size = sizeof(struct mve_fw_secure_descriptor_ext);
+	return TEE_ERROR_SHORT_BUFFER;
 }
 
-static TEE_Result verify_firmware_signature(const void *chunk,
-			uint32_t chunkLen)
+/*
+ * Fill the page tables at offset 'tables' of the firmware buffer and the
+ * descriptor, which is extended when 'l1' is set. The descriptor memref is
+ * updated with the size written and added to 'written'.
+ */
+static void fill_fw_tables(uint8_t *fw_addr, const struct mve_fw_phys *phys,
+			   size_t tables, const struct mve_fw_layout *layout,
+			   uint32_t ncores, bool l1, TEE_Param *desc,
+			   struct cache_range_set *written)
 {
-	TEE_Result res = TEE_SUCCESS;
-	TEE_OperationHandle op = TEE_HANDLE_NULL;
-	void *hash = NULL;
-	uint32_t hashlen = FIRMWARE_SIGNATURE_LEN;
+	struct mve_fw_secure_descriptor_ext *ext = desc->memref.buffer;
+	size_t tables_page = tables >> MVE_MMU_PAGE_SHIFT;
+	size_t l2_pages = (size_t)ncores * layout->num_l2pages;
+	phys_addr_t l2pages_phys = mve_fw_page_phys(phys, tables_page);
 
-	res = TEE_AllocateOperation(&op, TEE_ALG_SHA1, TEE_MODE_DIGEST, 0);
-	if (res != TEE_SUCCESS)
-		goto out;
+	fill_l2pages(fw_addr, phys, layout, fw_addr + tables, ncores, &ext->base);
 
-	hash = TEE_Malloc(hashlen, 0);
-	if (!hash) {
-		EMSG("Malloc memory failed!\n");
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
+	if (!l1) {
+		ext->base.l2pages = (uint32_t)l2pages_phys;
+		desc->memref.size = sizeof(ext->base);
+	} else {
+		fill_l1pages(fw_addr + tables + l2_pages * MVE_MMU_PAGE_SIZE,
+			     phys, tables_page, layout, ncores);
+		ext->base.l2pages = 0;
+		if (fits_v1_desc(layout, ncores, phys, tables_page))
+			ext->base.l2pages = (uint32_t)l2pages_phys;
+		ext->num_l2pages = layout->num_l2pages;
+		ext->reserved = 0;
+		ext->l1pages = mve_fw_page_phys(phys, tables_page + l2_pages);
+		ext->l2pages = l2pages_phys;
+		desc->memref.size = sizeof(*ext);
 	}
 
-	res = TEE_DigestDoFinal(op, chunk, chunkLen - FIRMWARE_SIGNATURE_LEN,
-			hash, &hashlen);
-	if (res != TEE_SUCCESS) {
-		EMSG("Digest failed!");
-		goto out;
-	}
+	cache_range_add(written, ext, desc->memref.size);
+}
 
-	if (TEE_MemCompare((char *)chunk + chunkLen -
-			FIRMWARE_SIGNATURE_LEN,
-			hash, hashlen) != 0 ) {
-		EMSG("Verify firmware hash failed!");
-		res = TEE_ERROR_CORRUPT_OBJECT;
-	}
-out:
-	if (op)
-		TEE_FreeOperation(op);
+/*
+ * A memref is mapped from a single piece of shared memory, with one secure
+ * attribute and one set of access rights: checking its first byte checks
+ * all of it. Zero sized buffers have nothing to check.
+ */
+static TEE_Result check_secure_buf(uint32_t access, void *buf, size_t size)
+{
+	return TEE_CheckMemoryAccessRights(access | TEE_MEMORY_ACCESS_SECURE,
+					   buf, size ? 1 : 0);
+}
 
-	if (hash)
-		TEE_Free(hash);
-	return res;
+/*
+ * Refuse buffers firmware was loaded into, in this instance or an earlier
+ * one as far as their load record tells, for commands writing caller chosen
+ * data or zeroes.
+ */
+static TEE_Result check_not_fw_buf(uint8_t *buf, size_t size)
+{
+	uint64_t pa;
+
+	if (!size)
+		return TEE_SUCCESS;
+	if (sdp_phys_addr(buf, &pa) != TEE_SUCCESS)
+		return TEE_ERROR_ACCESS_DENIED;
+	if (fw_pages_contain(&fw_loaded, pa) || fw_record_present(buf, size))
+		return TEE_ERROR_ACCESS_DENIED;
+	return TEE_SUCCESS;
 }
 
-static TEE_Result decrypt_video_firmware(void *srcdata, size_t srclen,
-		void *destdata, uint32_t *destlen)
+/* Whether a worker claimed any of the 'npages' pages */
+static bool pages_claimed(const struct sdp_phys_pages *pages, size_t npages)
 {
-	TEE_Result res = TEE_SUCCESS;
+	struct worker_session *s;
 
-	res = decrypt_firmware(srcdata, srclen, destdata, destlen);
-	if (res != TEE_SUCCESS) {
-		EMSG("Decrypt firmware failed (0x%x)", res);
-		return res;
-	}
+	for (s = worker_sessions; s; s = s->next)
+		if (fw_pages_overlap(&s->claim, pages, npages))
+			return true;
+	return false;
+}
+
+/*
+ * Translate the pages of the firmware buffer, which need not be physically
+ * contiguous but must all be within reach of the MVE. Release with
+ * sdp_phys_pages_put().
+ */
+static TEE_Result get_fw_phys(uint8_t *fw_addr, size_t fw_size,
+			      struct sdp_phys_pages *pages,
+			      struct mve_fw_phys *phys)
+{
+	size_t npages = fw_size >> MVE_MMU_PAGE_SHIFT;
+	phys_addr_t last;
+	size_t i;
+
+	if (fw_size % MVE_MMU_PAGE_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (fw_size > SEDGET_FW_BUF_MAX_SIZE)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	if (sdp_phys_pages_get(fw_addr, npages, pages) != TEE_SUCCESS)
+		return TEE_ERROR_ACCESS_DENIED;
+
+	phys->base = pages->base;
+	phys->pfns = pages->pfns;
 
-	res = verify_firmware_signature(destdata, *destlen);
-	if (res != TEE_SUCCESS) {
-		EMSG("Verify firmware signature failed (0x%x)", res);
-		return res;
+	last = pages->pfns ? 0 : pages->base + fw_size - 1;
+	for (i = 0; pages->pfns && i < npages; i++)
+		if (mve_fw_page_phys(phys, i) + MVE_MMU_PAGE_SIZE - 1 > last)
+			last = mve_fw_page_phys(phys, i) + MVE_MMU_PAGE_SIZE - 1;
+
+	if (last > MVE_MMU_PADDR_MAX) {
+		EMSG("Secure buffer beyond MVE physical address range");
+		sdp_phys_pages_put(pages);
+		return TEE_ERROR_NOT_SUPPORTED;
 	}
 
-	return res;
+	return TEE_SUCCESS;
 }
 
-/* A TA have no reason to retrieve physical address of buffers;
- * call helper PTA to retrieve this */
-static uint8_t *get_phys_address(TEE_Param *param)
+/* Invalidate, zero and add to 'written' a range of the firmware buffer */
+static TEE_Result clear_fw_range(uint8_t *addr, size_t len,
+				 struct cache_range_set *written)
 {
+	struct cache_range_set stale;
 	TEE_Result rc;
-	TEE_UUID pta_uuid = PTA_SDP_PTA_UUID;
-	TEE_TASessionHandle sess = TEE_HANDLE_NULL;
-	uint32_t param_types;
-	TEE_Param p[TEE_NUM_PARAMS];
-	param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
-				      TEE_PARAM_TYPE_VALUE_OUTPUT,
-				      TEE_PARAM_TYPE_NONE,
-				      TEE_PARAM_TYPE_NONE);
-	p[0].memref.buffer = param->memref.buffer;
-	p[0].memref.size = param->memref.size;
-	rc = TEE_OpenTASession(&pta_uuid, 0, 0, NULL, &sess, NULL);
-	if (rc == TEE_SUCCESS) {
-		rc = TEE_InvokeTACommand(sess, 0, PTA_CMD_SDP_VIRT_TO_PHYS,
-					 param_types, p, NULL);
-		if(rc != TEE_SUCCESS) {
-			return NULL;
-		}
-		TEE_CloseTASession(sess);
+
+	cache_range_init(&stale);
+	cache_range_add(&stale, addr, len);
+	rc = cache_range_invalidate(&stale);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	TEE_MemFill(addr, 0x0, len);
+	cache_range_add(written, addr, len);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Zero what the firmware is going to use but decryption did not write: the
+ * tail of the last image page, the shared and per-core BSS pages and the
+ * 'tables_size' bytes of page tables at 'tables'. Space between the BSS
+ * pages and the page tables is never mapped to the MVE and is left
+ * untouched. The cleared ranges are added to 'written'.
+ */
+static TEE_Result zero_fw_unwritten(uint8_t *fw_addr, size_t tables,
+				    size_t tables_size, uint32_t image_len,
+				    const struct mve_fw_layout *layout,
+				    uint32_t ncores,
+				    struct cache_range_set *written)
+{
+	size_t image_end = layout->num_pages << MVE_MMU_PAGE_SHIFT;
+	size_t data_end = mve_fw_data_size(layout, ncores);
+	TEE_Result rc;
+
+	/* image pages were invalidated before decryption */
+	rc = clear_fw_range(fw_addr + image_end, data_end - image_end, written);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	TEE_MemFill(fw_addr + image_len, 0x0, image_end - image_len);
+	cache_range_add(written, fw_addr + image_len, image_end - image_len);
+
+	return clear_fw_range(fw_addr + tables, tables_size, written);
+}
+
+/*
+ * Decrypt and verify a firmware package into 'fw_addr', or copy the image
+ * from the cache when the same package was loaded before. 'layout'
+ * receives the layout section of the package, if any.
+ */
+static TEE_Result get_fw_image(const void *pkg, size_t pkg_size,
+			       uint8_t *fw_addr, uint32_t *len,
+			       uint8_t *image_digest,
+			       struct fw_pkg_layout *layout)
+{
+	uint8_t pkg_digest[FW_DIGEST_LEN];
+	TEE_Result rc;
+
+	if (fw_cache_enabled()) {
+		rc = fw_package_digest(pkg, pkg_size, pkg_digest);
+		if (rc != TEE_SUCCESS)
+			return rc;
+
+		rc = fw_cache_get(pkg_digest, fw_addr, len, image_digest,
+				  layout);
+		if (rc != TEE_ERROR_ITEM_NOT_FOUND)
+			return rc;
+	}
+
+	/* the key of a new entry must cover the bytes actually decrypted */
+	rc = fw_decrypt_image(pkg, pkg_size, fw_addr, len, image_digest,
+			      fw_cache_enabled() ? pkg_digest : NULL, layout);
+	if (rc != TEE_SUCCESS) {
+		EMSG("fw_decrypt_image failed: 0x%x\n", rc);
+		return rc;
 	}
 
-	/* LIMIT: current mve mmu cares for 32bit address */
-	return (uint8_t *)((uintptr_t)p[1].value.a << 32 | p[1].value.b);
+	if (fw_cache_enabled())
+		fw_cache_put(pkg_digest, fw_addr, *len, image_digest, layout);
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Page layout of the image at 'fw_addr', from the layout section of its
+ * package when it has one, else walking the bitmap of the image header
+ */
+static TEE_Result get_fw_layout(const uint8_t *fw_addr, size_t len,
+				const struct fw_pkg_layout *pkg_layout,
+				struct mve_fw_layout *layout)
+{
+	if (pkg_layout->data)
+		return mve_fw_get_pkg_layout(fw_addr, len, pkg_layout->data,
+					     pkg_layout->len, layout);
+	return mve_fw_get_layout(fw_addr, len, layout);
 }
 
 /*
- * Basic Secure Data Path access test commands:
- * - command INJECT: copy from non secure input into secure output.
+ * LOAD_FW, or FINISH_FW when 'decrypted' is set: the image was decrypted in
+ * place by worker TAs and only needs verifying.
  */
 static TEE_Result sedget_video_load_firmware(uint32_t types,
-		TEE_Param params[TEE_NUM_PARAMS])
+		TEE_Param params[TEE_NUM_PARAMS], bool decrypted)
 {
 	TEE_Result rc;
 	const int ns_idx = 0;       /* nonsecure buffer index */
 	const int sec_idx = 1;      /* secure buffer index */
 	const int fw_desc_idx = 2;  /* fw load descriptor buffer index */
 	const int ncores_idx = 3;
-	uint8_t *fw_addr, *fw_phys_addr;
-	uint8_t *l2pages, *l2pages_phys;
+	uint8_t *fw_addr;
+	size_t fw_size, tables, tables_size, min_size;
 	uint32_t len;
-	struct mve_fw_secure_descriptor *fw_secure_desc;
-	int ncores = 1;
+	struct mve_fw_layout layout;
+	struct fw_pkg_layout pkg_layout = { NULL, 0 };
+	struct fw_load_record record;
+	struct cache_range_set written;
+	struct sdp_phys_pages pages;
+	struct mve_fw_phys phys;
+	uint32_t ncores = 1;
+	bool l1;
 
 	if (types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
 				     TEE_PARAM_TYPE_MEMREF_OUTPUT,
@@ -193,17 +351,33 @@ static TEE_Result sedget_video_load_firmware(uint32_t types,
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	if (params[sec_idx].memref.size <
-	    params[ns_idx].memref.size + MVE_MMU_PAGE_SIZE)
+	ncores = params[ncores_idx].value.a;
+	if (ncores == 0 || ncores > MVE_MAX_CORES)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* the exact size is only known once the image is decrypted */
+	min_size = params[ns_idx].memref.size + ncores * MVE_MMU_PAGE_SIZE +
+		   FW_RECORD_SIZE;
+	if (params[sec_idx].memref.size < min_size) {
+		params[sec_idx].memref.size = min_size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (params[fw_desc_idx].memref.size <
+	    sizeof(struct mve_fw_secure_descriptor)) {
+		params[fw_desc_idx].memref.size =
+			sizeof(struct mve_fw_secure_descriptor);
 		return TEE_ERROR_SHORT_BUFFER;
+	}
+	l1 = params[fw_desc_idx].memref.size >=
+		sizeof(struct mve_fw_secure_descriptor_ext);
 
 	/*
 	 * We could rely on the TEE to provide consistent buffer/size values
 	 * to reference a buffer with a unique and consistent secure attribute
 	 * value. Hence it is safe enough (and more optimal) to test only the
-	 * secure attribute of a single byte of it. Yet, since the current
-	 * test does not deal with performance, let check the secure attribute
-	 * of each byte of the buffer.
+	 * secure attribute of a single byte of it, see check_secure_buf().
+	 * The non secure buffers are still checked in full.
 	 */
 	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
 					 TEE_MEMORY_ACCESS_READ |
@@ -215,18 +389,17 @@ static TEE_Result sedget_video_load_firmware(uint32_t types,
 		return rc;
 	}
 
-	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
-					 TEE_MEMORY_ACCESS_WRITE |
-					 TEE_MEMORY_ACCESS_SECURE,
-					 params[sec_idx].memref.buffer,
-					 params[sec_idx].memref.size);
+	rc = check_secure_buf(TEE_MEMORY_ACCESS_ANY_OWNER |
+			      TEE_MEMORY_ACCESS_WRITE,
+			      params[sec_idx].memref.buffer,
+			      params[sec_idx].memref.size);
 	if (rc != TEE_SUCCESS) {
 		EMSG("TEE_CheckMemoryAccessRights(secure) failed %x\n", rc);
 		return rc;
 	}
 
 	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
-					 TEE_MEMORY_ACCESS_READ |
+					 TEE_MEMORY_ACCESS_WRITE |
 					 TEE_MEMORY_ACCESS_NONSECURE,
 					 params[fw_desc_idx].memref.buffer,
 					 params[fw_desc_idx].memref.size);
@@ -235,105 +408,816 @@ static TEE_Result sedget_video_load_firmware(uint32_t types,
 		return rc;
 	}
 
-	fw_phys_addr = get_phys_address(&params[sec_idx]);
-	if(NULL == fw_phys_addr) {
-		return TEE_ERROR_ACCESS_DENIED;
+	fw_addr = params[sec_idx].memref.buffer;
+	fw_size = params[sec_idx].memref.size;
+
+	rc = get_fw_phys(fw_addr, fw_size, &pages, &phys);
+	if (rc != TEE_SUCCESS)
+		return rc;
+	if (pages_claimed(&pages, fw_size >> MVE_MMU_PAGE_SHIFT)) {
+		EMSG("Firmware buffer still written by a worker");
+		rc = TEE_ERROR_BUSY;
+		goto out;
 	}
+	/* leave room for at least one table per core */
+	len = fw_tables_offset(fw_size, ncores * MVE_MMU_PAGE_SIZE);
 
-	ncores = params[ncores_idx].value.a;
+	if (decrypted) {
+		/* the workers' writes are in the caches: no invalidation */
+		rc = fw_verify_image(params[ns_idx].memref.buffer,
+				     params[ns_idx].memref.size, fw_addr, &len,
+				     record.image_digest,
+				     &record.digest_seg_size, &pkg_layout);
+		if (rc != TEE_SUCCESS) {
+			TEE_MemFill(fw_addr, 0x0,
+				    MIN(params[ns_idx].memref.size, len));
+			goto out;
+		}
+	} else {
+		/* decrypted image is never larger than its package */
+		cache_range_init(&written);
+		cache_range_add(&written, fw_addr,
+				MIN((params[ns_idx].memref.size + MVE_MMU_PAGE_SIZE - 1) &
+				    ~(MVE_MMU_PAGE_SIZE - 1), len));
+		rc = cache_range_invalidate(&written);
+		if (rc != TEE_SUCCESS)
+			goto out;
+
+		rc = get_fw_image(params[ns_idx].memref.buffer,
+				  params[ns_idx].memref.size, fw_addr, &len,
+				  record.image_digest, &pkg_layout);
+		if (rc != TEE_SUCCESS)
+			goto out;
+		record.digest_seg_size = 0;
+	}
 
-#ifdef CFG_CACHE_API
-	rc = TEE_CacheInvalidate(params[sec_idx].memref.buffer,
-				 params[sec_idx].memref.size);
+	rc = get_fw_layout(fw_addr, len, &pkg_layout, &layout);
+	if (rc != TEE_SUCCESS)
+		goto err_wipe;
+
+	if (fw_required_size(&layout, ncores, l1) > fw_size) {
+		EMSG("Firmware BSS does not fit in secure buffer");
+		params[sec_idx].memref.size = fw_required_size(&layout, ncores,
+							       l1);
+		rc = TEE_ERROR_SHORT_BUFFER;
+		goto err_wipe;
+	}
+
+	tables_size = mve_fw_tables_size(&layout, ncores, l1);
+	tables = fw_tables_offset(fw_size, tables_size);
+	rc = check_fw_desc(&layout, ncores, l1, &phys, tables,
+			   &params[fw_desc_idx]);
+	if (rc != TEE_SUCCESS)
+		goto err_wipe;
+
+	/* decryption wrote the image; only clear what it did not cover */
+	cache_range_init(&written);
+	cache_range_add(&written, fw_addr, len);
+	rc = zero_fw_unwritten(fw_addr, tables, tables_size, len, &layout,
+			       ncores, &written);
+	if (rc != TEE_SUCCESS)
+		goto err_wipe;
+
+	record.image_len = len;
+	record.ncores = ncores;
+	record.flags = l1 ? FW_RECORD_FLAG_L1 : 0;
+	record.phys_addr = phys.base;
+	record.size = fw_size;
+	rc = fw_record_write(fw_addr, fw_size, &record, &pkg_layout);
+	if (rc != TEE_SUCCESS)
+		goto err_wipe;
+
+	rc = fw_pages_add(&fw_loaded, &pages, fw_size >> MVE_MMU_PAGE_SHIFT);
+	if (rc != TEE_SUCCESS)
+		goto err_wipe;
+
+	fill_fw_tables(fw_addr, &phys, tables, &layout, ncores, l1,
+		       &params[fw_desc_idx], &written);
+
+	rc = cache_range_flush(&written);
+	mve_fw_put_layout(&layout);
+	goto out;
+
+err_wipe:
+	mve_fw_put_layout(&layout);
+	TEE_MemFill(fw_addr, 0x0, len);
+out:
+	fw_pkg_layout_put(&pkg_layout);
+	sdp_phys_pages_put(&pages);
+	return rc;
+}
+
+static bool range_fits(uint32_t offset, uint32_t len, size_t size)
+{
+	return offset <= size && len <= size - offset;
+}
+
+/*
+ * Secure Data Path inject: copy a batch of access units from non secure
+ * input into secure output buffers. Buffers are checked once per batch,
+ * secure ones on a single byte; entries are read into secure memory one at
+ * a time and bounds checked against them before copying. Buffers firmware
+ * was loaded into, in this instance or an earlier one as far as their load
+ * record tells, are refused.
+ */
+static TEE_Result sedget_video_inject(uint32_t types,
+		TEE_Param params[TEE_NUM_PARAMS])
+{
+	TEE_Result rc;
+	const int ns_idx = 0;       /* nonsecure staging buffer index */
+	const int list_idx = 1;     /* entry list index */
+	const int dst_idx = 2;      /* first secure buffer index */
+	struct sedget_inject_entry *list = params[list_idx].memref.buffer;
+	struct sedget_inject_entry entry;
+	/* one set per buffer so merged ranges never span two buffers */
+	struct cache_range_set written[SEDGET_INJECT_MAX_DST];
+	uint8_t *src = params[ns_idx].memref.buffer;
+	uint8_t *dst[SEDGET_INJECT_MAX_DST] = { NULL };
+	size_t dst_size[SEDGET_INJECT_MAX_DST] = { 0 };
+	size_t count, i;
+	uint32_t ndst;
+
+	if (types == TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				     TEE_PARAM_TYPE_MEMREF_INOUT,
+				     TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				     TEE_PARAM_TYPE_MEMREF_OUTPUT)) {
+		ndst = 2;
+	} else if (types == TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+					    TEE_PARAM_TYPE_MEMREF_INOUT,
+					    TEE_PARAM_TYPE_MEMREF_OUTPUT,
+					    TEE_PARAM_TYPE_NONE)) {
+		ndst = 1;
+	} else {
+		EMSG("bad parameters types: %x", (unsigned)types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (params[list_idx].memref.size % sizeof(entry))
+		return TEE_ERROR_BAD_PARAMETERS;
+	count = params[list_idx].memref.size / sizeof(entry);
+
+	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
+					 TEE_MEMORY_ACCESS_READ |
+					 TEE_MEMORY_ACCESS_NONSECURE,
+					 src, params[ns_idx].memref.size);
 	if (rc != TEE_SUCCESS) {
-		EMSG("TEE_CacheFlush(%p, %x) failed: 0x%x\n",
-		     params[sec_idx].memref.buffer,
-		     params[sec_idx].memref.size, rc);
+		EMSG("TEE_CheckMemoryAccessRights(nsec) failed %x\n", rc);
 		return rc;
 	}
-#endif /* CFG_CACHE_API */
 
-	fw_addr = params[sec_idx].memref.buffer;
-	len = params[sec_idx].memref.size - (ncores * MVE_MMU_PAGE_SIZE);
-	l2pages = fw_addr + len;
-	l2pages_phys = fw_phys_addr + len;
-
-	/* Empty sdp buffer */
-	TEE_MemFill(fw_addr, 0x0,
-			params[sec_idx].memref.size);
-
-	rc = decrypt_video_firmware(params[ns_idx].memref.buffer,
-				       params[ns_idx].memref.size,
-				       fw_addr,
-				       &len);
+	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
+					 TEE_MEMORY_ACCESS_READ |
+					 TEE_MEMORY_ACCESS_WRITE |
+					 TEE_MEMORY_ACCESS_NONSECURE,
+					 list, params[list_idx].memref.size);
 	if (rc != TEE_SUCCESS) {
-		EMSG("decrypt_video_firmware failed: 0x%x\n", rc);
+		EMSG("TEE_CheckMemoryAccessRights(nsec) failed %x\n", rc);
 		return rc;
 	}
 
-	fw_secure_desc = (struct mve_fw_secure_descriptor *)
-				params[fw_desc_idx].memref.buffer;
+	for (i = 0; i < ndst; i++) {
+		cache_range_init(&written[i]);
+		dst[i] = params[dst_idx + i].memref.buffer;
+		dst_size[i] = params[dst_idx + i].memref.size;
+
+		rc = check_secure_buf(TEE_MEMORY_ACCESS_ANY_OWNER |
+				      TEE_MEMORY_ACCESS_WRITE,
+				      dst[i], dst_size[i]);
+		if (rc != TEE_SUCCESS) {
+			EMSG("TEE_CheckMemoryAccessRights(secure) failed %x\n",
+			     rc);
+			return rc;
+		}
+
+		/* only input buffers, never firmware the MVE runs */
+		rc = check_not_fw_buf(dst[i], dst_size[i]);
+		if (rc != TEE_SUCCESS) {
+			EMSG("Inject into a firmware buffer");
+			return rc;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		/* non secure memory: work on a private copy of the entry */
+		TEE_MemMove(&entry, list + i, sizeof(entry));
+
+		if (entry.dst >= ndst ||
+		    !range_fits(entry.src_offset, entry.len,
+				params[ns_idx].memref.size) ||
+		    !range_fits(entry.dst_offset, entry.len,
+				dst_size[entry.dst])) {
+			list[i].result = TEE_ERROR_BAD_PARAMETERS;
+			continue;
+		}
+
+		TEE_MemMove(dst[entry.dst] + entry.dst_offset,
+			    src + entry.src_offset, entry.len);
+		cache_range_add(&written[entry.dst],
+				dst[entry.dst] + entry.dst_offset, entry.len);
+		list[i].result = TEE_SUCCESS;
+	}
+
+	/* the codec reads input buffers from memory */
+	for (i = 0; i < ndst; i++) {
+		rc = cache_range_flush(&written[i]);
+		if (rc != TEE_SUCCESS)
+			return rc;
+	}
 
-	fill_l2pages(fw_addr, fw_phys_addr, len, l2pages,
-		     ncores,fw_secure_desc);
-	fw_secure_desc->l2pages = (uint32_t)(uintptr_t)l2pages_phys;
+	return TEE_SUCCESS;
+}
 
-#ifdef CFG_CACHE_API
-	rc = TEE_CacheFlush(params[sec_idx].memref.buffer,
-			    params[sec_idx].memref.size);
+/*
+ * Zero ranges of secure buffers being released so they can be handed to
+ * another session or client. Zeroes are flushed to memory before
+ * returning, as the next user may be a device. Entries of buffers firmware
+ * was loaded into are refused as INJECT refuses them; RELEASE_FW wipes
+ * those.
+ */
+static TEE_Result sedget_video_scrub(uint32_t types,
+		TEE_Param params[TEE_NUM_PARAMS])
+{
+	TEE_Result rc;
+	const int list_idx = 0;     /* entry list index */
+	const int buf_idx = 1;      /* first secure buffer index */
+	struct sedget_scrub_entry *list = params[list_idx].memref.buffer;
+	struct sedget_scrub_entry entry;
+	/* one set per buffer so merged ranges never span two buffers */
+	struct cache_range_set written[SEDGET_SCRUB_MAX_BUF];
+	uint8_t *buf[SEDGET_SCRUB_MAX_BUF];
+	size_t buf_size[SEDGET_SCRUB_MAX_BUF];
+	TEE_Result buf_rc[SEDGET_SCRUB_MAX_BUF];
+	size_t count, i;
+	uint32_t nbuf;
+
+	if (TEE_PARAM_TYPE_GET(types, list_idx) != TEE_PARAM_TYPE_MEMREF_INOUT)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* secure buffers come first, unused parameters last */
+	for (nbuf = 0; nbuf < SEDGET_SCRUB_MAX_BUF; nbuf++)
+		if (TEE_PARAM_TYPE_GET(types, buf_idx + nbuf) !=
+		    TEE_PARAM_TYPE_MEMREF_OUTPUT)
+			break;
+	for (i = nbuf; i < SEDGET_SCRUB_MAX_BUF; i++)
+		if (TEE_PARAM_TYPE_GET(types, buf_idx + i) !=
+		    TEE_PARAM_TYPE_NONE)
+			break;
+	if (nbuf == 0 || i < SEDGET_SCRUB_MAX_BUF) {
+		EMSG("bad parameters types: %x", (unsigned)types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (params[list_idx].memref.size % sizeof(entry))
+		return TEE_ERROR_BAD_PARAMETERS;
+	count = params[list_idx].memref.size / sizeof(entry);
+
+	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
+					 TEE_MEMORY_ACCESS_READ |
+					 TEE_MEMORY_ACCESS_WRITE |
+					 TEE_MEMORY_ACCESS_NONSECURE,
+					 list, params[list_idx].memref.size);
 	if (rc != TEE_SUCCESS) {
-		EMSG("TEE_CacheFlush(%p, %x) failed: 0x%x\n",
-		     params[sec_idx].memref.buffer,
-		     params[sec_idx].memref.size, rc);
+		EMSG("TEE_CheckMemoryAccessRights(nsec) failed %x\n", rc);
 		return rc;
 	}
-#endif /* CFG_CACHE_API */
-#ifdef CFG_CACHE_API
-	rc = TEE_CacheFlush(params[fw_desc_idx].memref.buffer,
-			    params[fw_desc_idx].memref.size);
+
+	for (i = 0; i < nbuf; i++) {
+		cache_range_init(&written[i]);
+		buf[i] = params[buf_idx + i].memref.buffer;
+		buf_size[i] = params[buf_idx + i].memref.size;
+
+		rc = check_secure_buf(TEE_MEMORY_ACCESS_ANY_OWNER |
+				      TEE_MEMORY_ACCESS_WRITE,
+				      buf[i], buf_size[i]);
+		if (rc != TEE_SUCCESS) {
+			EMSG("TEE_CheckMemoryAccessRights(secure) failed %x\n",
+			     rc);
+			return rc;
+		}
+
+		buf_rc[i] = check_not_fw_buf(buf[i], buf_size[i]);
+		if (buf_rc[i] != TEE_SUCCESS)
+			EMSG("Scrub of a firmware buffer");
+	}
+
+	for (i = 0; i < count; i++) {
+		/* non secure memory: work on a private copy of the entry */
+		TEE_MemMove(&entry, list + i, sizeof(entry));
+
+		if (entry.buf >= nbuf ||
+		    !range_fits(entry.offset, entry.len, buf_size[entry.buf])) {
+			list[i].result = TEE_ERROR_BAD_PARAMETERS;
+			continue;
+		}
+		if (buf_rc[entry.buf] != TEE_SUCCESS) {
+			list[i].result = buf_rc[entry.buf];
+			continue;
+		}
+
+		TEE_MemFill(buf[entry.buf] + entry.offset, 0x0, entry.len);
+		cache_range_add(&written[entry.buf],
+				buf[entry.buf] + entry.offset, entry.len);
+		list[i].result = TEE_SUCCESS;
+	}
+
+	for (i = 0; i < nbuf; i++) {
+		rc = cache_range_flush(&written[i]);
+		if (rc != TEE_SUCCESS)
+			return rc;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Wipe a firmware buffer about to be freed, page tables and load record
+ * included, and forget its pages so that they can be used for input
+ * buffers again. Only whole buffers ending with a record of this TA are
+ * taken, so the pages of a firmware still loaded elsewhere stay refused.
+ * The MVE must not run the firmware anymore.
+ */
+static TEE_Result sedget_video_release_firmware(uint32_t types,
+		TEE_Param params[TEE_NUM_PARAMS])
+{
+	TEE_Result rc;
+	const int sec_idx = 0;      /* secure buffer index */
+	uint8_t *fw_addr = params[sec_idx].memref.buffer;
+	size_t fw_size = params[sec_idx].memref.size;
+	struct fw_load_record record;
+	struct cache_range_set written;
+	struct sdp_phys_pages pages;
+	struct mve_fw_phys phys;
+
+	if (types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INOUT,
+				     TEE_PARAM_TYPE_NONE,
+				     TEE_PARAM_TYPE_NONE,
+				     TEE_PARAM_TYPE_NONE)) {
+		EMSG("bad parameters types: %x", (unsigned)types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	rc = check_secure_buf(TEE_MEMORY_ACCESS_ANY_OWNER |
+			      TEE_MEMORY_ACCESS_READ |
+			      TEE_MEMORY_ACCESS_WRITE,
+			      fw_addr, fw_size);
 	if (rc != TEE_SUCCESS) {
-		EMSG("TEE_CacheFlush(%p, %x) failed: 0x%x\n",
-		     params[fw_desc_idx].memref.buffer,
-		     params[fw_desc_idx].memref.size, rc);
+		EMSG("TEE_CheckMemoryAccessRights(secure) failed %x\n", rc);
 		return rc;
 	}
-#endif /* CFG_CACHE_API */
+
+	rc = get_fw_phys(fw_addr, fw_size, &pages, &phys);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	/* the record as in memory; its page is never written by the MVE */
+	cache_range_init(&written);
+	cache_range_add(&written, fw_addr + fw_size - FW_RECORD_SIZE,
+			FW_RECORD_SIZE);
+	rc = cache_range_invalidate(&written);
+	if (rc != TEE_SUCCESS)
+		goto out;
+
+	/* the image may be gone, e.g. after a failed reload */
+	rc = fw_record_check(fw_addr, fw_size, phys.base, &record);
+	if (rc != TEE_SUCCESS)
+		goto out;
+
+	cache_range_init(&written);
+	rc = clear_fw_range(fw_addr, fw_size, &written);
+	if (rc == TEE_SUCCESS)
+		rc = cache_range_flush(&written);
+	if (rc == TEE_SUCCESS)
+		rc = fw_pages_remove(&fw_loaded, &pages,
+				     fw_size >> MVE_MMU_PAGE_SHIFT);
+out:
+	sdp_phys_pages_put(&pages);
 	return rc;
 }
 
-TEE_Result TA_CreateEntryPoint(void)
+/*
+ * Rebuild the page tables of a loaded firmware for another number of cores.
+ * The image and shared pages are kept as they are; per-core BSS pages are
+ * zeroed when added and scrubbed when dropped, and every core gets fresh
+ * page tables. The MVE must not be running the firmware meanwhile.
+ */
+static TEE_Result sedget_video_rescale_firmware(uint32_t types,
+		TEE_Param params[TEE_NUM_PARAMS])
 {
+	TEE_Result rc;
+	const int sec_idx = 0;      /* secure buffer index */
+	const int fw_desc_idx = 1;  /* fw load descriptor buffer index */
+	const int ncores_idx = 2;
+	uint8_t *fw_addr = params[sec_idx].memref.buffer;
+	size_t fw_size = params[sec_idx].memref.size;
+	uint32_t ncores = params[ncores_idx].value.a;
+	struct mve_fw_layout layout;
+	struct fw_pkg_layout pkg_layout = { NULL, 0 };
+	struct fw_load_record record;
+	struct cache_range_set written;
+	size_t old_end, new_end, old_tables, new_tables;
+	struct sdp_phys_pages pages;
+	struct mve_fw_phys phys;
+	bool l1;
+
+	if (types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INOUT,
+				     TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				     TEE_PARAM_TYPE_VALUE_INPUT,
+				     TEE_PARAM_TYPE_NONE)) {
+		EMSG("bad parameters types: %x", (unsigned)types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (ncores == 0 || ncores > MVE_MAX_CORES)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[fw_desc_idx].memref.size <
+	    sizeof(struct mve_fw_secure_descriptor)) {
+		params[fw_desc_idx].memref.size =
+			sizeof(struct mve_fw_secure_descriptor);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	l1 = params[fw_desc_idx].memref.size >=
+		sizeof(struct mve_fw_secure_descriptor_ext);
+
+	rc = check_secure_buf(TEE_MEMORY_ACCESS_ANY_OWNER |
+			      TEE_MEMORY_ACCESS_READ |
+			      TEE_MEMORY_ACCESS_WRITE,
+			      fw_addr, fw_size);
+	if (rc != TEE_SUCCESS) {
+		EMSG("TEE_CheckMemoryAccessRights(secure) failed %x\n", rc);
+		return rc;
+	}
+
+	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
+					 TEE_MEMORY_ACCESS_WRITE |
+					 TEE_MEMORY_ACCESS_NONSECURE,
+					 params[fw_desc_idx].memref.buffer,
+					 params[fw_desc_idx].memref.size);
+	if (rc != TEE_SUCCESS) {
+		EMSG("TEE_CheckMemoryAccessRights(nsec) failed %x\n", rc);
+		return rc;
+	}
+
+	rc = get_fw_phys(fw_addr, fw_size, &pages, &phys);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	/*
+	 * Verify what is in memory, which is what the MVE sees. Loading
+	 * flushed everything it wrote so no line of the buffer is dirty.
+	 */
+	cache_range_init(&written);
+	cache_range_add(&written, fw_addr, fw_size);
+	rc = cache_range_invalidate(&written);
+	if (rc != TEE_SUCCESS)
+		goto put_phys;
+
+	rc = fw_record_read(fw_addr, fw_size, phys.base, &record, &pkg_layout);
+	if (rc != TEE_SUCCESS)
+		goto put_phys;
+
+	/* the layout the image was loaded with, which the MVE runs on */
+	if ((record.flags & FW_RECORD_FLAG_PKG_LAYOUT) && !pkg_layout.data) {
+		EMSG("Layout of the firmware not kept, load it again");
+		rc = TEE_ERROR_NOT_SUPPORTED;
+		goto put_phys;
+	}
+
+	rc = get_fw_layout(fw_addr, record.image_len, &pkg_layout, &layout);
+	if (rc != TEE_SUCCESS)
+		goto put_phys;
+
+	old_end = mve_fw_data_size(&layout, record.ncores);
+	new_end = mve_fw_data_size(&layout, ncores);
+	old_tables = fw_tables_offset(fw_size,
+			mve_fw_tables_size(&layout, record.ncores,
+					   record.flags & FW_RECORD_FLAG_L1));
+
+	if (fw_required_size(&layout, ncores, l1) > fw_size) {
+		EMSG("Firmware BSS does not fit in secure buffer");
+		rc = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
+
+	new_tables = fw_tables_offset(fw_size,
+				      mve_fw_tables_size(&layout, ncores, l1));
+	rc = check_fw_desc(&layout, ncores, l1, &phys, new_tables,
+			   &params[fw_desc_idx]);
+	if (rc != TEE_SUCCESS)
+		goto out;
+
+	/* fresh BSS for added cores, scrub what removed cores left behind */
+	cache_range_init(&written);
+	if (new_end != old_end) {
+		rc = clear_fw_range(fw_addr + MIN(old_end, new_end),
+				    new_end > old_end ? new_end - old_end :
+							old_end - new_end,
+				    &written);
+		if (rc != TEE_SUCCESS)
+			goto out;
+	}
+
+	/* old and new tables both end at the record */
+	rc = clear_fw_range(fw_addr + MIN(old_tables, new_tables),
+			    fw_size - FW_RECORD_SIZE - MIN(old_tables, new_tables),
+			    &written);
+	if (rc != TEE_SUCCESS)
+		goto out;
+
+	fill_fw_tables(fw_addr, &phys, new_tables, &layout, ncores, l1,
+		       &params[fw_desc_idx], &written);
+
+	record.ncores = ncores;
+	record.flags = l1 ? FW_RECORD_FLAG_L1 : 0;
+	rc = fw_record_write(fw_addr, fw_size, &record, &pkg_layout);
+	if (rc != TEE_SUCCESS)
+		goto out;
+
+	/* loaded by an earlier instance of the TA */
+	rc = fw_pages_add(&fw_loaded, &pages, fw_size >> MVE_MMU_PAGE_SHIFT);
+	if (rc != TEE_SUCCESS)
+		goto out;
+
+	rc = cache_range_flush(&written);
+out:
+	mve_fw_put_layout(&layout);
+put_phys:
+	fw_pkg_layout_put(&pkg_layout);
+	sdp_phys_pages_put(&pages);
+	return rc;
+}
+
+/*
+ * CLAIM: a worker is about to write the pages of its memref. A session
+ * holds one claim at a time, a new one replaces the last.
+ */
+static TEE_Result sedget_video_claim(struct worker_session *s,
+		uint32_t types, TEE_Param params[TEE_NUM_PARAMS])
+{
+	TEE_Result rc;
+	const int sec_idx = 0;      /* secure buffer index */
+	uintptr_t start = (uintptr_t)params[sec_idx].memref.buffer;
+	size_t size = params[sec_idx].memref.size;
+	struct sdp_phys_pages pages;
+	uintptr_t end;
+	size_t npages;
+
+	if (!s)
+		return TEE_ERROR_ACCESS_DENIED;
+
+	if (types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				     TEE_PARAM_TYPE_NONE,
+				     TEE_PARAM_TYPE_NONE,
+				     TEE_PARAM_TYPE_NONE)) {
+		EMSG("bad parameters types: %x", (unsigned)types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	fw_pages_release(&s->claim);
+	if (!size)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	rc = check_secure_buf(TEE_MEMORY_ACCESS_ANY_OWNER |
+			      TEE_MEMORY_ACCESS_READ,
+			      (void *)start, size);
+	if (rc != TEE_SUCCESS) {
+		EMSG("TEE_CheckMemoryAccessRights(secure) failed %x\n", rc);
+		return rc;
+	}
+
+	/* memrefs are mapped in whole pages */
+	end = (start + size + SDP_PHYS_PAGE_SIZE - 1) &
+	      ~(uintptr_t)(SDP_PHYS_PAGE_SIZE - 1);
+	start &= ~(uintptr_t)(SDP_PHYS_PAGE_SIZE - 1);
+	npages = (end - start) >> SDP_PHYS_PAGE_SHIFT;
+	if (end - start > SEDGET_FW_BUF_MAX_SIZE)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	if (sdp_phys_pages_get((void *)start, npages, &pages) != TEE_SUCCESS)
+		return TEE_ERROR_ACCESS_DENIED;
+
+	if (fw_pages_overlap(&fw_loaded, &pages, npages)) {
+		EMSG("Refusing a worker claim on firmware pages");
+		rc = TEE_ERROR_ACCESS_DENIED;
+	} else {
+		rc = fw_pages_add(&s->claim, &pages, npages);
+	}
+
+	sdp_phys_pages_put(&pages);
+	return rc;
+}
+
+/* UNCLAIM: the worker is done writing the pages it claimed */
+static TEE_Result sedget_video_unclaim(struct worker_session *s,
+		uint32_t types)
+{
+	if (!s)
+		return TEE_ERROR_ACCESS_DENIED;
+
+	if (types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+				     TEE_PARAM_TYPE_NONE,
+				     TEE_PARAM_TYPE_NONE,
+				     TEE_PARAM_TYPE_NONE)) {
+		EMSG("bad parameters types: %x", (unsigned)types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	fw_pages_release(&s->claim);
 	return TEE_SUCCESS;
 }
 
+#ifdef CFG_SEDGET_BENCH
+static uint32_t elapsed_ms(const TEE_Time *start)
+{
+	TEE_Time now;
+
+	TEE_GetSystemTime(&now);
+	return (now.seconds - start->seconds) * 1000 +
+		now.millis - start->millis;
+}
+
+/*
+ * Firmware buffer zeroing micro benchmark: decrypt the firmware as LOAD_FW
+ * does, then time 'iterations' rounds of zeroing the whole secure buffer
+ * against zeroing only the regions decryption leaves unwritten. Both
+ * rounds invalidate what they zero beforehand and flush it afterwards, as
+ * a load would. The secure buffer is left wiped.
+ */
+static TEE_Result sedget_video_bench_zero(uint32_t types,
+		TEE_Param params[TEE_NUM_PARAMS])
+{
+	TEE_Result rc;
+	const int ns_idx = 0;       /* nonsecure buffer index */
+	const int sec_idx = 1;      /* secure buffer index */
+	const int arg_idx = 2;      /* ncores and iterations */
+	const int res_idx = 3;      /* elapsed times */
+	uint8_t *fw_addr = params[sec_idx].memref.buffer;
+	size_t fw_size = params[sec_idx].memref.size;
+	uint32_t ncores = params[arg_idx].value.a;
+	uint32_t iterations = params[arg_idx].value.b;
+	struct mve_fw_layout layout;
+	struct cache_range_set written;
+	TEE_Time start;
+	size_t tables_size;
+	uint32_t len, i;
+
+	if (types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				     TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				     TEE_PARAM_TYPE_VALUE_INPUT,
+				     TEE_PARAM_TYPE_VALUE_OUTPUT))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (ncores == 0 || ncores > MVE_MAX_CORES ||
+	    fw_size < ncores * MVE_MMU_PAGE_SIZE + FW_RECORD_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
+					 TEE_MEMORY_ACCESS_WRITE |
+					 TEE_MEMORY_ACCESS_SECURE,
+					 fw_addr, fw_size);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	len = fw_tables_offset(fw_size, ncores * MVE_MMU_PAGE_SIZE);
+	rc = fw_decrypt_image(params[ns_idx].memref.buffer,
+			      params[ns_idx].memref.size, fw_addr, &len, NULL,
+			      NULL, NULL);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	rc = mve_fw_get_layout(fw_addr, len, &layout);
+	if (rc != TEE_SUCCESS)
+		goto out;
+	if (fw_required_size(&layout, ncores, false) > fw_size) {
+		rc = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
+	tables_size = mve_fw_tables_size(&layout, ncores, false);
+
+	TEE_GetSystemTime(&start);
+	for (i = 0; i < iterations && rc == TEE_SUCCESS; i++) {
+		cache_range_init(&written);
+		rc = clear_fw_range(fw_addr, fw_size, &written);
+		if (rc == TEE_SUCCESS)
+			rc = cache_range_flush(&written);
+	}
+	params[res_idx].value.a = elapsed_ms(&start);
+
+	TEE_GetSystemTime(&start);
+	for (i = 0; i < iterations && rc == TEE_SUCCESS; i++) {
+		cache_range_init(&written);
+		rc = zero_fw_unwritten(fw_addr,
+				       fw_tables_offset(fw_size, tables_size),
+				       tables_size, len, &layout, ncores,
+				       &written);
+		if (rc == TEE_SUCCESS)
+			rc = cache_range_flush(&written);
+	}
+	params[res_idx].value.b = elapsed_ms(&start);
+	if (rc != TEE_SUCCESS)
+		goto out;
+
+	IMSG("zero %u x %zu bytes: full %u ms, regions %u ms", iterations,
+	     fw_size, params[res_idx].value.a, params[res_idx].value.b);
+out:
+	mve_fw_put_layout(&layout);
+	TEE_MemFill(fw_addr, 0x0, fw_size);
+	return rc;
+}
+#endif /* CFG_SEDGET_BENCH */
+
+/*
+ * The TA is single instance and multi session: every session shares the
+ * instance state set up here (keyed crypto operations, the SDP PTA session)
+ * and OP-TEE runs one entry point of the instance at a time, so commands
+ * of different sessions never interleave. The instance is kept alive once
+ * created so that state is paid for once.
+ */
+TEE_Result TA_CreateEntryPoint(void)
+{
+	return fw_crypto_init();
+}
+
 void TA_DestroyEntryPoint(void)
 {
+	sdp_phys_close();
+	fw_pages_release(&fw_loaded);
+	fw_cache_release();
+	fw_crypto_release();
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t nParamTypes,
 		TEE_Param pParams[TEE_NUM_PARAMS],
 		void **ppSessionContext)
 {
+	static const TEE_UUID worker_uuid = SEDGET_WORKER_TA_UUID;
+	struct worker_session *s;
+	TEE_Identity client;
+	TEE_Result rc;
+
 	(void)nParamTypes;
 	(void)pParams;
-	(void)ppSessionContext;
+
+	rc = TEE_GetPropertyAsIdentity(TEE_PROPSET_CURRENT_CLIENT,
+				       "gpd.client.identity", &client);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	/* only worker TA sessions get a context, for their claims */
+	if (client.login != TEE_LOGIN_TRUSTED_APP ||
+	    memcmp(&client.uuid, &worker_uuid, sizeof(worker_uuid)))
+		return TEE_SUCCESS;
+
+	s = TEE_Malloc(sizeof(*s), TEE_MALLOC_FILL_ZERO);
+	if (!s)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	s->next = worker_sessions;
+	worker_sessions = s;
+	*ppSessionContext = s;
 	return TEE_SUCCESS;
 }
 
 void TA_CloseSessionEntryPoint(void *pSessionContext)
 {
-	(void)pSessionContext;
+	struct worker_session *s = pSessionContext;
+	struct worker_session **p;
+
+	if (!s)
+		return;
+
+	for (p = &worker_sessions; *p != s; p = &(*p)->next)
+		;
+	*p = s->next;
+	fw_pages_release(&s->claim);
+	TEE_Free(s);
 }
 
 TEE_Result TA_InvokeCommandEntryPoint(void *pSessionContext,
 		uint32_t nCommandID, uint32_t nParamTypes,
 		TEE_Param pParams[TEE_NUM_PARAMS])
 {
-	(void)pSessionContext;
-
 	switch (nCommandID) {
 	case SEDGET_VIDEO_TA_CMD_LOAD_FW:
-		return sedget_video_load_firmware(nParamTypes, pParams);
+		return sedget_video_load_firmware(nParamTypes, pParams, false);
+	case SEDGET_VIDEO_TA_CMD_FINISH_FW:
+		return sedget_video_load_firmware(nParamTypes, pParams, true);
+	case SEDGET_VIDEO_TA_CMD_RESCALE_FW:
+		return sedget_video_rescale_firmware(nParamTypes, pParams);
+	case SEDGET_VIDEO_TA_CMD_INJECT:
+		return sedget_video_inject(nParamTypes, pParams);
+	case SEDGET_VIDEO_TA_CMD_SCRUB:
+		return sedget_video_scrub(nParamTypes, pParams);
+	case SEDGET_VIDEO_TA_CMD_RELEASE_FW:
+		return sedget_video_release_firmware(nParamTypes, pParams);
+	case SEDGET_VIDEO_TA_CMD_CLAIM:
+		return sedget_video_claim(pSessionContext, nParamTypes,
+					  pParams);
+	case SEDGET_VIDEO_TA_CMD_UNCLAIM:
+		return sedget_video_unclaim(pSessionContext, nParamTypes);
+#ifdef CFG_SEDGET_BENCH
+	case SEDGET_VIDEO_TA_CMD_BENCH_ZERO:
+		return sedget_video_bench_zero(nParamTypes, pParams);
+#endif
 	default:
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
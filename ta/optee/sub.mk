@@ -1,4 +1,12 @@
 global-incdirs-y += ../arm/mve
 global-incdirs-y += ../include/optee
 srcs-y += sedget_video_ta.c
+srcs-y += fw_crypto.c
+srcs-y += fw_keys.c
+srcs-y += fw_segments.c
+srcs-y += sdp_phys.c
+srcs-y += cache_range.c
+srcs-y += fw_record.c
+srcs-y += fw_pages.c
+srcs-y += fw_cache.c
 srcs-y += ../arm/mve/mve_fw_mmu.c
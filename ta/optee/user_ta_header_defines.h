@@ -8,13 +8,30 @@
 
 #include "sedget_video_ta.h"
 
+#ifndef CFG_SEDGET_FW_CACHE_SIZE
+#define CFG_SEDGET_FW_CACHE_SIZE 0
+#endif
+
 #define TA_UUID       SEDGET_VIDEO_TA_UUID
 
 #define TA_FLAGS      (TA_FLAG_USER_MODE | TA_FLAG_EXEC_DDR | \
+                        TA_FLAG_SINGLE_INSTANCE | \
+                        TA_FLAG_MULTI_SESSION | \
+                        TA_FLAG_INSTANCE_KEEP_ALIVE | \
                         TA_FLAG_SECURE_DATA_PATH | \
                         TA_FLAG_CACHE_MAINTENANCE)
 
 #define TA_STACK_SIZE (2 * 1024)
-#define TA_DATA_SIZE  (32 * 1024)
+/*
+ * The heap holds at worst, besides the crypto operations, the page list of
+ * a scattered firmware buffer of SEDGET_FW_BUF_MAX_SIZE (64 KiB), a package
+ * header of up to 64 KiB with a copy of its layout section and the
+ * segments built from it (64 KiB each), the runs of pages holding firmware
+ * (64 KiB), those claimed by workers (64 KiB in all, a contiguous buffer
+ * taking one run per worker) and a 16 KiB bounce buffer; plus the
+ * firmware image cache and its own bounce buffer.
+ */
+#define TA_DATA_SIZE  (448 * 1024 + (CFG_SEDGET_FW_CACHE_SIZE ? \
+                        CFG_SEDGET_FW_CACHE_SIZE + 32 * 1024 : 0))
 
 #endif /* USER_TA_HEADER_DEFINES_H */
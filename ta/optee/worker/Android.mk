@@ -0,0 +1,5 @@
+LOCAL_PATH := $(call my-dir)
+
+local_module := 5d3c8e1a-2f47-4c09-9b61-7e0ad435c28f.ta
+
+include $(BUILD_OPTEE_MK)
@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2017-2018, ARM Limited
+ */
+
+#include <string.h>
+#include <tee_api.h>
+#include <tee_internal_api_extensions.h>
+#include <tee_internal_api.h>
+#include <tee_ta_api.h>
+#include <trace.h>
+
+#include "sedget_video_ta.h"
+/* shared with the main TA, whose directory holds another TA header */
+#include "../fw_keys.h"
+#include "../fw_segments.h"
+#include "../cache_range.h"
+
+/*
+ * Operations of this instance. Every session gets an instance of its own,
+ * so that the host can decrypt segments of one package on several cores.
+ */
+static TEE_OperationHandle ctr_op = TEE_HANDLE_NULL;
+static TEE_OperationHandle header_mac_op = TEE_HANDLE_NULL;
+static TEE_OperationHandle segment_mac_op = TEE_HANDLE_NULL;
+
+/* Session to the main TA, which keeps track of firmware pages */
+static TEE_TASessionHandle video_sess = TEE_HANDLE_NULL;
+
+/*
+ * Claim the pages of 'size' bytes at 'buf' from the main TA before writing
+ * them: it refuses pages holding firmware, and loads firmware into none of
+ * them until unclaim_pages().
+ */
+static TEE_Result claim_pages(void *buf, size_t size)
+{
+	static const TEE_UUID video_uuid = SEDGET_VIDEO_TA_UUID;
+	const uint32_t types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+					       TEE_PARAM_TYPE_NONE,
+					       TEE_PARAM_TYPE_NONE,
+					       TEE_PARAM_TYPE_NONE);
+	TEE_Param params[TEE_NUM_PARAMS];
+	uint32_t err_origin;
+	TEE_Result rc;
+
+	if (video_sess == TEE_HANDLE_NULL) {
+		rc = TEE_OpenTASession(&video_uuid, TEE_TIMEOUT_INFINITE, 0,
+				       NULL, &video_sess, &err_origin);
+		if (rc != TEE_SUCCESS) {
+			EMSG("Opening a session to the main TA failed %x", rc);
+			video_sess = TEE_HANDLE_NULL;
+			return rc;
+		}
+	}
+
+	memset(params, 0, sizeof(params));
+	params[0].memref.buffer = buf;
+	params[0].memref.size = size;
+	return TEE_InvokeTACommand(video_sess, TEE_TIMEOUT_INFINITE,
+				   SEDGET_VIDEO_TA_CMD_CLAIM, types, params,
+				   &err_origin);
+}
+
+static void unclaim_pages(void)
+{
+	const uint32_t types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+					       TEE_PARAM_TYPE_NONE,
+					       TEE_PARAM_TYPE_NONE,
+					       TEE_PARAM_TYPE_NONE);
+	TEE_Param params[TEE_NUM_PARAMS];
+	uint32_t err_origin;
+	TEE_Result rc;
+
+	memset(params, 0, sizeof(params));
+	rc = TEE_InvokeTACommand(video_sess, TEE_TIMEOUT_INFINITE,
+				 SEDGET_VIDEO_TA_CMD_UNCLAIM, types, params,
+				 &err_origin);
+	if (rc != TEE_SUCCESS) {
+		/* the claim goes with the session */
+		TEE_CloseTASession(video_sess);
+		video_sess = TEE_HANDLE_NULL;
+	}
+}
+
+static TEE_Result sedget_worker_decrypt(uint32_t types,
+		TEE_Param params[TEE_NUM_PARAMS])
+{
+	const int ns_idx = 0;       /* nonsecure buffer index */
+	const int sec_idx = 1;      /* secure buffer index */
+	const int seg_idx = 2;
+	uint32_t first, count;
+	struct fw_seg_header h;
+	struct cache_range_set stale;
+	uint8_t *image;
+	size_t start, end;
+	TEE_Result rc;
+
+	if (types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				     TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				     TEE_PARAM_TYPE_VALUE_INPUT,
+				     TEE_PARAM_TYPE_NONE)) {
+		EMSG("bad parameters types: %x", (unsigned)types);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
+					 TEE_MEMORY_ACCESS_READ |
+					 TEE_MEMORY_ACCESS_NONSECURE,
+					 params[ns_idx].memref.buffer,
+					 params[ns_idx].memref.size);
+	if (rc != TEE_SUCCESS) {
+		EMSG("TEE_CheckMemoryAccessRights(nsec) failed %x\n", rc);
+		return rc;
+	}
+
+	/* plain firmware must never reach non secure memory */
+	rc = TEE_CheckMemoryAccessRights(TEE_MEMORY_ACCESS_ANY_OWNER |
+					 TEE_MEMORY_ACCESS_WRITE |
+					 TEE_MEMORY_ACCESS_SECURE,
+					 params[sec_idx].memref.buffer,
+					 params[sec_idx].memref.size);
+	if (rc != TEE_SUCCESS) {
+		EMSG("TEE_CheckMemoryAccessRights(secure) failed %x\n", rc);
+		return rc;
+	}
+
+	rc = fw_seg_header_get(params[ns_idx].memref.buffer,
+			       params[ns_idx].memref.size, header_mac_op, &h);
+	if (rc == TEE_ERROR_ITEM_NOT_FOUND)
+		return TEE_ERROR_BAD_FORMAT;
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	first = params[seg_idx].value.a;
+	count = params[seg_idx].value.b;
+	if (count == 0 || first >= h.segs->num_segments ||
+	    count > h.segs->num_segments - first) {
+		rc = TEE_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+
+	if (params[sec_idx].memref.size < h.hdr->payload_size) {
+		rc = TEE_ERROR_SHORT_BUFFER;
+		goto out;
+	}
+
+	image = params[sec_idx].memref.buffer;
+	start = fw_seg_offset(&h, first);
+	end = fw_seg_offset(&h, first + count - 1) +
+	      fw_seg_size(&h, first + count - 1);
+
+	rc = claim_pages(image + start, end - start);
+	if (rc != TEE_SUCCESS) {
+		if (rc == TEE_ERROR_ACCESS_DENIED)
+			EMSG("Refusing to decrypt into a firmware buffer");
+		goto out;
+	}
+
+	/* as LOAD_FW does for the whole image */
+	cache_range_init(&stale);
+	cache_range_add(&stale, image + start, end - start);
+	rc = cache_range_invalidate(&stale);
+	if (rc == TEE_SUCCESS)
+		rc = fw_seg_decrypt(&h, ctr_op, segment_mac_op,
+				    params[ns_idx].memref.buffer, image, first,
+				    count);
+	unclaim_pages();
+out:
+	fw_seg_header_put(&h);
+	return rc;
+}
+
+TEE_Result TA_CreateEntryPoint(void)
+{
+	TEE_Result rc;
+
+	rc = fw_keys_alloc_aes(&ctr_op, TEE_ALG_AES_CTR, TEE_MODE_DECRYPT);
+	if (rc != TEE_SUCCESS)
+		return rc;
+
+	rc = fw_keys_alloc_mac(&header_mac_op, FW_KEY_LABEL_PKG_HEADER);
+	if (rc != TEE_SUCCESS)
+		goto err;
+
+	rc = fw_keys_alloc_mac(&segment_mac_op, FW_KEY_LABEL_PKG_SEGMENT);
+	if (rc != TEE_SUCCESS)
+		goto err;
+
+	return TEE_SUCCESS;
+err:
+	TA_DestroyEntryPoint();
+	return rc;
+}
+
+void TA_DestroyEntryPoint(void)
+{
+	if (video_sess != TEE_HANDLE_NULL)
+		TEE_CloseTASession(video_sess);
+	video_sess = TEE_HANDLE_NULL;
+	if (segment_mac_op != TEE_HANDLE_NULL)
+		TEE_FreeOperation(segment_mac_op);
+	segment_mac_op = TEE_HANDLE_NULL;
+	if (header_mac_op != TEE_HANDLE_NULL)
+		TEE_FreeOperation(header_mac_op);
+	header_mac_op = TEE_HANDLE_NULL;
+	if (ctr_op != TEE_HANDLE_NULL)
+		TEE_FreeOperation(ctr_op);
+	ctr_op = TEE_HANDLE_NULL;
+}
+
+TEE_Result TA_OpenSessionEntryPoint(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS],
+		void **ppSessionContext)
+{
+	(void)nParamTypes;
+	(void)pParams;
+	(void)ppSessionContext;
+	return TEE_SUCCESS;
+}
+
+void TA_CloseSessionEntryPoint(void *pSessionContext)
+{
+	(void)pSessionContext;
+}
+
+TEE_Result TA_InvokeCommandEntryPoint(void *pSessionContext,
+		uint32_t nCommandID, uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	(void)pSessionContext;
+
+	switch (nCommandID) {
+	case SEDGET_WORKER_TA_CMD_DECRYPT:
+		return sedget_worker_decrypt(nParamTypes, pParams);
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+}
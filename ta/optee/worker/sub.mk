@@ -0,0 +1,6 @@
+global-incdirs-y += ../../arm/mve
+global-incdirs-y += ../../include/optee
+srcs-y += sedget_worker_ta.c
+srcs-y += ../fw_keys.c
+srcs-y += ../fw_segments.c
+srcs-y += ../cache_range.c
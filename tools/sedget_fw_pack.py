@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-2-Clause
+#
+# Copyright (c) 2017-2018, ARM Limited
+#
+# Package a plain MVE firmware binary into an encrypted .efwb file loadable
+# by the Secure Gadget Library Trusted Application.
+# See ta/arm/mve/mve_fw_package.h for the package layout.
+
+import argparse
+import hashlib
+import hmac
+import os
+import struct
+import sys
+
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+from cryptography.hazmat.primitives.ciphers.aead import AESGCM
+
+# Test purpose key, must match fw_encryption_key in ta/optee/fw_crypto.c
+DEFAULT_KEY = b'0123456789ABCDEF'
+
+PKG_MAGIC = 0x42574653
+PKG_VERSION = 1
+PKG_CIPHER_AES_GCM = 1
+PKG_CIPHER_AES_CTR = 2
+PKG_FLAG_LAYOUT = 1 << 0
+
+# struct mve_fw_pkg_header
+PKG_HEADER = struct.Struct('<IHHIIII16s')
+# struct mve_fw_pkg_segments, without the MACs
+PKG_SEGMENTS = struct.Struct('<II')
+# struct mve_fw_pkg_layout, without the runs
+PKG_LAYOUT = struct.Struct('<IIIIII')
+# struct mve_fw_pkg_run
+PKG_RUN = struct.Struct('<IIII')
+
+# struct fw_header fields the page layout depends on, see mve_fw_mmu.h
+FW_HEADER_SIZE = 180
+FW_HEADER_LAYOUT = struct.Struct('<III16I')
+FW_HEADER_LAYOUT_OFFSET = 96
+FW_HEADER_SHARED = struct.Struct('<II')
+FW_HEADER_SHARED_OFFSET = 172
+
+# enum mve_fw_segment_type
+SEG_TEXT = 0
+SEG_SHARED = 1
+SEG_BSS = 2
+
+PAGE_SIZE = 4096
+PAGE_TABLE_ENTRIES = PAGE_SIZE // 4
+
+AES_BLOCK_SIZE = 16
+SIGNATURE_LEN = 32
+GCM_IV_LEN = 12
+MAC_LEN = 32
+SEGMENT_ALIGN = 4096
+DEFAULT_SEGMENT_SIZE = 64 * 1024
+
+# Labels of the keys derived from the firmware key, see ta/optee/fw_keys.h
+KEY_LABEL_PKG_HEADER = b'sedget firmware package header'
+KEY_LABEL_PKG_SEGMENT = b'sedget firmware package segment'
+
+
+def pad(data, align):
+    return data + bytes(-len(data) % align)
+
+
+def pages(size):
+    return (size + PAGE_SIZE - 1) // PAGE_SIZE
+
+
+def image_layout(image):
+    """struct mve_fw_pkg_layout, as mve_fw_get_layout() derives it"""
+    if len(image) < FW_HEADER_SIZE:
+        sys.exit('image too small for a firmware header')
+    fields = FW_HEADER_LAYOUT.unpack_from(image, FW_HEADER_LAYOUT_OFFSET)
+    text_length, bss_start, bitmap_size = fields[:3]
+    bitmap = fields[3:]
+    rw_start, rw_size = FW_HEADER_SHARED.unpack_from(image,
+                                                     FW_HEADER_SHARED_OFFSET)
+    if text_length > len(image) or bitmap_size > 32 * len(bitmap):
+        sys.exit('invalid firmware header')
+
+    text_pages = pages(text_length)
+    counts = [text_pages, 0, 0]
+    runs = []
+
+    def add(entry, kind):
+        if runs:
+            last = runs[-1]
+            if (last[3] == kind and last[0] + last[1] == entry and
+                    last[2] + last[1] == counts[kind]):
+                last[1] += 1
+                counts[kind] += 1
+                return
+        runs.append([entry, 1, counts[kind], kind])
+        counts[kind] += 1
+
+    # the first MMU entry is left blank
+    if text_pages:
+        runs.append([1, text_pages, 0, SEG_TEXT])
+    entry = 1 + text_pages
+    page = bss_start // PAGE_SIZE
+    for i in range(bitmap_size):
+        # 32 bit address arithmetic, as the MVE sees it
+        addr = (page * PAGE_SIZE) & 0xffffffff
+        if rw_start <= addr < (rw_start + rw_size) & 0xffffffff:
+            add(entry, SEG_SHARED)
+        elif bitmap[i // 32] & (1 << (i % 32)):
+            add(entry, SEG_BSS)
+        page += 1
+        entry += 1
+
+    num_l2pages = ((1 + text_pages + bitmap_size + PAGE_TABLE_ENTRIES - 1) //
+                   PAGE_TABLE_ENTRIES)
+    return (PKG_LAYOUT.pack(pages(len(image)), text_pages, counts[SEG_SHARED],
+                            counts[SEG_BSS], num_l2pages, len(runs)) +
+            b''.join(PKG_RUN.pack(*run) for run in runs))
+
+
+def pack_legacy(key, image):
+    """AES-ECB of the image followed by its SHA1 signature"""
+    plain = pad(image, AES_BLOCK_SIZE)
+    plain += pad(hashlib.sha1(plain).digest(), SIGNATURE_LEN)
+    enc = Cipher(algorithms.AES(key), modes.ECB()).encryptor()
+    return enc.update(plain) + enc.finalize()
+
+
+def pack_gcm(key, image, layout=True):
+    """Clear header (AAD), AES-GCM encrypted image and tag"""
+    iv = os.urandom(GCM_IV_LEN)
+    section = image_layout(image) if layout else b''
+    header = PKG_HEADER.pack(PKG_MAGIC, PKG_VERSION,
+                             PKG_HEADER.size + len(section),
+                             PKG_CIPHER_AES_GCM,
+                             PKG_FLAG_LAYOUT if layout else 0,
+                             len(image), 0, pad(iv, 16))
+    header += section
+    return header + AESGCM(key).encrypt(iv, image, header)
+
+
+def derive_key(key, label):
+    return hmac.new(key, label + b'\0', hashlib.sha256).digest()
+
+
+def pack_ctr(key, image, segment_size=DEFAULT_SEGMENT_SIZE, layout=True):
+    """Clear header and segment MACs, AES-CTR image and header MAC"""
+    if not image:
+        sys.exit('empty image')
+    if segment_size <= 0 or segment_size % SEGMENT_ALIGN:
+        sys.exit('segment size must be a multiple of %d' % SEGMENT_ALIGN)
+
+    segment_key = derive_key(key, KEY_LABEL_PKG_SEGMENT)
+    macs = [hmac.new(segment_key, image[off:off + segment_size],
+                     hashlib.sha256).digest()
+            for off in range(0, len(image), segment_size)]
+    section = image_layout(image) if layout else b''
+    header_size = (PKG_HEADER.size + PKG_SEGMENTS.size + MAC_LEN * len(macs) +
+                   len(section))
+    if header_size > 0xffff:
+        sys.exit('too many segments, use larger ones')
+
+    iv = os.urandom(16)
+    header = PKG_HEADER.pack(PKG_MAGIC, PKG_VERSION, header_size,
+                             PKG_CIPHER_AES_CTR,
+                             PKG_FLAG_LAYOUT if layout else 0,
+                             len(image), 0, iv)
+    header += PKG_SEGMENTS.pack(segment_size, len(macs)) + b''.join(macs)
+    header += section
+
+    enc = Cipher(algorithms.AES(key), modes.CTR(iv)).encryptor()
+    header_mac = hmac.new(derive_key(key, KEY_LABEL_PKG_HEADER), header,
+                          hashlib.sha256).digest()
+    return header + enc.update(image) + enc.finalize() + header_mac
+
+
+PACKERS = {
+    'legacy': pack_legacy,
+    'gcm': pack_gcm,
+    'ctr': pack_ctr,
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Package MVE firmware into an encrypted .efwb file')
+    parser.add_argument('input', help='plain firmware binary')
+    parser.add_argument('output', help='encrypted firmware package')
+    parser.add_argument('--format', choices=sorted(PACKERS), default='gcm',
+                        help='package format (default: %(default)s)')
+    parser.add_argument('--key', type=bytes.fromhex,
+                        default=DEFAULT_KEY,
+                        help='AES-128 key as hex string')
+    parser.add_argument('--segment-size', type=int,
+                        default=DEFAULT_SEGMENT_SIZE,
+                        help='ctr format: bytes decrypted independently, '
+                             'a multiple of %d (default: %%(default)s)'
+                             % SEGMENT_ALIGN)
+    parser.add_argument('--no-layout', action='store_true',
+                        help='gcm and ctr formats: leave out the page '
+                             'layout section, the TA then derives it from '
+                             'the firmware header')
+    args = parser.parse_args()
+
+    if len(args.key) != 16:
+        sys.exit('key must be 16 bytes')
+
+    with open(args.input, 'rb') as f:
+        image = f.read()
+
+    opts = {}
+    if args.format == 'ctr':
+        opts['segment_size'] = args.segment_size
+    if args.format != 'legacy':
+        opts['layout'] = not args.no_layout
+
+    with open(args.output, 'wb') as f:
+        f.write(PACKERS[args.format](args.key, image, **opts))
+
+
+if __name__ == '__main__':
+    main()